@@ -0,0 +1,74 @@
+#include "Benchmark.h"
+
+#include "DeletionQueue.h"
+#include "TlsfAllocator.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+BENCHMARK("TlsfAllocator/allocate+free/lifo")
+{
+	constexpr size_t Count = 1024;
+
+	TlsfAllocator allocator(uint64_t(256) << 20);
+	std::vector<TlsfAllocator::Handle> handles(Count);
+
+	state.SetItemsPerIteration(Count);
+	state.Run([&]
+	{
+		for (size_t i = 0; i < Count; ++i)
+			handles[i] = allocator.Allocate(4096, 256)->handle;
+		for (size_t i = Count; i-- > 0;)
+			allocator.Free(handles[i]);
+	});
+}
+
+BENCHMARK("TlsfAllocator/allocate+free/random")
+{
+	// A steady state of textures and buffers of mixed sizes, freed in no particular order.
+	constexpr size_t LiveCount = 4096;
+	constexpr size_t OperationCount = 1024;
+
+	TlsfAllocator allocator(uint64_t(1) << 30);
+	std::mt19937 random(42);
+	std::uniform_int_distribution<uint64_t> sizes(64, 256 * 1024);
+	std::uniform_int_distribution<size_t> slots(0, LiveCount - 1);
+
+	std::vector<TlsfAllocator::Handle> live(LiveCount);
+	for (auto& handle : live)
+		handle = allocator.Allocate(sizes(random), 256)->handle;
+
+	// Drawn up front so that the random number generator is not measured.
+	std::vector<std::pair<size_t, uint64_t>> operations(OperationCount);
+	for (auto& operation : operations)
+		operation = {slots(random), sizes(random)};
+
+	state.SetItemsPerIteration(OperationCount);
+	state.Run([&]
+	{
+		for (const auto& [slot, size] : operations)
+		{
+			allocator.Free(live[slot]);
+			live[slot] = allocator.Allocate(size, 256)->handle;
+		}
+	});
+}
+
+BENCHMARK("DeletionQueue/push+retire")
+{
+	// About what a frame retires while textures stream in.
+	constexpr size_t Count = 256;
+
+	DeletionQueue queue;
+	uint64_t destroyed = 0;
+
+	state.SetItemsPerIteration(Count);
+	state.Run([&]
+	{
+		for (size_t i = 0; i < Count; ++i)
+			queue.Push([&destroyed] { ++destroyed; }, 1);
+		queue.Retire(queue.Submit());
+	});
+	benchmark::KeepAlive(destroyed);
+}
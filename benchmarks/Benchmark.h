@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A minimal benchmark harness, so that the suite builds wherever the core does without extra dependencies.
+// A benchmark prepares its data and then passes the measured body to State::Run(), which repeats it until the timing is stable.
+namespace benchmark
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Keeps the compiler from optimizing away a result that is never used otherwise.
+	template <class T>
+	void KeepAlive(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	class State
+	{
+		Clock::duration minTime_;
+		uint64_t itemsPerIteration_ = 0;
+		uint64_t bytesPerIteration_ = 0;
+
+		uint64_t iterations_ = 0;
+		double nanosecondsPerIteration_ = 0.0;
+
+	public:
+		explicit State(Clock::duration minTime)
+			: minTime_(minTime)
+		{
+		}
+
+		// What one iteration processes, for the throughput columns; e.g. pixels and their bytes for a conversion.
+		void SetItemsPerIteration(uint64_t items)
+		{
+			itemsPerIteration_ = items;
+		}
+
+		void SetBytesPerIteration(uint64_t bytes)
+		{
+			bytesPerIteration_ = bytes;
+		}
+
+		/**
+		Measures body, which runs one iteration.
+		\note The reported time is the best of several runs of at least minTime / Repetitions each; the best run is the one least
+		disturbed by the rest of the system.
+		*/
+		template <class TBody>
+		void Run(TBody&& body)
+		{
+			constexpr int Repetitions = 5;
+
+			const auto runTime = minTime_ / Repetitions;
+
+			// Grows the batch until it takes long enough to time.
+			uint64_t batch = 1;
+			for (;;)
+			{
+				const auto start = Clock::now();
+				for (uint64_t i = 0; i < batch; ++i)
+					body();
+				const auto elapsed = Clock::now() - start;
+
+				if (elapsed >= runTime || batch >= (uint64_t(1) << 40))
+					break;
+
+				const auto scale = elapsed.count() > 0 ? double(runTime.count()) / double(elapsed.count()) : 10.0;
+				batch = std::max(batch + 1, uint64_t(double(batch) * std::min(10.0, scale * 1.2)));
+			}
+
+			auto best = std::numeric_limits<double>::max();
+			for (int repetition = 0; repetition < Repetitions; ++repetition)
+			{
+				const auto start = Clock::now();
+				for (uint64_t i = 0; i < batch; ++i)
+					body();
+				const auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+				best = std::min(best, elapsed / double(batch));
+			}
+
+			iterations_ = batch * Repetitions;
+			nanosecondsPerIteration_ = best;
+		}
+
+		[[nodiscard]] uint64_t GetItemsPerIteration() const
+		{
+			return itemsPerIteration_;
+		}
+
+		[[nodiscard]] uint64_t GetBytesPerIteration() const
+		{
+			return bytesPerIteration_;
+		}
+
+		[[nodiscard]] uint64_t GetIterations() const
+		{
+			return iterations_;
+		}
+
+		// 0 when Run() was not called.
+		[[nodiscard]] double GetNanosecondsPerIteration() const
+		{
+			return nanosecondsPerIteration_;
+		}
+	};
+
+	struct Case
+	{
+		std::string name;
+		std::function<void(State&)> function;
+	};
+
+	inline std::vector<Case>& GetCases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	// Registers a benchmark from a static initializer, see BENCHMARK.
+	struct Registration
+	{
+		Registration(std::string name, std::function<void(State&)> function)
+		{
+			GetCases().push_back(Case{std::move(name), std::move(function)});
+		}
+	};
+}
+
+#define BENCHMARK_CONCATENATE_(a, b) a##b
+#define BENCHMARK_CONCATENATE(a, b) BENCHMARK_CONCATENATE_(a, b)
+
+// Defines and registers a benchmark: BENCHMARK("name") { ...; state.Run([&] { ... }); }
+#define BENCHMARK(name) \
+	static void BENCHMARK_CONCATENATE(Benchmark_, __LINE__)(benchmark::State& state); \
+	static const benchmark::Registration BENCHMARK_CONCATENATE(registration_, __LINE__)(name, &BENCHMARK_CONCATENATE(Benchmark_, __LINE__)); \
+	static void BENCHMARK_CONCATENATE(Benchmark_, __LINE__)(benchmark::State& state)
@@ -0,0 +1,156 @@
+#include "Benchmark.h"
+
+#include "HitRecorder.h"
+#include "VertexPacking.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Roughly what a frame of meshes submits through DrawGouraudPolygon.
+	constexpr uint32_t VertexCount = 4096;
+
+	struct EngineVertex
+	{
+		float position[3];
+		float u;
+		float v;
+		float light[4];
+		float fog[4];
+	};
+
+	std::vector<EngineVertex> MakeVertices()
+	{
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_real_distribution<float> coordinate(-4096.0f, 4096.0f);
+
+		std::vector<EngineVertex> vertices(VertexCount);
+		for (auto& vertex : vertices)
+		{
+			for (auto& component : vertex.position)
+				component = coordinate(random);
+			vertex.u = coordinate(random);
+			vertex.v = coordinate(random);
+			for (int i = 0; i < 4; ++i)
+			{
+				vertex.light[i] = unit(random) * 1.5f;
+				vertex.fog[i] = unit(random);
+			}
+		}
+		return vertices;
+	}
+
+	void BenchmarkPackGouraudVertex(benchmark::State& state, bool lit, bool fogged)
+	{
+		const auto vertices = MakeVertices();
+		const float uvScale[2] = {1.0f / 256.0f, 1.0f / 128.0f};
+		std::vector<vertex_packing::GouraudVertex> destination(VertexCount);
+
+		state.SetItemsPerIteration(VertexCount);
+		state.SetBytesPerIteration(VertexCount * sizeof(vertex_packing::GouraudVertex));
+		state.Run([&]
+		{
+			for (uint32_t i = 0; i < VertexCount; ++i)
+			{
+				const auto& vertex = vertices[i];
+				vertex_packing::PackGouraudVertex(
+					vertex.position,
+					vertex.u,
+					vertex.v,
+					lit ? vertex.light : nullptr,
+					fogged ? vertex.fog : nullptr,
+					uvScale,
+					destination[i]);
+			}
+			benchmark::KeepAlive(destination.data());
+		});
+	}
+}
+
+BENCHMARK("vertex_packing::PackGouraudVertex/lit")
+{
+	BenchmarkPackGouraudVertex(state, true, false);
+}
+
+BENCHMARK("vertex_packing::PackGouraudVertex/lit/fogged")
+{
+	BenchmarkPackGouraudVertex(state, true, true);
+}
+
+BENCHMARK("vertex_packing::PackGouraudVertex/modulated")
+{
+	BenchmarkPackGouraudVertex(state, false, false);
+}
+
+BENCHMARK("vertex_packing::ToColor")
+{
+	const auto vertices = MakeVertices();
+	std::vector<uint32_t> destination(VertexCount);
+
+	state.SetItemsPerIteration(VertexCount);
+	state.Run([&]
+	{
+		for (uint32_t i = 0; i < VertexCount; ++i)
+			destination[i] = vertex_packing::ToColor(vertices[i].light);
+		benchmark::KeepAlive(destination.data());
+	});
+}
+
+BENCHMARK("vertex_packing::WriteFanIndices/quads")
+{
+	// Most BSP surfaces and mesh faces are small fans.
+	constexpr uint32_t FanCount = 1024;
+	constexpr uint32_t FanSize = 4;
+	std::vector<uint16_t> destination(FanCount * (FanSize - 2) * 3);
+
+	state.SetItemsPerIteration(FanCount);
+	state.Run([&]
+	{
+		auto* indices = destination.data();
+		for (uint32_t i = 0; i < FanCount; ++i)
+			indices = vertex_packing::WriteFanIndices(uint16_t(i * FanSize), FanSize, indices);
+		benchmark::KeepAlive(destination.data());
+	});
+}
+
+BENCHMARK("vertex_packing::WriteFanIndices/16")
+{
+	constexpr uint32_t FanCount = 256;
+	constexpr uint32_t FanSize = 16;
+	std::vector<uint16_t> destination(FanCount * (FanSize - 2) * 3);
+
+	state.SetItemsPerIteration(FanCount);
+	state.Run([&]
+	{
+		auto* indices = destination.data();
+		for (uint32_t i = 0; i < FanCount; ++i)
+			indices = vertex_packing::WriteFanIndices(uint16_t(i * FanSize), FanSize, indices);
+		benchmark::KeepAlive(destination.data());
+	});
+}
+
+BENCHMARK("HitRecorder::Resolve/32x32")
+{
+	constexpr uint32_t Size = 32;
+
+	HitRecorder recorder;
+	const uint8_t record[8] = {};
+	std::vector<uint32_t> ids(Size * Size);
+	for (uint32_t i = 0; i < 64; ++i)
+	{
+		recorder.Push(record, sizeof(record));
+		const auto id = recorder.GetCurrentId();
+		recorder.Pop(sizeof(record), false);
+		for (uint32_t pixel = i; pixel < ids.size(); pixel += 67)
+			ids[pixel] = id;
+	}
+
+	state.SetItemsPerIteration(ids.size());
+	state.Run([&]
+	{
+		benchmark::KeepAlive(recorder.Resolve(ids.data(), Size, Size));
+	});
+}
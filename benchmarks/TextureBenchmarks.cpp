@@ -0,0 +1,119 @@
+#include "Benchmark.h"
+
+#include "BcDecoder.h"
+#include "TextureConversion.h"
+#include "TextureDiskCache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	std::vector<uint8_t> MakeRandomBytes(size_t size)
+	{
+		std::mt19937 random(42);
+		std::vector<uint8_t> bytes(size);
+		for (auto& byte : bytes)
+			byte = uint8_t(random());
+		return bytes;
+	}
+
+	std::vector<uint32_t> MakePalette()
+	{
+		std::vector<uint32_t> palette(256);
+		for (uint32_t i = 0; i < 256; ++i)
+			palette[i] = 0xFF000000 | i * 0x010101;
+		return palette;
+	}
+
+	void BenchmarkConvertP8(benchmark::State& state, uint32_t size, bool masked)
+	{
+		const auto pixelCount = size_t(size) * size;
+		const auto source = MakeRandomBytes(pixelCount);
+		const auto palette = MakePalette();
+		std::vector<uint32_t> destination(pixelCount);
+
+		state.SetItemsPerIteration(pixelCount);
+		state.SetBytesPerIteration(pixelCount * sizeof(uint32_t));
+		state.Run([&]
+		{
+			texture_conversion::ConvertP8(source.data(), palette.data(), masked, destination.data(), pixelCount);
+			benchmark::KeepAlive(destination.data());
+		});
+	}
+
+	void BenchmarkBcDecode(benchmark::State& state, bc::Format format, uint32_t size, uint32_t maxThreads)
+	{
+		// Any bytes are valid blocks, and random ones keep both BC1 color modes in the mix.
+		const auto source = MakeRandomBytes(bc::GetCompressedSize(format, size, size));
+		std::vector<uint32_t> destination(size_t(size) * size);
+
+		state.SetItemsPerIteration(destination.size());
+		state.SetBytesPerIteration(destination.size() * sizeof(uint32_t));
+		state.Run([&]
+		{
+			bc::Decode(format, source.data(), size, size, destination.data(), maxThreads);
+			benchmark::KeepAlive(destination.data());
+		});
+	}
+}
+
+BENCHMARK("texture_conversion::ConvertP8/256x256")
+{
+	BenchmarkConvertP8(state, 256, false);
+}
+
+BENCHMARK("texture_conversion::ConvertP8/256x256/masked")
+{
+	BenchmarkConvertP8(state, 256, true);
+}
+
+BENCHMARK("texture_conversion::ConvertP8/1024x1024")
+{
+	BenchmarkConvertP8(state, 1024, false);
+}
+
+BENCHMARK("bc::Decode/BC1/256x256")
+{
+	BenchmarkBcDecode(state, bc::Format::BC1, 256, 1);
+}
+
+BENCHMARK("bc::Decode/BC2/256x256")
+{
+	BenchmarkBcDecode(state, bc::Format::BC2, 256, 1);
+}
+
+BENCHMARK("bc::Decode/BC3/256x256")
+{
+	BenchmarkBcDecode(state, bc::Format::BC3, 256, 1);
+}
+
+BENCHMARK("bc::Decode/BC1/2048x2048/threaded")
+{
+	BenchmarkBcDecode(state, bc::Format::BC1, 2048, std::max(1u, std::thread::hardware_concurrency()));
+}
+
+BENCHMARK("TextureDiskCache::Hash/64KiB")
+{
+	const auto data = MakeRandomBytes(64 * 1024);
+
+	state.SetBytesPerIteration(data.size());
+	state.Run([&]
+	{
+		benchmark::KeepAlive(TextureDiskCache::Hash(data.data(), data.size()));
+	});
+}
+
+BENCHMARK("TextureDiskCache::Hash/palette")
+{
+	const auto palette = MakePalette();
+
+	state.SetBytesPerIteration(palette.size() * sizeof(uint32_t));
+	state.Run([&]
+	{
+		benchmark::KeepAlive(TextureDiskCache::Hash(palette.data(), palette.size() * sizeof(uint32_t)));
+	});
+}
@@ -0,0 +1,72 @@
+#include "Benchmark.h"
+
+#include "DebugMessageFilter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace
+{
+	void BenchmarkThreadPool(benchmark::State& state, size_t jobCount, uint32_t jobSize)
+	{
+		ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+		std::atomic<uint64_t> sum{0};
+
+		state.SetItemsPerIteration(jobCount);
+		state.Run([&]
+		{
+			for (size_t i = 0; i < jobCount; ++i)
+			{
+				pool.Submit([&sum, jobSize]
+				{
+					uint64_t value = 0;
+					for (uint32_t j = 0; j < jobSize; ++j)
+						value = value * 31 + j;
+					sum += value;
+				});
+			}
+			pool.Wait();
+		});
+		benchmark::KeepAlive(sum.load());
+	}
+}
+
+// Dominated by scheduling: how much a job must do to be worth submitting.
+BENCHMARK("ThreadPool/submit+wait/empty")
+{
+	BenchmarkThreadPool(state, 1024, 0);
+}
+
+BENCHMARK("ThreadPool/submit+wait/small")
+{
+	BenchmarkThreadPool(state, 256, 16 * 1024);
+}
+
+BENCHMARK("DebugMessageFilter::Accept/suppressed")
+{
+	// A broken draw repeating one message every frame.
+	DebugMessageFilter filter(DebugMessageFilter::Severity::Warning, 4, std::chrono::seconds(10));
+	const auto now = DebugMessageFilter::Clock::now();
+	uint32_t logged = 0;
+
+	state.Run([&]
+	{
+		logged += filter.Accept(DebugMessageFilter::Severity::Error, 0x12345678, now).has_value();
+	});
+	benchmark::KeepAlive(logged);
+}
+
+BENCHMARK("DebugMessageFilter::Accept/below-minimum")
+{
+	DebugMessageFilter filter(DebugMessageFilter::Severity::Warning, 4, std::chrono::seconds(10));
+	uint32_t logged = 0;
+
+	state.Run([&]
+	{
+		logged += filter.Accept(DebugMessageFilter::Severity::Info, 0x12345678).has_value();
+	});
+	benchmark::KeepAlive(logged);
+}
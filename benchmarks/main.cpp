@@ -0,0 +1,87 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	void PrintUsage(const char* program)
+	{
+		std::printf("Usage: %s [--list] [--min-time=MILLISECONDS] [FILTER...]\n", program);
+		std::printf("Runs the benchmarks whose names contain any of the filters, or all of them.\n");
+	}
+
+	void PrintRate(double perSecond, const char* unit)
+	{
+		if (perSecond >= 1e9)
+			std::printf(" %9.2f G%s/s", perSecond / 1e9, unit);
+		else if (perSecond >= 1e6)
+			std::printf(" %9.2f M%s/s", perSecond / 1e6, unit);
+		else
+			std::printf(" %9.2f k%s/s", perSecond / 1e3, unit);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	auto minTime = std::chrono::milliseconds(500);
+	auto list = false;
+	std::vector<std::string> filters;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* argument = argv[i];
+		if (std::strcmp(argument, "--list") == 0)
+			list = true;
+		else if (std::strncmp(argument, "--min-time=", 11) == 0)
+			minTime = std::chrono::milliseconds(std::max(1, std::atoi(argument + 11)));
+		else if (argument[0] == '-')
+		{
+			PrintUsage(argv[0]);
+			return std::strcmp(argument, "--help") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		else
+			filters.emplace_back(argument);
+	}
+
+	auto cases = benchmark::GetCases();
+	std::sort(cases.begin(), cases.end(), [](const auto& a, const auto& b) { return a.name < b.name; });
+
+	const auto isSelected = [&](const std::string& name)
+	{
+		return filters.empty() || std::any_of(filters.begin(), filters.end(), [&](const auto& filter) { return name.find(filter) != std::string::npos; });
+	};
+
+	for (const auto& benchmarkCase : cases)
+	{
+		if (!isSelected(benchmarkCase.name))
+			continue;
+
+		if (list)
+		{
+			std::printf("%s\n", benchmarkCase.name.c_str());
+			continue;
+		}
+
+		benchmark::State state(minTime);
+		benchmarkCase.function(state);
+
+		const auto nanoseconds = state.GetNanosecondsPerIteration();
+		std::printf("%-48s %12.1f ns", benchmarkCase.name.c_str(), nanoseconds);
+		if (nanoseconds > 0.0)
+		{
+			if (state.GetItemsPerIteration() != 0)
+				PrintRate(double(state.GetItemsPerIteration()) * 1e9 / nanoseconds, "item");
+			if (state.GetBytesPerIteration() != 0)
+				PrintRate(double(state.GetBytesPerIteration()) * 1e9 / nanoseconds, "B");
+		}
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define BC_DECODER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Software decoder for S3TC (BC1/DXT1, BC2/DXT3, BC3/DXT5) textures, used when the device can't sample them directly.
+// Output is R8G8B8A8 (R in the lowest byte), tightly packed.
+namespace bc
+{
+	enum class Format
+	{
+		BC1,
+		BC2,
+		BC3,
+	};
+
+	[[nodiscard]] constexpr size_t GetBlockSize(Format format)
+	{
+		return format == Format::BC1 ? 8 : 16;
+	}
+
+	[[nodiscard]] constexpr size_t GetCompressedSize(Format format, uint32_t width, uint32_t height)
+	{
+		return size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4) * GetBlockSize(format);
+	}
+
+	namespace details
+	{
+		inline uint32_t Expand565(uint16_t color)
+		{
+			const uint32_t r = (color >> 11) & 0x1F;
+			const uint32_t g = (color >> 5) & 0x3F;
+			const uint32_t b = color & 0x1F;
+			return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xFF000000u;
+		}
+
+		// Builds the four-entry color table of a block. BC2/BC3 always use the four-color mode.
+		inline void BuildColorTable(const uint8_t* block, bool allowPunchThrough, uint32_t table[4])
+		{
+			uint16_t color0, color1;
+			std::memcpy(&color0, block, 2);
+			std::memcpy(&color1, block + 2, 2);
+
+			table[0] = Expand565(color0);
+			table[1] = Expand565(color1);
+
+			const bool fourColors = !allowPunchThrough || color0 > color1;
+
+			// Alpha is interpolated along with the color channels; both endpoints are opaque, so the result is too.
+			// The three-color mode's last entry is transparent black.
+#if BC_DECODER_SSE2
+			const auto zero = _mm_setzero_si128();
+			const auto c0 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(table[0])), zero);
+			const auto c1 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(table[1])), zero);
+
+			__m128i c2, c3;
+			if (fourColors)
+			{
+				// x / 3 == (x * 0x5556) >> 16 for the range we need (x <= 765).
+				const auto third = _mm_set1_epi16(0x5556);
+				c2 = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(c0, c0), c1), third);
+				c3 = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(c1, c1), c0), third);
+			}
+			else
+			{
+				c2 = _mm_srli_epi16(_mm_add_epi16(c0, c1), 1);
+				c3 = zero;
+			}
+
+			table[2] = uint32_t(_mm_cvtsi128_si32(_mm_packus_epi16(c2, zero)));
+			table[3] = uint32_t(_mm_cvtsi128_si32(_mm_packus_epi16(c3, zero)));
+#else
+			table[2] = 0;
+			table[3] = 0;
+			for (uint32_t shift = 0; shift < 32; shift += 8)
+			{
+				const auto a = (table[0] >> shift) & 0xFF;
+				const auto b = (table[1] >> shift) & 0xFF;
+				if (fourColors)
+				{
+					table[2] |= ((2 * a + b) / 3) << shift;
+					table[3] |= ((a + 2 * b) / 3) << shift;
+				}
+				else
+				{
+					table[2] |= ((a + b) / 2) << shift;
+				}
+			}
+#endif
+		}
+
+		// Decodes the color part of a block into a 4x4 tile.
+		inline void DecodeColorBlock(const uint8_t* block, bool allowPunchThrough, uint32_t pixels[16])
+		{
+			uint32_t table[4];
+			BuildColorTable(block, allowPunchThrough, table);
+
+			uint32_t indices;
+			std::memcpy(&indices, block + 4, 4);
+
+			for (size_t i = 0; i < 16; ++i, indices >>= 2)
+				pixels[i] = table[indices & 3];
+		}
+
+		// Replaces alpha of the tile with explicit 4-bit alpha (BC2).
+		inline void ApplyExplicitAlpha(const uint8_t* block, uint32_t pixels[16])
+		{
+			uint64_t alpha;
+			std::memcpy(&alpha, block, 8);
+
+			for (size_t i = 0; i < 16; ++i, alpha >>= 4)
+			{
+				const auto a = uint32_t(alpha & 0xF);
+				pixels[i] = (pixels[i] & 0x00FFFFFFu) | ((a | (a << 4)) << 24);
+			}
+		}
+
+		// Replaces alpha of the tile with interpolated alpha (BC3).
+		inline void ApplyInterpolatedAlpha(const uint8_t* block, uint32_t pixels[16])
+		{
+			uint32_t table[8];
+			table[0] = block[0];
+			table[1] = block[1];
+			if (table[0] > table[1])
+			{
+				for (uint32_t i = 1; i < 7; ++i)
+					table[i + 1] = ((7 - i) * table[0] + i * table[1]) / 7;
+			}
+			else
+			{
+				for (uint32_t i = 1; i < 5; ++i)
+					table[i + 1] = ((5 - i) * table[0] + i * table[1]) / 5;
+				table[6] = 0;
+				table[7] = 255;
+			}
+
+			uint64_t indices = 0;
+			std::memcpy(&indices, block + 2, 6);
+
+			for (size_t i = 0; i < 16; ++i, indices >>= 3)
+				pixels[i] = (pixels[i] & 0x00FFFFFFu) | (table[indices & 7] << 24);
+		}
+
+		inline void DecodeBlock(Format format, const uint8_t* block, uint32_t pixels[16])
+		{
+			switch (format)
+			{
+			case Format::BC1:
+				DecodeColorBlock(block, true, pixels);
+				break;
+			case Format::BC2:
+				DecodeColorBlock(block + 8, false, pixels);
+				ApplyExplicitAlpha(block, pixels);
+				break;
+			case Format::BC3:
+				DecodeColorBlock(block + 8, false, pixels);
+				ApplyInterpolatedAlpha(block, pixels);
+				break;
+			}
+		}
+
+		inline void DecodeBlockRows(Format format, const uint8_t* source, uint32_t width, uint32_t height, uint32_t* destination, uint32_t firstRow, uint32_t lastRow)
+		{
+			const auto blocksPerRow = std::max(1u, (width + 3) / 4);
+			const auto blockSize = GetBlockSize(format);
+
+			uint32_t pixels[16];
+			for (auto blockRow = firstRow; blockRow < lastRow; ++blockRow)
+			{
+				const auto* block = source + size_t(blockRow) * blocksPerRow * blockSize;
+				const auto y = blockRow * 4;
+				const auto rows = std::min(4u, height - y);
+
+				for (uint32_t blockColumn = 0; blockColumn < blocksPerRow; ++blockColumn, block += blockSize)
+				{
+					DecodeBlock(format, block, pixels);
+
+					const auto x = blockColumn * 4;
+					auto* target = destination + size_t(y) * width + x;
+
+					if (x + 4 <= width)
+					{
+						for (uint32_t row = 0; row < rows; ++row, target += width)
+						{
+#if BC_DECODER_SSE2
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(target), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + row * 4)));
+#else
+							std::memcpy(target, pixels + row * 4, 16);
+#endif
+						}
+					}
+					else
+					{
+						// Mips smaller than a block.
+						for (uint32_t row = 0; row < rows; ++row, target += width)
+							std::memcpy(target, pixels + row * 4, (width - x) * sizeof(uint32_t));
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	Decodes a whole mip.
+	\param destination width * height RGBA8 pixels.
+	\param maxThreads Large mips are split by block rows between up to this many threads, which are spawned for the call; 1 decodes on the
+	calling thread. Callers that already run on a pool, or decode many small mips, pass 1.
+	*/
+	inline void Decode(Format format, const uint8_t* source, uint32_t width, uint32_t height, uint32_t* destination, uint32_t maxThreads)
+	{
+		// Spawning threads costs more than decoding small mips.
+		constexpr uint32_t MinBlockRowsPerThread = 32;
+
+		const auto blockRows = std::max(1u, (height + 3) / 4);
+
+		const auto threadCount = std::min(std::max(1u, maxThreads), std::max(1u, blockRows / MinBlockRowsPerThread));
+		if (threadCount <= 1)
+		{
+			details::DecodeBlockRows(format, source, width, height, destination, 0, blockRows);
+			return;
+		}
+
+		const auto rowsPerThread = (blockRows + threadCount - 1) / threadCount;
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount - 1);
+		for (uint32_t i = 1; i < threadCount; ++i)
+		{
+			const auto firstRow = i * rowsPerThread;
+			const auto lastRow = std::min(blockRows, firstRow + rowsPerThread);
+			if (firstRow >= lastRow)
+				break;
+
+			threads.emplace_back(details::DecodeBlockRows, format, source, width, height, destination, firstRow, lastRow);
+		}
+
+		details::DecodeBlockRows(format, source, width, height, destination, 0, std::min(blockRows, rowsPerThread));
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+}
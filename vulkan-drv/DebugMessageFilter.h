@@ -0,0 +1,105 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+// Decides which validation messages are worth logging. A broken draw repeats the same message every frame, and formatting and logging
+// those would bury the first ones and slow the game down; each message ID is logged a few times per window and counted otherwise.
+// The callback may run on any thread. Independent of the engine headers and of Vulkan.
+class DebugMessageFilter : boost::noncopyable
+{
+public:
+	enum class Severity : uint32_t
+	{
+		Verbose,
+		Info,
+		Warning,
+		Error,
+
+		Count
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+private:
+	struct MessageState
+	{
+		Clock::time_point windowStart;
+		uint32_t loggedCount = 0;
+		uint32_t suppressedCount = 0; // Since the last one logged.
+	};
+
+	Severity minimumSeverity_;
+	uint32_t maxPerWindow_;
+	Clock::duration window_;
+
+	std::mutex mutex_;
+	std::unordered_map<int32_t, MessageState> messages_;
+
+	std::array<std::atomic<uint64_t>, size_t(Severity::Count)> counts_{};
+	std::atomic<uint64_t> suppressedCount_{0};
+
+public:
+	DebugMessageFilter(Severity minimumSeverity, uint32_t maxPerWindow, Clock::duration window)
+		: minimumSeverity_(minimumSeverity)
+		, maxPerWindow_(maxPerWindow)
+		, window_(window)
+	{
+	}
+
+	/**
+	Counts a message and decides whether it is logged.
+	\param messageId Messages with the same ID share one budget of maxPerWindow per window.
+	\return Nothing to drop it, otherwise how many messages with its ID were dropped since the last one logged.
+	*/
+	[[nodiscard]] std::optional<uint32_t> Accept(Severity severity, int32_t messageId, Clock::time_point now = Clock::now())
+	{
+		++counts_[size_t(severity)];
+		if (severity < minimumSeverity_)
+			return std::nullopt;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto& message = messages_[messageId];
+		if (message.loggedCount == 0 || now - message.windowStart >= window_)
+		{
+			message.windowStart = now;
+			message.loggedCount = 0;
+		}
+
+		if (message.loggedCount == maxPerWindow_)
+		{
+			++message.suppressedCount;
+			++suppressedCount_;
+			return std::nullopt;
+		}
+
+		++message.loggedCount;
+		const auto suppressedCount = message.suppressedCount;
+		message.suppressedCount = 0;
+		return suppressedCount;
+	}
+
+	[[nodiscard]] Severity GetMinimumSeverity() const
+	{
+		return minimumSeverity_;
+	}
+
+	// All messages received, logged or not.
+	[[nodiscard]] uint64_t GetCount(Severity severity) const
+	{
+		return counts_[size_t(severity)];
+	}
+
+	// Messages at or above the minimum severity that were over the budget of their ID.
+	[[nodiscard]] uint64_t GetSuppressedCount() const
+	{
+		return suppressedCount_;
+	}
+};
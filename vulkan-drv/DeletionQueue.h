@@ -0,0 +1,92 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Destroys GPU resources once the GPU is done with them, without waiting for the device to go idle.
+// Every queue submission gets a serial from Submit(); once its fence is signaled, Retire() runs the destructions that waited for it.
+// A fence covers everything submitted to its queue before it too, so serials retire in order.
+// Independent of the engine headers and of Vulkan.
+class DeletionQueue : boost::noncopyable
+{
+public:
+	using Destruction = std::function<void()>;
+
+private:
+	struct Entry
+	{
+		uint64_t serial;
+		Destruction destroy;
+	};
+
+	// Serials never decrease along the queue, see Push().
+	std::deque<Entry> entries_;
+	uint64_t lastSubmittedSerial_ = 0;
+	uint64_t completedSerial_ = 0;
+
+public:
+	~DeletionQueue()
+	{
+		Flush();
+	}
+
+	// Called for every submission; returns the serial to retire once the submission's fence is signaled.
+	[[nodiscard]] uint64_t Submit()
+	{
+		return ++lastSubmittedSerial_;
+	}
+
+	/**
+	Runs the destructions that only waited for submissions up to serial.
+	\param serial Of a submission whose fence has been signaled.
+	*/
+	void Retire(uint64_t serial)
+	{
+		completedSerial_ = std::max(completedSerial_, serial);
+
+		while (!entries_.empty() && entries_.front().serial <= completedSerial_)
+		{
+			// Popped first so that a throwing destruction is not run again.
+			auto destroy = std::move(entries_.front().destroy);
+			entries_.pop_front();
+			destroy();
+		}
+	}
+
+	/**
+	Destroys a resource once the GPU no longer uses it, or right away when it never did.
+	\param pendingSubmissionCount Submissions to come that may use the resource, i.e. of commands being recorded; 0 when none are.
+	*/
+	void Push(Destruction destroy, uint64_t pendingSubmissionCount)
+	{
+		const auto serial = lastSubmittedSerial_ + pendingSubmissionCount;
+		if (serial <= completedSerial_)
+		{
+			destroy();
+			return;
+		}
+
+		entries_.push_back(Entry{serial, std::move(destroy)});
+	}
+
+	// Runs every pending destruction. Only valid once the device is idle, e.g. on shutdown.
+	void Flush()
+	{
+		while (!entries_.empty())
+		{
+			auto destroy = std::move(entries_.front().destroy);
+			entries_.pop_front();
+			destroy();
+		}
+		completedSerial_ = lastSubmittedSerial_;
+	}
+
+	[[nodiscard]] size_t GetPendingCount() const
+	{
+		return entries_.size();
+	}
+};
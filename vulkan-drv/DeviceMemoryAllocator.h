@@ -0,0 +1,318 @@
+#pragma once
+
+#include "TlsfAllocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <boost/noncopyable.hpp>
+
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+struct MemoryAllocation
+{
+	static constexpr uint32_t DedicatedBlock = ~uint32_t(0);
+
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	void* mappedData = nullptr; // Persistently mapped for host-visible memory, nullptr otherwise.
+
+	uint32_t poolIndex = 0;
+	uint32_t blockIndex = DedicatedBlock;
+	TlsfAllocator::Handle handle = TlsfAllocator::InvalidHandle;
+
+	explicit operator bool() const
+	{
+		return bool(memory);
+	}
+};
+
+struct MemoryStatistics
+{
+	vk::DeviceSize reservedSize = 0;
+	vk::DeviceSize usedSize = 0;
+	vk::DeviceSize largestFreeBlockSize = 0;
+	size_t blockCount = 0;
+	size_t allocationCount = 0;
+	size_t dedicatedAllocationCount = 0;
+	size_t deviceMemoryObjectCount = 0;
+
+	// 0 when all free space is contiguous, approaching 1 when it is scattered in small pieces.
+	[[nodiscard]] float GetFragmentation() const
+	{
+		const auto freeSize = reservedSize - usedSize;
+		return freeSize == 0 ? 0.0f : 1.0f - float(largestFreeBlockSize) / float(freeSize);
+	}
+};
+
+// Sub-allocates VkDeviceMemory from large blocks, one set of blocks per memory type.
+// Blocks are only allocated when a pool runs dry (or up front through Reserve()), so the common path never calls into the driver.
+// Linear (buffers) and optimal (images) resources live in separate pools, so bufferImageGranularity never has to be respected inside a block.
+class DeviceMemoryAllocator : boost::noncopyable
+{
+	static constexpr vk::DeviceSize DefaultBlockSize = 64 * 1024 * 1024;
+
+	struct MemoryBlock
+	{
+		vk::DeviceMemory memory;
+		void* mappedData;
+		TlsfAllocator allocator;
+
+		MemoryBlock(vk::DeviceMemory memory, void* mappedData, vk::DeviceSize size)
+			: memory(memory)
+			, mappedData(mappedData)
+			, allocator(size)
+		{
+		}
+	};
+
+	struct MemoryPool
+	{
+		vk::DeviceSize blockSize = 0;
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+		size_t dedicatedAllocationCount = 0;
+	};
+
+	vk::Device device_;
+	vk::PhysicalDeviceMemoryProperties memoryProperties_;
+	uint32_t maxAllocationCount_;
+	size_t deviceMemoryObjectCount_ = 0;
+
+	// Two pools per memory type: [type * 2] for linear resources, [type * 2 + 1] for optimal-tiling images.
+	std::array<MemoryPool, VK_MAX_MEMORY_TYPES * 2> pools_;
+
+	[[nodiscard]] static uint32_t GetPoolIndex(uint32_t memoryTypeIndex, bool isOptimalImage)
+	{
+		return memoryTypeIndex * 2 + (isOptimalImage ? 1 : 0);
+	}
+
+	[[nodiscard]] uint32_t FindMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred) const
+	{
+		auto found = ~uint32_t(0);
+		for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; ++i)
+		{
+			if (!(memoryTypeBits & (1u << i)))
+				continue;
+
+			const auto flags = memoryProperties_.memoryTypes[i].propertyFlags;
+			if ((flags & required) != required)
+				continue;
+
+			if ((flags & preferred) == preferred)
+				return i;
+
+			if (found == ~uint32_t(0))
+				found = i;
+		}
+
+		if (found == ~uint32_t(0))
+			throw std::runtime_error("No suitable memory type");
+
+		return found;
+	}
+
+	[[nodiscard]] bool IsHostVisible(uint32_t memoryTypeIndex) const
+	{
+		return bool(memoryProperties_.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+	}
+
+	// Smaller heaps (e.g. the 256 MiB host-visible device-local heap) get proportionally smaller blocks.
+	[[nodiscard]] vk::DeviceSize GetBlockSize(uint32_t memoryTypeIndex) const
+	{
+		const auto heapSize = memoryProperties_.memoryHeaps[memoryProperties_.memoryTypes[memoryTypeIndex].heapIndex].size;
+		return std::min(DefaultBlockSize, heapSize / 8);
+	}
+
+	[[nodiscard]] std::pair<vk::DeviceMemory, void*> AllocateDeviceMemory(uint32_t memoryTypeIndex, vk::DeviceSize size)
+	{
+		if (deviceMemoryObjectCount_ >= maxAllocationCount_)
+			throw std::runtime_error("maxMemoryAllocationCount exceeded");
+
+		const auto memory = device_.allocateMemory(vk::MemoryAllocateInfo().setAllocationSize(size).setMemoryTypeIndex(memoryTypeIndex));
+		++deviceMemoryObjectCount_;
+
+		void* mappedData = nullptr;
+		if (IsHostVisible(memoryTypeIndex))
+			mappedData = device_.mapMemory(memory, 0, VK_WHOLE_SIZE);
+
+		return {memory, mappedData};
+	}
+
+	void FreeDeviceMemory(vk::DeviceMemory memory)
+	{
+		device_.freeMemory(memory);
+		--deviceMemoryObjectCount_;
+	}
+
+	MemoryBlock& AddBlock(uint32_t poolIndex)
+	{
+		auto& pool = pools_[poolIndex];
+		const auto memoryTypeIndex = poolIndex / 2;
+		if (pool.blockSize == 0)
+			pool.blockSize = GetBlockSize(memoryTypeIndex);
+
+		const auto [memory, mappedData] = AllocateDeviceMemory(memoryTypeIndex, pool.blockSize);
+		pool.blocks.push_back(std::make_unique<MemoryBlock>(memory, mappedData, pool.blockSize));
+
+		return *pool.blocks.back();
+	}
+
+	[[nodiscard]] MemoryAllocation Allocate(
+		const vk::MemoryRequirements& requirements,
+		vk::MemoryPropertyFlags required,
+		vk::MemoryPropertyFlags preferred,
+		bool isOptimalImage)
+	{
+		const auto memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, required, required | preferred);
+		const auto poolIndex = GetPoolIndex(memoryTypeIndex, isOptimalImage);
+		auto& pool = pools_[poolIndex];
+		if (pool.blockSize == 0)
+			pool.blockSize = GetBlockSize(memoryTypeIndex);
+
+		// Big resources (render targets, huge textures) get their own memory object instead of wasting a block.
+		if (requirements.size > pool.blockSize / 2)
+		{
+			const auto [memory, mappedData] = AllocateDeviceMemory(memoryTypeIndex, requirements.size);
+			++pool.dedicatedAllocationCount;
+
+			MemoryAllocation allocation;
+			allocation.memory = memory;
+			allocation.size = requirements.size;
+			allocation.mappedData = mappedData;
+			allocation.poolIndex = poolIndex;
+			return allocation;
+		}
+
+		for (size_t blockIndex = 0; blockIndex < pool.blocks.size(); ++blockIndex)
+		{
+			auto& block = *pool.blocks[blockIndex];
+			if (const auto subAllocation = block.allocator.Allocate(requirements.size, requirements.alignment))
+				return MakeAllocation(block, poolIndex, uint32_t(blockIndex), *subAllocation);
+		}
+
+		auto& block = AddBlock(poolIndex);
+		const auto subAllocation = block.allocator.Allocate(requirements.size, requirements.alignment);
+		if (!subAllocation)
+			throw std::runtime_error("Allocation does not fit into an empty memory block");
+
+		return MakeAllocation(block, poolIndex, uint32_t(pool.blocks.size() - 1), *subAllocation);
+	}
+
+	[[nodiscard]] static MemoryAllocation MakeAllocation(
+		const MemoryBlock& block,
+		uint32_t poolIndex,
+		uint32_t blockIndex,
+		const TlsfAllocator::Allocation& subAllocation)
+	{
+		MemoryAllocation allocation;
+		allocation.memory = block.memory;
+		allocation.offset = subAllocation.offset;
+		allocation.size = subAllocation.size;
+		allocation.mappedData = block.mappedData ? static_cast<uint8_t*>(block.mappedData) + subAllocation.offset : nullptr;
+		allocation.poolIndex = poolIndex;
+		allocation.blockIndex = blockIndex;
+		allocation.handle = subAllocation.handle;
+		return allocation;
+	}
+
+public:
+	DeviceMemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device)
+		: device_(device)
+		, memoryProperties_(physicalDevice.getMemoryProperties())
+		, maxAllocationCount_(physicalDevice.getProperties().limits.maxMemoryAllocationCount)
+	{
+	}
+
+	~DeviceMemoryAllocator()
+	{
+		for (auto& pool : pools_)
+		{
+			for (auto& block : pool.blocks)
+				FreeDeviceMemory(block->memory);
+		}
+	}
+
+	// Allocates blocks ahead of time, so that level loading does not hit vkAllocateMemory.
+	void Reserve(vk::MemoryPropertyFlags required, bool forOptimalImages, vk::DeviceSize size)
+	{
+		const auto memoryTypeIndex = FindMemoryType(~uint32_t(0), required, required);
+		const auto poolIndex = GetPoolIndex(memoryTypeIndex, forOptimalImages);
+
+		vk::DeviceSize reserved = 0;
+		for (const auto& block : pools_[poolIndex].blocks)
+			reserved += block->allocator.GetSize();
+
+		while (reserved < size)
+			reserved += AddBlock(poolIndex).allocator.GetSize();
+	}
+
+	[[nodiscard]] MemoryAllocation AllocateForImage(vk::Image image, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred = {})
+	{
+		auto allocation = Allocate(device_.getImageMemoryRequirements(image), required, preferred, true);
+		device_.bindImageMemory(image, allocation.memory, allocation.offset);
+		return allocation;
+	}
+
+	[[nodiscard]] MemoryAllocation AllocateForBuffer(vk::Buffer buffer, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred = {})
+	{
+		auto allocation = Allocate(device_.getBufferMemoryRequirements(buffer), required, preferred, false);
+		device_.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+		return allocation;
+	}
+
+	// Empty blocks are kept for reuse; see Trim().
+	void Free(const MemoryAllocation& allocation)
+	{
+		if (!allocation)
+			return;
+
+		auto& pool = pools_[allocation.poolIndex];
+
+		if (allocation.blockIndex == MemoryAllocation::DedicatedBlock)
+		{
+			FreeDeviceMemory(allocation.memory);
+			--pool.dedicatedAllocationCount;
+			return;
+		}
+
+		pool.blocks[allocation.blockIndex]->allocator.Free(allocation.handle);
+	}
+
+	// Returns empty blocks to the driver, keeping one per pool. Call it at level change, not per frame.
+	// Only trailing blocks are released so that block indices of live allocations stay valid.
+	void Trim()
+	{
+		for (auto& pool : pools_)
+		{
+			while (pool.blocks.size() > 1 && pool.blocks.back()->allocator.IsEmpty())
+			{
+				FreeDeviceMemory(pool.blocks.back()->memory);
+				pool.blocks.pop_back();
+			}
+		}
+	}
+
+	[[nodiscard]] MemoryStatistics GetStatistics() const
+	{
+		MemoryStatistics statistics;
+
+		for (const auto& pool : pools_)
+		{
+			for (const auto& block : pool.blocks)
+			{
+				statistics.reservedSize += block->allocator.GetSize();
+				statistics.usedSize += block->allocator.GetUsedSize();
+				statistics.largestFreeBlockSize = std::max(statistics.largestFreeBlockSize, block->allocator.GetLargestFreeBlockSize());
+				statistics.allocationCount += block->allocator.GetAllocationCount();
+			}
+			statistics.blockCount += pool.blocks.size();
+			statistics.dedicatedAllocationCount += pool.dedicatedAllocationCount;
+		}
+		statistics.deviceMemoryObjectCount = deviceMemoryObjectCount_;
+
+		return statistics;
+	}
+};
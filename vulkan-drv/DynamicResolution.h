@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the render resolution scale that keeps measured GPU frame time near a target.
+// Independent of the graphics API; feed it one GPU time per finished frame.
+class DynamicResolutionController
+{
+	// Smoothing of the measured frame time; lower reacts slower but ignores single spikes.
+	static constexpr float AverageWeight = 0.1f;
+	// No adjustment while the average is this close to the target, so the scale does not oscillate.
+	static constexpr float Tolerance = 0.05f;
+	// Maximum relative change per frame. Dropping resolution is faster than raising it, so overload is handled quickly
+	// while recovery does not overshoot.
+	static constexpr float MaxIncrease = 0.02f;
+	static constexpr float MaxDecrease = 0.05f;
+	// Scales are quantized so that render extent changes are not a per-frame occurrence.
+	static constexpr float ScaleStep = 1.0f / 64.0f;
+
+	float targetFrameTime_ = 0.0f;
+	float minScale_ = 1.0f;
+	float maxScale_ = 1.0f;
+
+	float scale_ = 1.0f;
+	float averageFrameTime_ = 0.0f;
+
+public:
+	/**
+	\param targetFrameTime GPU time per frame in milliseconds. 0 disables scaling; the scale then stays at 1 (within bounds).
+	*/
+	void Configure(float targetFrameTime, float minScale, float maxScale)
+	{
+		targetFrameTime_ = std::max(0.0f, targetFrameTime);
+		minScale_ = std::max(ScaleStep, std::min(minScale, maxScale));
+		maxScale_ = std::max(minScale_, maxScale);
+		scale_ = std::clamp(1.0f, minScale_, maxScale_);
+		averageFrameTime_ = 0.0f;
+	}
+
+	// Returns the scale to render the next frame with.
+	float Update(float gpuFrameTime)
+	{
+		averageFrameTime_ = averageFrameTime_ == 0.0f ? gpuFrameTime : averageFrameTime_ + (gpuFrameTime - averageFrameTime_) * AverageWeight;
+
+		if (!IsEnabled() || averageFrameTime_ <= 0.0f)
+			return scale_;
+
+		const auto ratio = targetFrameTime_ / averageFrameTime_;
+		if (std::abs(ratio - 1.0f) < Tolerance)
+			return scale_;
+
+		// GPU time is roughly proportional to the pixel count, i.e. to the square of the scale.
+		const auto desiredChange = std::sqrt(ratio);
+		const auto change = std::clamp(desiredChange, 1.0f - MaxDecrease, 1.0f + MaxIncrease);
+		const auto scale = std::clamp(std::round(scale_ * change / ScaleStep) * ScaleStep, minScale_, maxScale_);
+
+		// Rounding may undo small steps; still move by one step in the requested direction.
+		if (scale == scale_ && desiredChange != 1.0f)
+			scale_ = std::clamp(scale_ + (desiredChange > 1.0f ? ScaleStep : -ScaleStep), minScale_, maxScale_);
+		else
+			scale_ = scale;
+
+		return scale_;
+	}
+
+	[[nodiscard]] bool IsEnabled() const
+	{
+		return targetFrameTime_ > 0.0f && minScale_ < maxScale_;
+	}
+
+	[[nodiscard]] float GetScale() const
+	{
+		return scale_;
+	}
+
+	[[nodiscard]] float GetMaxScale() const
+	{
+		return maxScale_;
+	}
+
+	[[nodiscard]] float GetAverageFrameTime() const
+	{
+		return averageFrameTime_;
+	}
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Caps the frame rate with sub-millisecond precision: sleeps while the deadline is far, then spins.
+// OS sleeps overshoot by up to a timer tick, so the spin margin adapts to the overshoot actually observed.
+class FrameLimiter
+{
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr Clock::duration MinSpinMargin = std::chrono::microseconds(500);
+	static constexpr Clock::duration MaxSpinMargin = std::chrono::milliseconds(20);
+
+	Clock::duration interval_ = Clock::duration::zero();
+	Clock::duration spinMargin_ = std::chrono::milliseconds(2);
+	Clock::time_point nextFrame_;
+
+public:
+	// 0 disables the limiter.
+	void SetFrameRate(float framesPerSecond)
+	{
+		interval_ = framesPerSecond > 0.0f
+			            ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond))
+			            : Clock::duration::zero();
+		nextFrame_ = Clock::time_point();
+	}
+
+	[[nodiscard]] bool IsEnabled() const
+	{
+		return interval_ != Clock::duration::zero();
+	}
+
+	// Blocks until the next frame is due.
+	void Wait()
+	{
+		if (!IsEnabled())
+			return;
+
+		auto now = Clock::now();
+		if (nextFrame_ > now)
+		{
+			if (nextFrame_ - now > spinMargin_)
+			{
+				const auto wakeUp = nextFrame_ - spinMargin_;
+				std::this_thread::sleep_until(wakeUp);
+
+				now = Clock::now();
+				const auto overshoot = now - wakeUp;
+				if (overshoot > spinMargin_ / 2)
+					spinMargin_ = std::min(MaxSpinMargin, overshoot * 2);
+				else
+					spinMargin_ = std::max(MinSpinMargin, spinMargin_ - spinMargin_ / 64);
+			}
+
+			while ((now = Clock::now()) < nextFrame_)
+				std::this_thread::yield();
+		}
+
+		// A frame that is late by more than an interval starts a new schedule instead of making the following frames rush.
+		nextFrame_ = nextFrame_ + interval_ < now ? now + interval_ : nextFrame_ + interval_;
+	}
+};
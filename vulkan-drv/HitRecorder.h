@@ -0,0 +1,103 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// UnrealEd's hit stack: PushHit() and PopHit() nest the records of what is drawn in between, e.g. an actor inside a level.
+// Every primitive drawn under a stack gets the ID of a snapshot of it; the hit pass renders the IDs and Resolve() picks one.
+// ID 0 is no hit. Independent of the engine headers and of Vulkan.
+class HitRecorder : boost::noncopyable
+{
+	std::vector<uint8_t> stack_;
+	// Snapshots of the stack, record i has ID i + 1.
+	std::vector<std::vector<uint8_t>> records_;
+	// 0 until something is drawn under the current stack.
+	uint32_t currentId_ = 0;
+	// The last stack popped with force, which wins when no primitive covers the hit region.
+	uint32_t forcedId_ = 0;
+
+public:
+	void Reset()
+	{
+		stack_.clear();
+		records_.clear();
+		currentId_ = 0;
+		forcedId_ = 0;
+	}
+
+	void Push(const uint8_t* data, size_t size)
+	{
+		stack_.insert(stack_.end(), data, data + size);
+		currentId_ = 0;
+	}
+
+	/**
+	\param size Of the record pushed last.
+	\param force The stack is a hit even if nothing drawn under it covers the hit region, e.g. the editor's background.
+	*/
+	void Pop(size_t size, bool force)
+	{
+		if (force)
+			forcedId_ = GetCurrentId();
+
+		stack_.resize(size < stack_.size() ? stack_.size() - size : 0);
+		currentId_ = 0;
+	}
+
+	[[nodiscard]] bool IsActive() const
+	{
+		return !stack_.empty();
+	}
+
+	// The ID for primitives drawn now; the first call after a change of the stack records it.
+	[[nodiscard]] uint32_t GetCurrentId()
+	{
+		if (currentId_ == 0)
+		{
+			records_.push_back(stack_);
+			currentId_ = uint32_t(records_.size());
+		}
+		return currentId_;
+	}
+
+	/**
+	Picks the hit from the IDs rendered into the hit region: the one nearest to its center, or the forced one when there is none.
+	\param ids Row-major, width * height of them.
+	*/
+	[[nodiscard]] uint32_t Resolve(const uint32_t* ids, uint32_t width, uint32_t height) const
+	{
+		auto id = forcedId_;
+		auto bestDistance = std::numeric_limits<int64_t>::max();
+
+		// Doubled coordinates keep the center of even-sized regions exact.
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const auto pixelId = ids[y * width + x];
+				if (pixelId == 0 || pixelId > records_.size())
+					continue;
+
+				const auto dx = int64_t(x) * 2 + 1 - int64_t(width);
+				const auto dy = int64_t(y) * 2 + 1 - int64_t(height);
+				const auto distance = dx * dx + dy * dy;
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					id = pixelId;
+				}
+			}
+		}
+
+		return id;
+	}
+
+	// nullptr for ID 0.
+	[[nodiscard]] const std::vector<uint8_t>* GetRecord(uint32_t id) const
+	{
+		return id == 0 || id > records_.size() ? nullptr : &records_[id - 1];
+	}
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "DeviceMemoryAllocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+struct TransientAllocation
+{
+	vk::Buffer buffer;
+	vk::DeviceSize offset;
+	void* data;
+};
+
+// Bump allocator over host-visible buffers for data that lives for one frame only (vertices, uniforms, staging).
+// One pool per frame in flight; Reset() it once the frame's fence has been waited on.
+// Running out of space mid-frame chains another chunk; the next Reset() folds all chunks into one that fits the whole frame.
+class LinearBufferPool : boost::noncopyable
+{
+	struct Chunk
+	{
+		vk::Buffer buffer;
+		MemoryAllocation allocation;
+		vk::DeviceSize size;
+	};
+
+	vk::Device device_;
+	DeviceMemoryAllocator* allocator_;
+	vk::BufferUsageFlags usage_;
+
+	std::vector<Chunk> chunks_;
+	vk::DeviceSize offset_ = 0;
+	vk::DeviceSize usedInPreviousChunks_ = 0;
+
+	void AddChunk(vk::DeviceSize size)
+	{
+		Chunk chunk;
+		chunk.size = size;
+		chunk.buffer = device_.createBuffer(
+			vk::BufferCreateInfo()
+			.setSize(size)
+			.setUsage(usage_)
+			.setSharingMode(vk::SharingMode::eExclusive));
+		chunk.allocation = allocator_->AllocateForBuffer(
+			chunk.buffer,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		chunks_.push_back(chunk);
+		offset_ = 0;
+	}
+
+	void DestroyChunks()
+	{
+		for (auto& chunk : chunks_)
+		{
+			device_.destroyBuffer(chunk.buffer);
+			allocator_->Free(chunk.allocation);
+		}
+		chunks_.clear();
+	}
+
+public:
+	LinearBufferPool(vk::Device device, DeviceMemoryAllocator& allocator, vk::BufferUsageFlags usage, vk::DeviceSize initialSize)
+		: device_(device)
+		, allocator_(&allocator)
+		, usage_(usage)
+	{
+		AddChunk(initialSize);
+	}
+
+	~LinearBufferPool()
+	{
+		DestroyChunks();
+	}
+
+	[[nodiscard]] TransientAllocation Allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+	{
+		auto offset = (offset_ + alignment - 1) & ~(alignment - 1);
+		if (offset + size > chunks_.back().size)
+		{
+			usedInPreviousChunks_ += offset_;
+			AddChunk(std::max(chunks_.back().size * 2, size + alignment));
+			offset = 0;
+		}
+
+		offset_ = offset + size;
+
+		const auto& chunk = chunks_.back();
+		return TransientAllocation{chunk.buffer, offset, static_cast<uint8_t*>(chunk.allocation.mappedData) + offset};
+	}
+
+	// Must only be called when the GPU no longer uses anything allocated since the previous Reset().
+	void Reset()
+	{
+		if (chunks_.size() > 1)
+		{
+			const auto requiredSize = GetCapacity();
+			DestroyChunks();
+			AddChunk(requiredSize);
+		}
+
+		offset_ = 0;
+		usedInPreviousChunks_ = 0;
+	}
+
+	[[nodiscard]] vk::DeviceSize GetUsedSize() const
+	{
+		return usedInPreviousChunks_ + offset_;
+	}
+
+	[[nodiscard]] vk::DeviceSize GetCapacity() const
+	{
+		vk::DeviceSize capacity = 0;
+		for (const auto& chunk : chunks_)
+			capacity += chunk.size;
+		return capacity;
+	}
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "DeviceMemoryAllocator.h"
+#include "LinearBufferPool.h"
+#include "Texture.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <boost/noncopyable.hpp>
+
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+
+// The palettes of palette-indexed textures, one per row of a shared 256-wide RGBA8 texture.
+// Shaders fetch a texel of the R8 index image and then the color at (index, row); see world.frag and gouraud.frag.
+// Rows are shared between textures with the same palette, except for rows allocated privately, which are rewritten in place.
+class PaletteTable : boost::noncopyable
+{
+public:
+	static constexpr uint32_t Width = 256;
+	// Draws pass up to three rows packed into one push constant.
+	static constexpr uint32_t RowBits = 10;
+	static constexpr uint32_t RowCount = 1 << RowBits;
+
+private:
+	Texture texture_;
+	std::unordered_map<uint64_t, uint32_t> sharedRows_;
+	uint32_t usedRowCount_ = 0;
+
+public:
+	PaletteTable(vk::Device device, DeviceMemoryAllocator& allocator, vk::CommandBuffer commandBuffer, LinearBufferPool& staging)
+		: texture_(device, allocator, vk::Format::eR8G8B8A8Unorm, vk::Extent2D(Width, RowCount), 1)
+	{
+		texture_.BeginUpload(commandBuffer);
+		std::memset(texture_.UploadMip(commandBuffer, staging, 0), 0, texture_.GetMipSize(0));
+		texture_.EndUpload(commandBuffer, 1);
+	}
+
+	/**
+	Finds the row holding a palette, adding it if it is new.
+	\param hash Of the palette contents; equal hashes are taken to be equal palettes.
+	\return Nothing when the table is full.
+	*/
+	[[nodiscard]] std::optional<uint32_t> GetSharedRow(uint64_t hash, const uint32_t* palette, vk::CommandBuffer commandBuffer, LinearBufferPool& staging)
+	{
+		const auto it = sharedRows_.find(hash);
+		if (it != sharedRows_.end())
+			return it->second;
+
+		const auto row = AllocatePrivateRow();
+		if (!row)
+			return std::nullopt;
+
+		WriteRow(*row, palette, commandBuffer, staging);
+		sharedRows_.emplace(hash, *row);
+		return row;
+	}
+
+	// For a texture whose palette is animated: the row is its own and WriteRow() replaces its contents.
+	[[nodiscard]] std::optional<uint32_t> AllocatePrivateRow()
+	{
+		if (usedRowCount_ == RowCount)
+			return std::nullopt;
+
+		return usedRowCount_++;
+	}
+
+	// Hands out every row again; for when no texture refers to them anymore. Their contents are rewritten as they are handed out.
+	void Clear()
+	{
+		sharedRows_.clear();
+		usedRowCount_ = 0;
+	}
+
+	void WriteRow(uint32_t row, const uint32_t* palette, vk::CommandBuffer commandBuffer, LinearBufferPool& staging) const
+	{
+		auto* destination = texture_.UpdateRegion(commandBuffer, staging, vk::Offset2D(0, int32_t(row)), vk::Extent2D(Width, 1));
+		std::memcpy(destination, palette, Width * sizeof(uint32_t));
+	}
+
+	[[nodiscard]] vk::ImageView GetView() const
+	{
+		return texture_.GetView();
+	}
+
+	[[nodiscard]] uint32_t GetUsedRowCount() const
+	{
+		return usedRowCount_;
+	}
+};
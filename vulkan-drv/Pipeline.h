@@ -2,6 +2,7 @@
 
 #include "SelfDestroyable.h"
 #include "Bundle.h"
+#include "PipelineState.h"
 
 #include "utils.hpp"
 
@@ -12,72 +13,103 @@
 #include <filesystem>
 #include <fstream>
 #include <memory>
+#include <string>
+#include <vector>
+
+// Everything that differs between the renderer's pipelines apart from the fixed-function PipelineState.
+struct PipelineDescription
+{
+	// Compiled shader file names in DRIVER_DATA_DIRECTORY_NAME, without the ".spv" suffix.
+	std::string vertexShader = "shader.vert";
+	std::string fragmentShader = "shader.frag";
+	// Specialization constants of the fragment shader; each one's constant_id is its index.
+	std::vector<uint32_t> fragmentConstants;
+
+	std::vector<vk::VertexInputBindingDescription> vertexBindings;
+	std::vector<vk::VertexInputAttributeDescription> vertexAttributes;
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+
+	std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
+	std::vector<vk::PushConstantRange> pushConstantRanges;
+
+	bool depthTest = true;
+	// Off for depth-only pipelines, which then write no color whatever their blend mode.
+	bool colorWrite = true;
+};
 
 class Pipeline : boost::noncopyable
 {
 	vk::Device device_;
-	vk::Extent2D viewportExtent_;
+	vk::PipelineCache pipelineCache_;
 	vk::Format presentationSurfaceFormat_;
 	vk::RenderPass renderPass_;
 	uint32_t subpassIndex_;
+	PipelineDescription description_;
+	PipelineState state_;
+	bool dynamicRasterState_;
 
 	vk::PipelineLayout pipelineLayout_;
 	vk::Pipeline pipeline_;
 
-	[[nodiscard]] auto GetViewportStateCreateInfo() const
+	[[nodiscard]] vk::PipelineViewportStateCreateInfo GetViewportStateCreateInfo() const
 	{
-		auto viewport = vk::Viewport()
-		                .setWidth(float(viewportExtent_.width))
-		                .setHeight(float(viewportExtent_.height))
-		                .setMinDepth(0.0f)
-		                .setMaxDepth(1.0f);
-		vk::Rect2D scissors({0, 0}, viewportExtent_);
-
-		return makeBundle(
-			[](auto& viewport, auto& scissors)
-			{
-				return vk::PipelineViewportStateCreateInfo().setViewportCount(1).setPViewports(&viewport).setScissorCount(1).setPScissors(&scissors);
-			},
-			std::move(viewport),
-			std::move(scissors));
+		// Viewport and scissor are dynamic, so the pipeline does not depend on the swapchain extent.
+		return vk::PipelineViewportStateCreateInfo().setViewportCount(1).setScissorCount(1);
 	}
 
 	[[nodiscard]] auto GetShaderStageCreateInfos() const
 	{
 		// TODO FIX REFERENCE TO TEMPORARY!!!
 		auto vertexShaderModule = makeSelfDestroyable(
-			LoadShaderModule((std::filesystem::path(DRIVER_DATA_DIRECTORY_NAME) / "shader.vert.spv").wstring().c_str()),
+			LoadShaderModule((std::filesystem::path(DRIVER_DATA_DIRECTORY_NAME) / (description_.vertexShader + ".spv")).wstring().c_str()),
 			[&](vk::ShaderModule& shader)
 			{
 				device_.destroyShaderModule(shader);
 			});
 		auto fragmentShaderModule = makeSelfDestroyable(
-			LoadShaderModule((std::filesystem::path(DRIVER_DATA_DIRECTORY_NAME) / "shader.frag.spv").wstring().c_str()),
+			LoadShaderModule((std::filesystem::path(DRIVER_DATA_DIRECTORY_NAME) / (description_.fragmentShader + ".spv")).wstring().c_str()),
 			[&](vk::ShaderModule& shader)
 			{
 				device_.destroyShaderModule(shader);
 			});
 
+		const auto& constants = description_.fragmentConstants;
+		std::vector<vk::SpecializationMapEntry> constantEntries;
+		for (uint32_t i = 0; i < constants.size(); ++i)
+			constantEntries.emplace_back(i, uint32_t(i * sizeof(uint32_t)), sizeof(uint32_t));
+		// Moving the entries into the bundle keeps their storage, so the pointer stays valid.
+		const auto specializationInfo = vk::SpecializationInfo(
+			uint32_t(constantEntries.size()),
+			constantEntries.data(),
+			constants.size() * sizeof(uint32_t),
+			constants.data());
+
 		return makeBundle(
-			[](auto& vertexModule, auto& fragmentModule) -> std::array<vk::PipelineShaderStageCreateInfo, 2>
+			[](auto& vertexModule, auto& fragmentModule, auto&, auto& specialization) -> std::array<vk::PipelineShaderStageCreateInfo, 2>
 			{
 				return {
 					vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, *vertexModule, "main"),
-					vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, *fragmentModule, "main")
+					vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, *fragmentModule, "main", &specialization)
 				};
 			},
 			std::move(vertexShaderModule),
-			std::move(fragmentShaderModule));
+			std::move(fragmentShaderModule),
+			std::move(constantEntries),
+			specializationInfo);
 	}
 
 	[[nodiscard]] vk::PipelineVertexInputStateCreateInfo GetVertexInputStateCreateInfo() const
 	{
-		return vk::PipelineVertexInputStateCreateInfo();
+		return vk::PipelineVertexInputStateCreateInfo()
+		       .setVertexBindingDescriptionCount(uint32_t(description_.vertexBindings.size()))
+		       .setPVertexBindingDescriptions(description_.vertexBindings.data())
+		       .setVertexAttributeDescriptionCount(uint32_t(description_.vertexAttributes.size()))
+		       .setPVertexAttributeDescriptions(description_.vertexAttributes.data());
 	}
 
 	[[nodiscard]] vk::PipelineInputAssemblyStateCreateInfo GetInputAssemblyStateCreateInfo() const
 	{
-		return vk::PipelineInputAssemblyStateCreateInfo().setPrimitiveRestartEnable(false).setTopology(vk::PrimitiveTopology::eTriangleList);
+		return vk::PipelineInputAssemblyStateCreateInfo().setPrimitiveRestartEnable(false).setTopology(description_.topology);
 	}
 
 	[[nodiscard]] vk::PipelineRasterizationStateCreateInfo GetRasterizationStateCreateInfo() const
@@ -85,7 +117,7 @@ class Pipeline : boost::noncopyable
 		return vk::PipelineRasterizationStateCreateInfo()
 		       .setPolygonMode(vk::PolygonMode::eFill)
 		       .setLineWidth(1.0f)
-		       .setCullMode(vk::CullModeFlagBits::eBack)
+		       .setCullMode(state_.GetCullMode())
 		       .setFrontFace(vk::FrontFace::eClockwise); // TODO: investigate order
 	}
 
@@ -97,24 +129,18 @@ class Pipeline : boost::noncopyable
 
 	[[nodiscard]] vk::PipelineDepthStencilStateCreateInfo GetDepthStencilStateCreateInfo() const
 	{
-		return vk::PipelineDepthStencilStateCreateInfo();
+		// Write and compare are ignored when they are dynamic.
+		return vk::PipelineDepthStencilStateCreateInfo()
+		       .setDepthTestEnable(description_.depthTest)
+		       .setDepthWriteEnable(state_.depthWrite)
+		       .setDepthCompareOp(state_.depthCompare);
 	}
 
 	[[nodiscard]] auto GetColorBlendStateCreateInfo() const
 	{
-		auto attachmentState = vk::PipelineColorBlendAttachmentState()
-		                       .setColorWriteMask(
-			                       vk::ColorComponentFlagBits::eA
-			                       | vk::ColorComponentFlagBits::eR
-			                       | vk::ColorComponentFlagBits::eG
-			                       | vk::ColorComponentFlagBits::eB)
-		                       .setBlendEnable(true)
-		                       .setColorBlendOp(vk::BlendOp::eAdd)
-		                       .setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
-		                       .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
-		                       .setAlphaBlendOp(vk::BlendOp::eAdd)
-		                       .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
-		                       .setDstAlphaBlendFactor(vk::BlendFactor::eZero);
+		auto attachmentState = GetColorBlendAttachmentState(state_.blendMode);
+		if (!description_.colorWrite)
+			attachmentState.setColorWriteMask({});
 
 		return makeBundle(
 			[](auto& attachmentState)
@@ -126,14 +152,52 @@ class Pipeline : boost::noncopyable
 		);
 	}
 
+	[[nodiscard]] static vk::PipelineColorBlendAttachmentState GetColorBlendAttachmentState(BlendMode blendMode)
+	{
+		const auto attachmentState = vk::PipelineColorBlendAttachmentState()
+		                             .setColorWriteMask(
+			                             vk::ColorComponentFlagBits::eA
+			                             | vk::ColorComponentFlagBits::eR
+			                             | vk::ColorComponentFlagBits::eG
+			                             | vk::ColorComponentFlagBits::eB)
+		                             .setColorBlendOp(vk::BlendOp::eAdd)
+		                             .setAlphaBlendOp(vk::BlendOp::eAdd)
+		                             .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+		                             .setDstAlphaBlendFactor(vk::BlendFactor::eZero);
+
+		const auto blended = [&](vk::BlendFactor src, vk::BlendFactor dst)
+		{
+			return vk::PipelineColorBlendAttachmentState(attachmentState).setBlendEnable(true).setSrcColorBlendFactor(src).setDstColorBlendFactor(dst);
+		};
+
+		switch (blendMode)
+		{
+		case BlendMode::Opaque: return vk::PipelineColorBlendAttachmentState(attachmentState).setBlendEnable(false);
+		case BlendMode::Modulated: return blended(vk::BlendFactor::eDstColor, vk::BlendFactor::eSrcColor);
+		case BlendMode::Translucent: return blended(vk::BlendFactor::eOne, vk::BlendFactor::eOneMinusSrcColor);
+		case BlendMode::Highlight: return blended(vk::BlendFactor::eOne, vk::BlendFactor::eOneMinusSrcAlpha);
+		case BlendMode::AlphaBlend: return blended(vk::BlendFactor::eSrcAlpha, vk::BlendFactor::eOneMinusSrcAlpha);
+		case BlendMode::Invisible: return blended(vk::BlendFactor::eZero, vk::BlendFactor::eOne);
+		default: throw std::runtime_error("Unknown blend mode");
+		}
+	}
+
 	[[nodiscard]] auto GetDynamicStateCreateInfo() const
 	{
-		auto states = utils::make_array<vk::DynamicState>(vk::DynamicState::eBlendConstants, vk::DynamicState::eViewport);
+		std::vector<vk::DynamicState> states = {vk::DynamicState::eBlendConstants, vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+#ifdef VK_EXT_extended_dynamic_state
+		if (dynamicRasterState_)
+		{
+			states.push_back(vk::DynamicState::eCullModeEXT);
+			states.push_back(vk::DynamicState::eDepthWriteEnableEXT);
+			states.push_back(vk::DynamicState::eDepthCompareOpEXT);
+		}
+#endif
 
 		return makeBundle(
 			[](auto& states)
 			{
-				return vk::PipelineDynamicStateCreateInfo().setDynamicStateCount(states.size()).setPDynamicStates(states.data());
+				return vk::PipelineDynamicStateCreateInfo().setDynamicStateCount(uint32_t(states.size())).setPDynamicStates(states.data());
 			},
 			std::move(states));
 	}
@@ -168,17 +232,33 @@ class Pipeline : boost::noncopyable
 
 	void CreatePipelineLayout()
 	{
-		pipelineLayout_ = device_.createPipelineLayout(vk::PipelineLayoutCreateInfo());
+		pipelineLayout_ = device_.createPipelineLayout(
+			vk::PipelineLayoutCreateInfo()
+			.setSetLayoutCount(uint32_t(description_.descriptorSetLayouts.size()))
+			.setPSetLayouts(description_.descriptorSetLayouts.data())
+			.setPushConstantRangeCount(uint32_t(description_.pushConstantRanges.size()))
+			.setPPushConstantRanges(description_.pushConstantRanges.data()));
 	}
 
 public:
 
-	Pipeline(vk::Device device, vk::Extent2D viewportExtent, vk::Format presentationSurfaceFormat, vk::RenderPass renderPass, uint32_t subpassIndex)
+	Pipeline(
+		vk::Device device,
+		vk::PipelineCache pipelineCache,
+		vk::Format presentationSurfaceFormat,
+		vk::RenderPass renderPass,
+		uint32_t subpassIndex,
+		PipelineDescription description,
+		const PipelineState& state,
+		bool dynamicRasterState)
 		: device_(device)
-		, viewportExtent_(viewportExtent)
+		, pipelineCache_(pipelineCache)
 		, presentationSurfaceFormat_(presentationSurfaceFormat)
 		, renderPass_(renderPass)
 		, subpassIndex_(subpassIndex)
+		, description_(std::move(description))
+		, state_(state)
+		, dynamicRasterState_(dynamicRasterState)
 	{
 		const auto shaderStages = GetShaderStageCreateInfos();
 		const auto vertexInput = GetVertexInputStateCreateInfo();
@@ -193,13 +273,13 @@ public:
 		CreatePipelineLayout();
 
 		pipeline_ = device_.createGraphicsPipeline(
-			{},
+			pipelineCache_,
 			vk::GraphicsPipelineCreateInfo()
 			.setStageCount(shaderStages->size())
 			.setPStages(shaderStages->data())
 			.setPVertexInputState(&vertexInput)
 			.setPInputAssemblyState(&inputAssembly)
-			.setPViewportState(viewport.get())
+			.setPViewportState(&viewport)
 			.setPRasterizationState(&rasterization)
 			.setPMultisampleState(&multisample)
 			.setPDepthStencilState(&depthStencil)
@@ -213,10 +293,13 @@ public:
 
 	Pipeline(Pipeline&& other) noexcept
 		: device_(other.device_)
-		, viewportExtent_(other.viewportExtent_)
+		, pipelineCache_(other.pipelineCache_)
 		, presentationSurfaceFormat_(other.presentationSurfaceFormat_)
 		, renderPass_(other.renderPass_)
 		, subpassIndex_(other.subpassIndex_)
+		, description_(std::move(other.description_))
+		, state_(other.state_)
+		, dynamicRasterState_(other.dynamicRasterState_)
 		, pipelineLayout_(other.pipelineLayout_)
 		, pipeline_(other.pipeline_)
 	{
@@ -227,16 +310,34 @@ public:
 	Pipeline& operator=(Pipeline&& other) noexcept
 	{
 		device_ = other.device_;
-		viewportExtent_ = other.viewportExtent_;
+		pipelineCache_ = other.pipelineCache_;
 		presentationSurfaceFormat_ = other.presentationSurfaceFormat_;
 		renderPass_ = other.renderPass_;
 		subpassIndex_ = other.subpassIndex_;
+		description_ = std::move(other.description_);
+		state_ = other.state_;
+		dynamicRasterState_ = other.dynamicRasterState_;
 		std::swap(pipelineLayout_, other.pipelineLayout_);
 		std::swap(pipeline_, other.pipeline_);
 
 		return *this;
 	}
 
+	[[nodiscard]] vk::Pipeline GetHandle() const
+	{
+		return pipeline_;
+	}
+
+	[[nodiscard]] vk::PipelineLayout GetLayout() const
+	{
+		return pipelineLayout_;
+	}
+
+	[[nodiscard]] const PipelineState& GetState() const
+	{
+		return state_;
+	}
+
 	~Pipeline()
 	{
 		device_.destroyPipeline(pipeline_);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "polyflags.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+
+enum class BlendMode : uint8_t
+{
+	Opaque,
+	Modulated,
+	Translucent,
+	Highlight,
+	AlphaBlend,
+	Invisible,
+
+	Count
+};
+
+// Fixed-function state that is derived from PolyFlags.
+// Everything except blending can be set dynamically when VK_EXT_extended_dynamic_state is available,
+// so in that case only blend mode selects a pipeline.
+struct PipelineState
+{
+	BlendMode blendMode = BlendMode::Opaque;
+	bool depthWrite = true;
+	bool twoSided = false;
+	vk::CompareOp depthCompare = vk::CompareOp::eLessOrEqual;
+
+	// See polyflags.h for interpretation of the flags.
+	[[nodiscard]] static PipelineState FromPolyFlags(uint32_t polyFlags)
+	{
+		PipelineState state;
+
+		if (polyFlags & PF_Invisible)
+			state.blendMode = BlendMode::Invisible;
+		else if (polyFlags & PF_Translucent)
+			state.blendMode = BlendMode::Translucent;
+		else if (polyFlags & PF_Modulated)
+			state.blendMode = BlendMode::Modulated;
+		else if (polyFlags & PF_Highlighted)
+			state.blendMode = BlendMode::Highlight;
+#ifdef RUNE
+		else if (polyFlags & PF_AlphaBlend)
+			state.blendMode = BlendMode::AlphaBlend;
+#endif
+
+		state.depthWrite = (polyFlags & PF_Occlude) || !(polyFlags & (PF_Translucent | PF_Modulated));
+		state.twoSided = (polyFlags & PF_TwoSided) != 0;
+
+		return state;
+	}
+
+	[[nodiscard]] vk::CullModeFlags GetCullMode() const
+	{
+		return twoSided ? vk::CullModeFlagBits::eNone : vk::CullModeFlagBits::eBack;
+	}
+
+	// Packs the state into a small integer suitable for pipeline lookup.
+	// When raster state is dynamic, only the part that is baked into the pipeline is kept.
+	[[nodiscard]] uint32_t GetKey(bool dynamicRasterState) const
+	{
+		uint32_t key = uint32_t(blendMode);
+		if (!dynamicRasterState)
+		{
+			key |= uint32_t(depthWrite) << 3;
+			key |= uint32_t(twoSided) << 4;
+			key |= uint32_t(depthCompare) << 5;
+		}
+		return key;
+	}
+
+	[[nodiscard]] static PipelineState FromKey(uint32_t key)
+	{
+		PipelineState state;
+		state.blendMode = BlendMode(key & 0x7);
+		state.depthWrite = (key >> 3) & 1;
+		state.twoSided = (key >> 4) & 1;
+		state.depthCompare = vk::CompareOp((key >> 5) & 0x7);
+		return state;
+	}
+};
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 enum class PresentationMode
 {
 	Immediate,
@@ -8,7 +11,41 @@ enum class PresentationMode
 	VSyncTripleBuffering,
 };
 
+enum class UpscaleFilter
+{
+	Bilinear,
+	Sharpen,
+};
+
 struct RendererSettings
 {
 	PresentationMode presentationMode;
+	uint32_t anisotropy; // Clamped to the device limit; 1 disables anisotropic filtering.
+	float lodBias;
+	std::wstring preferredDevice; // Device name or UUID; empty picks the best ranked device.
+
+	// Dynamic resolution: the scene is rendered at [minResolutionScale, maxResolutionScale] of the swapchain extent and upscaled.
+	float targetFrameTime; // GPU milliseconds per frame; 0 disables dynamic resolution.
+	float minResolutionScale;
+	float maxResolutionScale;
+	UpscaleFilter upscaleFilter;
+	float sharpness; // Strength of UpscaleFilter::Sharpen, 0..1.
+
+	// Low latency mode starts a frame only once the previous one is presented, so no frame is queued ahead of the GPU.
+	bool lowLatency;
+	float frameRateLimit; // Frames per second; 0 is unlimited.
+
+	bool diskTextureCache; // Keep converted textures in a file next to the driver for later runs.
+
+	// Keep P8 textures as indices plus a palette row and look colors up in the shader; see PaletteTable.
+	bool paletteIndexedTextures;
+	bool paletteBilinearFilter; // Filter palette-indexed textures manually; otherwise they are point sampled.
+
+	// Draw opaque world surfaces depth-only first and shade them with an equal depth test, so every pixel is shaded once.
+	// Pays off when fill rate is the limit, costs when geometry is.
+	bool depthPrePass;
+
+	// VK_EXT_debug_utils object names and command buffer labels, so that captures in graphics debuggers and profilers are readable.
+	bool debugLabels;
+	uint32_t debugMessageSeverity; // Validation messages below it are dropped: 0 verbose, 1 info, 2 warning, 3 error.
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <boost/noncopyable.hpp>
+
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+struct SamplerState
+{
+	bool nearest = false; // PF_NoSmooth
+	bool clamp = false;
+	uint8_t maxAnisotropy = 1; // 1 disables anisotropic filtering.
+	int8_t lodBias = 0; // In 1/8 of a mip.
+
+	[[nodiscard]] static int8_t ToLodBias(float bias)
+	{
+		return int8_t(std::lround(std::fmax(-16.0f, std::fmin(15.875f, bias)) * 8.0f));
+	}
+
+	// Every field gets its own bits, so equal keys mean equal samplers.
+	[[nodiscard]] uint32_t GetKey() const
+	{
+		return uint32_t(nearest) | uint32_t(clamp) << 1 | uint32_t(maxAnisotropy) << 8 | uint32_t(uint8_t(lodBias)) << 16;
+	}
+
+	[[nodiscard]] vk::SamplerCreateInfo GetCreateInfo() const
+	{
+		const auto filter = nearest ? vk::Filter::eNearest : vk::Filter::eLinear;
+		const auto addressMode = clamp ? vk::SamplerAddressMode::eClampToEdge : vk::SamplerAddressMode::eRepeat;
+
+		return vk::SamplerCreateInfo()
+		       .setMagFilter(filter)
+		       .setMinFilter(filter)
+		       .setMipmapMode(nearest ? vk::SamplerMipmapMode::eNearest : vk::SamplerMipmapMode::eLinear)
+		       .setAddressModeU(addressMode)
+		       .setAddressModeV(addressMode)
+		       .setAddressModeW(addressMode)
+		       .setMipLodBias(float(lodBias) / 8.0f)
+		       .setAnisotropyEnable(!nearest && maxAnisotropy > 1)
+		       .setMaxAnisotropy(float(maxAnisotropy))
+		       .setMinLod(0.0f)
+		       .setMaxLod(VK_LOD_CLAMP_NONE);
+	}
+};
+
+// Creates each distinct sampler once per device.
+// Meant to be queried while building descriptor sets and layouts, not per draw.
+class SamplerCache : boost::noncopyable
+{
+	vk::Device device_;
+	uint32_t maxSamplerCount_;
+	std::unordered_map<uint32_t, vk::Sampler> samplers_;
+
+public:
+	SamplerCache(vk::Device device, uint32_t maxSamplerAllocationCount)
+		: device_(device)
+		, maxSamplerCount_(maxSamplerAllocationCount)
+	{
+	}
+
+	~SamplerCache()
+	{
+		for (const auto& [key, sampler] : samplers_)
+			device_.destroySampler(sampler);
+	}
+
+	[[nodiscard]] vk::Sampler Get(const SamplerState& state)
+	{
+		const auto key = state.GetKey();
+
+		const auto it = samplers_.find(key);
+		if (it != samplers_.end())
+			return it->second;
+
+		if (samplers_.size() >= maxSamplerCount_)
+			throw std::runtime_error("maxSamplerAllocationCount exceeded");
+
+		const auto sampler = device_.createSampler(state.GetCreateInfo());
+		samplers_.emplace(key, sampler);
+		return sampler;
+	}
+
+	[[nodiscard]] size_t GetCount() const
+	{
+		return samplers_.size();
+	}
+};
@@ -0,0 +1,396 @@
+#pragma once
+
+#include "DeviceMemoryAllocator.h"
+#include "LinearBufferPool.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+// A sampled 2D image with its memory and view.
+// Contents are uploaded through a command buffer that runs before the frame that samples them (see BeginUpload()).
+class Texture : boost::noncopyable
+{
+	vk::Device device_;
+	DeviceMemoryAllocator* allocator_;
+	vk::Format format_;
+	vk::Extent2D extent_;
+	uint32_t mipCount_;
+
+	vk::Image image_;
+	vk::ImageView view_;
+	MemoryAllocation memory_;
+
+	void Destroy()
+	{
+		if (!image_)
+			return;
+
+		device_.destroyImageView(view_);
+		device_.destroyImage(image_);
+		allocator_->Free(memory_);
+	}
+
+	// All transitions start from transfer writes.
+	void TransitionMips(
+		vk::CommandBuffer commandBuffer,
+		uint32_t firstMip,
+		uint32_t mipCount,
+		vk::ImageLayout oldLayout,
+		vk::ImageLayout newLayout,
+		vk::PipelineStageFlags dstStage,
+		vk::AccessFlags dstAccess) const
+	{
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer,
+			dstStage,
+			{},
+			nullptr,
+			nullptr,
+			vk::ImageMemoryBarrier()
+			.setImage(image_)
+			.setSubresourceRange(GetSubresourceRange(firstMip, mipCount))
+			.setOldLayout(oldLayout)
+			.setNewLayout(newLayout)
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(dstAccess)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED));
+	}
+
+public:
+	Texture(
+		vk::Device device,
+		DeviceMemoryAllocator& allocator,
+		vk::Format format,
+		vk::Extent2D extent,
+		uint32_t mipCount,
+		vk::ImageUsageFlags extraUsage = {})
+		: device_(device)
+		, allocator_(&allocator)
+		, format_(format)
+		, extent_(extent)
+		, mipCount_(mipCount)
+	{
+		image_ = device_.createImage(
+			vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setFormat(format_)
+			.setExtent(vk::Extent3D(extent_.width, extent_.height, 1))
+			.setMipLevels(mipCount_)
+			.setArrayLayers(1)
+			.setSamples(vk::SampleCountFlagBits::e1)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setUsage(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | extraUsage)
+			.setSharingMode(vk::SharingMode::eExclusive)
+			.setInitialLayout(vk::ImageLayout::eUndefined));
+
+		memory_ = allocator_->AllocateForImage(image_, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		view_ = device_.createImageView(
+			vk::ImageViewCreateInfo()
+			.setImage(image_)
+			.setFormat(format_)
+			.setViewType(vk::ImageViewType::e2D)
+			.setSubresourceRange(GetSubresourceRange(0, mipCount_)));
+	}
+
+	Texture(Texture&& other) noexcept
+		: device_(other.device_)
+		, allocator_(other.allocator_)
+		, format_(other.format_)
+		, extent_(other.extent_)
+		, mipCount_(other.mipCount_)
+		, image_(other.image_)
+		, view_(other.view_)
+		, memory_(other.memory_)
+	{
+		other.image_ = nullptr;
+		other.view_ = nullptr;
+		other.memory_ = {};
+	}
+
+	Texture& operator=(Texture&& other) noexcept
+	{
+		Destroy();
+
+		device_ = other.device_;
+		allocator_ = other.allocator_;
+		format_ = other.format_;
+		extent_ = other.extent_;
+		mipCount_ = other.mipCount_;
+		image_ = other.image_;
+		view_ = other.view_;
+		memory_ = other.memory_;
+
+		other.image_ = nullptr;
+		other.view_ = nullptr;
+		other.memory_ = {};
+
+		return *this;
+	}
+
+	~Texture()
+	{
+		Destroy();
+	}
+
+	[[nodiscard]] static bool IsBlockCompressed(vk::Format format)
+	{
+		return format >= vk::Format::eBc1RgbUnormBlock && format <= vk::Format::eBc7SrgbBlock;
+	}
+
+	[[nodiscard]] static size_t GetMipSize(vk::Format format, uint32_t width, uint32_t height)
+	{
+		switch (format)
+		{
+		case vk::Format::eBc1RgbUnormBlock:
+		case vk::Format::eBc1RgbaUnormBlock:
+			return size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4) * 8;
+		case vk::Format::eBc2UnormBlock:
+		case vk::Format::eBc3UnormBlock:
+			return size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4) * 16;
+		case vk::Format::eR8Unorm:
+			return size_t(width) * height;
+		case vk::Format::eR8G8B8A8Unorm:
+		case vk::Format::eB8G8R8A8Unorm:
+			return size_t(width) * height * 4;
+		default:
+			throw std::runtime_error("Unsupported texture format");
+		}
+	}
+
+	// Number of mips down to 1x1.
+	[[nodiscard]] static uint32_t GetFullMipCount(vk::Extent2D extent)
+	{
+		uint32_t count = 1;
+		for (auto size = std::max(extent.width, extent.height); size > 1; size >>= 1)
+			++count;
+		return count;
+	}
+
+	[[nodiscard]] static vk::ImageSubresourceRange GetSubresourceRange(uint32_t firstMip, uint32_t mipCount)
+	{
+		return vk::ImageSubresourceRange()
+		       .setAspectMask(vk::ImageAspectFlagBits::eColor)
+		       .setBaseMipLevel(firstMip)
+		       .setLevelCount(mipCount)
+		       .setLayerCount(1);
+	}
+
+	[[nodiscard]] static vk::Extent2D GetMipExtent(vk::Extent2D extent, uint32_t mip)
+	{
+		return vk::Extent2D(std::max(1u, extent.width >> mip), std::max(1u, extent.height >> mip));
+	}
+
+	[[nodiscard]] vk::Extent2D GetMipExtent(uint32_t mip) const
+	{
+		return GetMipExtent(extent_, mip);
+	}
+
+	[[nodiscard]] size_t GetMipSize(uint32_t mip) const
+	{
+		const auto extent = GetMipExtent(mip);
+		return GetMipSize(format_, extent.width, extent.height);
+	}
+
+	/**
+	Prepares every mip for being written. Previous contents are discarded.
+	The barrier also orders the upload after any earlier frame that still samples this texture.
+	*/
+	void BeginUpload(vk::CommandBuffer commandBuffer) const
+	{
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eFragmentShader,
+			vk::PipelineStageFlagBits::eTransfer,
+			{},
+			nullptr,
+			nullptr,
+			vk::ImageMemoryBarrier()
+			.setImage(image_)
+			.setSubresourceRange(GetSubresourceRange(0, mipCount_))
+			.setOldLayout(vk::ImageLayout::eUndefined)
+			.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+			.setSrcAccessMask({})
+			.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED));
+	}
+
+	/**
+	Records a copy of one mip from staging memory.
+	\return Where the caller has to write GetMipSize(mip) bytes of texel data before the command buffer is submitted.
+	*/
+	[[nodiscard]] void* UploadMip(vk::CommandBuffer commandBuffer, LinearBufferPool& staging, uint32_t mip) const
+	{
+		const auto stagingAllocation = staging.Allocate(GetMipSize(mip), 16);
+		const auto extent = GetMipExtent(mip);
+
+		commandBuffer.copyBufferToImage(
+			stagingAllocation.buffer,
+			image_,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::BufferImageCopy()
+			.setBufferOffset(stagingAllocation.offset)
+			.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mip, 0, 1))
+			.setImageExtent(vk::Extent3D(extent.width, extent.height, 1)));
+
+		return stagingAllocation.data;
+	}
+
+	/**
+	Rewrites a rectangle of mip 0 of a texture that shaders already read; the rest keeps its contents. Records its own barriers.
+	\return Where the caller has to write the rectangle's texels, rows tightly packed, before the command buffer is submitted.
+	*/
+	[[nodiscard]] void* UpdateRegion(vk::CommandBuffer commandBuffer, LinearBufferPool& staging, vk::Offset2D offset, vk::Extent2D extent) const
+	{
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eFragmentShader,
+			vk::PipelineStageFlagBits::eTransfer,
+			{},
+			nullptr,
+			nullptr,
+			vk::ImageMemoryBarrier()
+			.setImage(image_)
+			.setSubresourceRange(GetSubresourceRange(0, 1))
+			.setOldLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+			.setSrcAccessMask({})
+			.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED));
+
+		const auto stagingAllocation = staging.Allocate(GetMipSize(format_, extent.width, extent.height), 16);
+
+		commandBuffer.copyBufferToImage(
+			stagingAllocation.buffer,
+			image_,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::BufferImageCopy()
+			.setBufferOffset(stagingAllocation.offset)
+			.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+			.setImageOffset(vk::Offset3D(offset.x, offset.y, 0))
+			.setImageExtent(vk::Extent3D(extent.width, extent.height, 1)));
+
+		TransitionMips(
+			commandBuffer,
+			0,
+			1,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::ImageLayout::eShaderReadOnlyOptimal,
+			vk::PipelineStageFlagBits::eFragmentShader,
+			vk::AccessFlagBits::eShaderRead);
+
+		return stagingAllocation.data;
+	}
+
+	/**
+	Makes the texture visible to fragment shaders.
+	\param uploadedMipCount Mips [uploadedMipCount, GetMipCount()) are generated from the last uploaded one with a chain of linear blits.
+	The texture has to be created with eTransferSrc usage and a format that supports linear blits for that.
+	*/
+	void EndUpload(vk::CommandBuffer commandBuffer, uint32_t uploadedMipCount) const
+	{
+		for (auto mip = std::max(1u, uploadedMipCount); mip < mipCount_; ++mip)
+		{
+			// The previous mip was just written, either by the upload or by the previous blit.
+			TransitionMips(
+				commandBuffer,
+				mip - 1,
+				1,
+				vk::ImageLayout::eTransferDstOptimal,
+				vk::ImageLayout::eTransferSrcOptimal,
+				vk::PipelineStageFlagBits::eTransfer,
+				vk::AccessFlagBits::eTransferRead);
+
+			const auto sourceExtent = GetMipExtent(mip - 1);
+			const auto destinationExtent = GetMipExtent(mip);
+
+			commandBuffer.blitImage(
+				image_,
+				vk::ImageLayout::eTransferSrcOptimal,
+				image_,
+				vk::ImageLayout::eTransferDstOptimal,
+				vk::ImageBlit()
+				.setSrcSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mip - 1, 0, 1))
+				.setSrcOffsets({vk::Offset3D(0, 0, 0), vk::Offset3D(int32_t(sourceExtent.width), int32_t(sourceExtent.height), 1)})
+				.setDstSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mip, 0, 1))
+				.setDstOffsets({vk::Offset3D(0, 0, 0), vk::Offset3D(int32_t(destinationExtent.width), int32_t(destinationExtent.height), 1)}),
+				vk::Filter::eLinear);
+		}
+
+		const auto blitSourceCount = uploadedMipCount < mipCount_ ? mipCount_ - std::max(1u, uploadedMipCount) : 0;
+		if (blitSourceCount == 0)
+		{
+			TransitionMips(
+				commandBuffer,
+				0,
+				mipCount_,
+				vk::ImageLayout::eTransferDstOptimal,
+				vk::ImageLayout::eShaderReadOnlyOptimal,
+				vk::PipelineStageFlagBits::eFragmentShader,
+				vk::AccessFlagBits::eShaderRead);
+			return;
+		}
+
+		// Blit sources are in eTransferSrcOptimal now; the uploaded mips before them and the last generated mip are still in eTransferDstOptimal.
+		const auto firstBlitSource = mipCount_ - 1 - blitSourceCount;
+		TransitionMips(
+			commandBuffer,
+			firstBlitSource,
+			blitSourceCount,
+			vk::ImageLayout::eTransferSrcOptimal,
+			vk::ImageLayout::eShaderReadOnlyOptimal,
+			vk::PipelineStageFlagBits::eFragmentShader,
+			vk::AccessFlagBits::eShaderRead);
+
+		if (firstBlitSource != 0)
+		{
+			TransitionMips(
+				commandBuffer,
+				0,
+				firstBlitSource,
+				vk::ImageLayout::eTransferDstOptimal,
+				vk::ImageLayout::eShaderReadOnlyOptimal,
+				vk::PipelineStageFlagBits::eFragmentShader,
+				vk::AccessFlagBits::eShaderRead);
+		}
+
+		TransitionMips(
+			commandBuffer,
+			mipCount_ - 1,
+			1,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::ImageLayout::eShaderReadOnlyOptimal,
+			vk::PipelineStageFlagBits::eFragmentShader,
+			vk::AccessFlagBits::eShaderRead);
+	}
+
+	[[nodiscard]] vk::Image GetImage() const
+	{
+		return image_;
+	}
+
+	[[nodiscard]] vk::ImageView GetView() const
+	{
+		return view_;
+	}
+
+	[[nodiscard]] vk::Format GetFormat() const
+	{
+		return format_;
+	}
+
+	[[nodiscard]] vk::Extent2D GetExtent() const
+	{
+		return extent_;
+	}
+
+	[[nodiscard]] uint32_t GetMipCount() const
+	{
+		return mipCount_;
+	}
+};
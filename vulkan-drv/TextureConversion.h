@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Conversions of UE texture data to formats Vulkan can sample. Independent of the engine headers.
+namespace texture_conversion
+{
+	/**
+	Expands 8-bit palette indices to 32-bit colors.
+	\param palette 256 colors in the layout expected by the destination format.
+	\param masked Index 0 becomes transparent black (PF_Masked).
+	*/
+	inline void ConvertP8(const uint8_t* source, const uint32_t* palette, bool masked, uint32_t* destination, size_t pixelCount)
+	{
+		uint32_t table[256];
+		std::memcpy(table, palette, sizeof(table));
+		if (masked)
+			table[0] = 0;
+
+		size_t i = 0;
+		for (; i + 4 <= pixelCount; i += 4)
+		{
+			destination[i + 0] = table[source[i + 0]];
+			destination[i + 1] = table[source[i + 1]];
+			destination[i + 2] = table[source[i + 2]];
+			destination[i + 3] = table[source[i + 3]];
+		}
+		for (; i < pixelCount; ++i)
+			destination[i] = table[source[i]];
+	}
+}
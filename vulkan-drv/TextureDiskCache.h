@@ -0,0 +1,359 @@
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Persists converted texture data between runs so that loading a known texture is a plain copy.
+// The file is an append-only log of entries. It is memory-mapped when opened; entries stored later become visible on the next Open().
+// Open() also compacts it: superseded entries are dropped, and once the file nears its size limit, the oldest entries too.
+// Find() may run on several threads at once and alongside Store(); everything else is single-threaded.
+// Independent of the engine headers and of Vulkan.
+class TextureDiskCache : boost::noncopyable
+{
+public:
+	// Bump when the layout of the file or of the converted data changes; files with another version are discarded.
+	static constexpr uint32_t Version = 1;
+
+	struct Key
+	{
+		uint64_t cacheId;
+		uint64_t contentHash;
+		uint64_t paletteHash;
+
+		bool operator==(const Key& other) const
+		{
+			return cacheId == other.cacheId && contentHash == other.contentHash && paletteHash == other.paletteHash;
+		}
+	};
+
+	struct Description
+	{
+		uint32_t format; // Up to the user, e.g. a VkFormat.
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipCount;
+	};
+
+	struct Entry
+	{
+		Description description;
+		const uint8_t* data; // Mips one after another, in the mapped file.
+		uint64_t size;
+	};
+
+	// Not cryptographic; it only has to tell apart different contents under the same CacheID.
+	[[nodiscard]] static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0)
+	{
+		constexpr uint64_t Multiplier = 0x9E3779B97F4A7C15ull;
+
+		const auto* bytes = static_cast<const uint8_t*>(data);
+		auto hash = seed ^ (size * Multiplier);
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + i, sizeof(word));
+			hash = (hash ^ word) * Multiplier;
+			hash ^= hash >> 29;
+		}
+
+		uint64_t tail = 0;
+		std::memcpy(&tail, bytes + i, size - i);
+		hash = (hash ^ tail) * Multiplier;
+
+		return hash ^ (hash >> 32);
+	}
+
+private:
+	static constexpr char Magic[4] = {'V', 'K', 'T', 'C'};
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+	};
+
+	struct EntryHeader
+	{
+		Key key;
+		Description description;
+		uint64_t size;
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			return size_t(key.cacheId ^ key.contentHash ^ (key.paletteHash << 1));
+		}
+	};
+
+	std::filesystem::path path_;
+	uint64_t maxFileSize_;
+
+	boost::interprocess::file_mapping mapping_;
+	boost::interprocess::mapped_region region_;
+	// Offsets of entry headers in the mapped file; later entries with the same key win.
+	std::unordered_map<Key, uint64_t, KeyHash> entries_;
+
+	std::ofstream writer_;
+	uint64_t fileSize_ = 0;
+	// Stored since the last Open(), so not in entries_ yet; a texture uploaded again in the same session is not appended twice.
+	std::unordered_set<Key, KeyHash> storedKeys_;
+
+	std::atomic<size_t> hitCount_{0};
+	std::atomic<size_t> missCount_{0};
+
+	// Entries are 8-byte aligned in the file.
+	[[nodiscard]] static uint64_t Align(uint64_t size)
+	{
+		return (size + 7) & ~uint64_t(7);
+	}
+
+	[[nodiscard]] bool HasValidHeader() const
+	{
+		std::ifstream reader(path_, std::ios::binary);
+		FileHeader header{};
+		return reader.read(reinterpret_cast<char*>(&header), sizeof(header)) && std::memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+			header.version == Version;
+	}
+
+	static void WriteHeader(std::ofstream& file)
+	{
+		FileHeader header{};
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	void Create()
+	{
+		std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+		WriteHeader(file);
+	}
+
+	// Returns the end of the last complete entry. A crash while writing leaves a partial entry behind.
+	uint64_t IndexEntries()
+	{
+		entries_.clear();
+
+		const auto* data = static_cast<const uint8_t*>(region_.get_address());
+		const auto size = uint64_t(region_.get_size());
+
+		auto offset = uint64_t(sizeof(FileHeader));
+		while (offset + sizeof(EntryHeader) <= size)
+		{
+			EntryHeader header;
+			std::memcpy(&header, data + offset, sizeof(header));
+
+			const auto end = offset + sizeof(EntryHeader) + Align(header.size);
+			if (header.size == 0 || end > size)
+				break;
+
+			entries_[header.key] = offset;
+			offset = end;
+		}
+
+		return offset;
+	}
+
+	[[nodiscard]] uint64_t GetEntrySize(uint64_t offset) const
+	{
+		EntryHeader header;
+		std::memcpy(&header, static_cast<const uint8_t*>(region_.get_address()) + offset, sizeof(header));
+		return sizeof(EntryHeader) + Align(header.size);
+	}
+
+	/**
+	Rewrites the file with the entries that Find() can return, newest first until budget is reached; later entries are newer.
+	Keeps the file as it is when it cannot be rewritten.
+	*/
+	void Compact(uint64_t budget)
+	{
+		std::vector<uint64_t> offsets;
+		offsets.reserve(entries_.size());
+		for (const auto& entry : entries_)
+			offsets.push_back(entry.second);
+		std::sort(offsets.begin(), offsets.end(), std::greater<>());
+
+		auto keptSize = uint64_t(sizeof(FileHeader));
+		std::vector<uint64_t> keptOffsets;
+		for (const auto offset : offsets)
+		{
+			const auto entrySize = GetEntrySize(offset);
+			if (keptSize + entrySize > budget)
+				break;
+
+			keptSize += entrySize;
+			keptOffsets.push_back(offset);
+		}
+
+		auto temporaryPath = path_;
+		temporaryPath += ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			WriteHeader(file);
+
+			const auto* data = static_cast<const char*>(region_.get_address());
+			for (auto it = keptOffsets.rbegin(); it != keptOffsets.rend(); ++it)
+				file.write(data + *it, std::streamsize(GetEntrySize(*it)));
+
+			if (!file)
+			{
+				file.close();
+				std::error_code error;
+				std::filesystem::remove(temporaryPath, error);
+				return;
+			}
+		}
+
+		Unmap();
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, path_, error);
+		if (error)
+			std::filesystem::remove(temporaryPath, error);
+		Map();
+		(void)IndexEntries();
+	}
+
+	void Unmap()
+	{
+		region_ = boost::interprocess::mapped_region();
+		mapping_ = boost::interprocess::file_mapping();
+	}
+
+	void Map()
+	{
+		mapping_ = boost::interprocess::file_mapping(path_.string().c_str(), boost::interprocess::read_only);
+		region_ = boost::interprocess::mapped_region(mapping_, boost::interprocess::read_only);
+	}
+
+public:
+	TextureDiskCache(std::filesystem::path path, uint64_t maxFileSize)
+		: path_(std::move(path))
+		, maxFileSize_(maxFileSize)
+	{
+		Open();
+	}
+
+	/**
+	Maps the file, including everything stored since the previous Open(). Invalid files are recreated empty.
+	\note Compacts the file when a quarter of it is superseded entries, or when it is three quarters full; then it keeps the newest entries
+	that fit in half of the limit, so Store() has room again.
+	*/
+	void Open()
+	{
+		writer_.close();
+		Unmap();
+		storedKeys_.clear();
+
+		if (!HasValidHeader())
+			Create();
+
+		Map();
+		const auto validSize = IndexEntries();
+
+		if (validSize < uint64_t(region_.get_size()))
+		{
+			Unmap();
+			std::error_code error;
+			std::filesystem::resize_file(path_, validSize, error);
+			Map();
+			(void)IndexEntries();
+		}
+
+		auto liveSize = uint64_t(sizeof(FileHeader));
+		for (const auto& entry : entries_)
+			liveSize += GetEntrySize(entry.second);
+
+		const auto size = uint64_t(region_.get_size());
+		if (size > maxFileSize_ / 4 * 3)
+			Compact(maxFileSize_ / 2);
+		else if (size - liveSize > size / 4)
+			Compact(maxFileSize_);
+
+		fileSize_ = uint64_t(region_.get_size());
+		writer_.open(path_, std::ios::binary | std::ios::app);
+	}
+
+	[[nodiscard]] std::optional<Entry> Find(const Key& key, const Description& description)
+	{
+		const auto it = entries_.find(key);
+		if (it == entries_.end())
+		{
+			++missCount_;
+			return std::nullopt;
+		}
+
+		const auto* data = static_cast<const uint8_t*>(region_.get_address()) + it->second;
+		EntryHeader header;
+		std::memcpy(&header, data, sizeof(header));
+
+		if (std::memcmp(&header.description, &description, sizeof(description)) != 0)
+		{
+			++missCount_;
+			return std::nullopt;
+		}
+
+		++hitCount_;
+		return Entry{header.description, data + sizeof(EntryHeader), header.size};
+	}
+
+	/**
+	Appends an entry; it can be found after the next Open(). Keys already stored since then are skipped.
+	\note Does nothing once the file has reached its size limit, until the next Open() compacts it.
+	*/
+	void Store(const Key& key, const Description& description, const void* data, uint64_t size)
+	{
+		const auto entrySize = sizeof(EntryHeader) + Align(size);
+		if (size == 0 || !writer_ || fileSize_ + entrySize > maxFileSize_ || !storedKeys_.insert(key).second)
+			return;
+
+		const EntryHeader header{key, description, size};
+		writer_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		writer_.write(static_cast<const char*>(data), std::streamsize(size));
+
+		constexpr char padding[8] = {};
+		writer_.write(padding, std::streamsize(Align(size) - size));
+
+		fileSize_ += entrySize;
+	}
+
+	void Flush()
+	{
+		writer_.flush();
+	}
+
+	[[nodiscard]] uint64_t GetFileSize() const
+	{
+		return fileSize_;
+	}
+
+	[[nodiscard]] size_t GetEntryCount() const
+	{
+		return entries_.size();
+	}
+
+	[[nodiscard]] size_t GetHitCount() const
+	{
+		return hitCount_;
+	}
+
+	[[nodiscard]] size_t GetMissCount() const
+	{
+		return missCount_;
+	}
+};
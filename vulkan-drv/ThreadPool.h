@@ -0,0 +1,203 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing thread pool for short CPU jobs such as texture conversion.
+// Every worker has its own deque: it takes its newest job first (jobs it just spawned are hot in cache) and steals the oldest job of
+// another queue when its own is empty. Jobs submitted from outside the pool go to a shared queue that everybody steals from.
+class ThreadPool : boost::noncopyable
+{
+public:
+	using Job = std::function<void()>;
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	// Workers own queues [0, threadCount); the last one is for outside submitters.
+	std::vector<std::unique_ptr<Queue>> queues_;
+	std::vector<std::thread> threads_;
+
+	std::mutex sleepMutex_;
+	std::condition_variable workAvailable_;
+	std::condition_variable allDone_;
+	std::atomic<size_t> queuedCount_{0};
+	std::atomic<size_t> pendingCount_{0};
+	bool stop_ = false;
+
+	std::mutex exceptionMutex_;
+	std::exception_ptr exception_;
+
+	static size_t& CurrentQueueIndex()
+	{
+		thread_local size_t index = ~size_t(0);
+		return index;
+	}
+
+	static const ThreadPool*& CurrentPool()
+	{
+		thread_local const ThreadPool* pool = nullptr;
+		return pool;
+	}
+
+	[[nodiscard]] size_t GetOwnQueueIndex() const
+	{
+		return CurrentPool() == this ? CurrentQueueIndex() : queues_.size() - 1;
+	}
+
+	[[nodiscard]] bool TryPop(size_t queueIndex, bool newest, Job& job)
+	{
+		auto& queue = *queues_[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())
+			return false;
+
+		if (newest)
+		{
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+		}
+		else
+		{
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+		}
+
+		--queuedCount_;
+		return true;
+	}
+
+	bool TryRunOne(size_t ownQueueIndex)
+	{
+		Job job;
+		bool found = TryPop(ownQueueIndex, true, job);
+		for (size_t i = 1; !found && i < queues_.size(); ++i)
+			found = TryPop((ownQueueIndex + i) % queues_.size(), false, job);
+
+		if (!found)
+			return false;
+
+		try
+		{
+			job();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(exceptionMutex_);
+			if (!exception_)
+				exception_ = std::current_exception();
+		}
+
+		if (--pendingCount_ == 0)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+			allDone_.notify_all();
+		}
+
+		return true;
+	}
+
+	void WorkerLoop(size_t queueIndex)
+	{
+		CurrentPool() = this;
+		CurrentQueueIndex() = queueIndex;
+
+		for (;;)
+		{
+			if (TryRunOne(queueIndex))
+				continue;
+
+			std::unique_lock<std::mutex> lock(sleepMutex_);
+			workAvailable_.wait(lock, [this] { return stop_ || queuedCount_ > 0; });
+			if (stop_ && queuedCount_ == 0)
+				return;
+		}
+	}
+
+public:
+	explicit ThreadPool(size_t threadCount)
+	{
+		threadCount = std::max<size_t>(threadCount, 1);
+
+		for (size_t i = 0; i <= threadCount; ++i)
+			queues_.push_back(std::make_unique<Queue>());
+
+		for (size_t i = 0; i < threadCount; ++i)
+			threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+
+	// Runs the remaining jobs before returning.
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+			stop_ = true;
+		}
+		workAvailable_.notify_all();
+
+		for (auto& thread : threads_)
+			thread.join();
+	}
+
+	// Jobs may submit further jobs; those go to the submitting worker's own queue.
+	void Submit(Job job)
+	{
+		++pendingCount_;
+
+		auto& queue = *queues_[GetOwnQueueIndex()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+		++queuedCount_;
+
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+		workAvailable_.notify_one();
+	}
+
+	/**
+	Blocks until every submitted job, including the ones submitted meanwhile, has finished. The calling thread runs jobs too.
+	Rethrows the first exception a job threw. Must not be called from a job.
+	*/
+	void Wait()
+	{
+		const auto ownQueueIndex = GetOwnQueueIndex();
+		while (pendingCount_ > 0)
+		{
+			if (TryRunOne(ownQueueIndex))
+				continue;
+
+			std::unique_lock<std::mutex> lock(sleepMutex_);
+			allDone_.wait(lock, [this] { return pendingCount_ == 0 || queuedCount_ > 0; });
+		}
+
+		std::lock_guard<std::mutex> lock(exceptionMutex_);
+		if (exception_)
+			std::rethrow_exception(std::exchange(exception_, nullptr));
+	}
+
+	[[nodiscard]] bool IsIdle() const
+	{
+		return pendingCount_ == 0;
+	}
+
+	[[nodiscard]] size_t GetThreadCount() const
+	{
+		return threads_.size();
+	}
+};
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Two-level segregated fit allocator (http://www.gii.upv.es/tlsf/) that manages an abstract range of offsets.
+// It never touches the memory it manages, which is what we need for sub-allocating VkDeviceMemory.
+// Allocation and deallocation are O(1): a lookup in two bitmaps plus a constant number of list operations.
+class TlsfAllocator : boost::noncopyable
+{
+public:
+	using Handle = uint32_t;
+	static constexpr Handle InvalidHandle = ~Handle(0);
+
+	struct Allocation
+	{
+		Handle handle;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+private:
+	static constexpr uint32_t SecondLevelCountLog2 = 5;
+	static constexpr uint32_t SecondLevelCount = 1u << SecondLevelCountLog2;
+	static constexpr uint32_t AlignmentLog2 = 4;
+	static constexpr uint32_t FirstLevelShift = SecondLevelCountLog2 + AlignmentLog2;
+	static constexpr uint32_t FirstLevelMax = 40; // 1 TiB is plenty for a single memory block
+	static constexpr uint32_t FirstLevelCount = FirstLevelMax - FirstLevelShift + 1;
+	static constexpr uint64_t SmallBlockSize = uint64_t(1) << FirstLevelShift;
+
+	// Smallest remainder worth splitting off into a free block.
+	static constexpr uint64_t MinBlockSize = uint64_t(1) << AlignmentLog2;
+
+	struct Block
+	{
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		Handle prevPhysical = InvalidHandle;
+		Handle nextPhysical = InvalidHandle;
+		Handle prevFree = InvalidHandle;
+		Handle nextFree = InvalidHandle;
+		bool isFree = false;
+	};
+
+	uint64_t size_;
+	uint64_t usedSize_ = 0;
+	size_t allocationCount_ = 0;
+
+	uint64_t firstLevelBitmap_ = 0;
+	uint32_t secondLevelBitmaps_[FirstLevelCount] = {};
+	Handle freeLists_[FirstLevelCount][SecondLevelCount];
+
+	// Block headers live outside of the managed range, recycled through unusedBlocks_.
+	std::vector<Block> blocks_;
+	std::vector<Handle> unusedBlocks_;
+
+	static uint32_t FindLastSet(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanReverse(&index, uint32_t(value >> 32)))
+			return uint32_t(index) + 32;
+		_BitScanReverse(&index, uint32_t(value));
+		return uint32_t(index);
+#else
+		return 63 - uint32_t(__builtin_clzll(value));
+#endif
+	}
+
+	static uint32_t FindFirstSet(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, uint32_t(value)))
+			return uint32_t(index);
+		_BitScanForward(&index, uint32_t(value >> 32));
+		return uint32_t(index) + 32;
+#else
+		return uint32_t(__builtin_ctzll(value));
+#endif
+	}
+
+	static void MapInsert(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+	{
+		if (size < SmallBlockSize)
+		{
+			firstLevel = 0;
+			secondLevel = uint32_t(size / (SmallBlockSize / SecondLevelCount));
+		}
+		else
+		{
+			const auto lastSet = FindLastSet(size);
+			secondLevel = uint32_t(size >> (lastSet - SecondLevelCountLog2)) ^ SecondLevelCount;
+			firstLevel = lastSet - (FirstLevelShift - 1);
+		}
+	}
+
+	// Rounds the size up to the next list, so that any block found there is large enough.
+	static void MapSearch(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+	{
+		if (size >= SmallBlockSize)
+			size += (uint64_t(1) << (FindLastSet(size) - SecondLevelCountLog2)) - 1;
+
+		MapInsert(size, firstLevel, secondLevel);
+	}
+
+	Handle CreateBlock()
+	{
+		if (!unusedBlocks_.empty())
+		{
+			const auto handle = unusedBlocks_.back();
+			unusedBlocks_.pop_back();
+			blocks_[handle] = Block();
+			return handle;
+		}
+
+		blocks_.emplace_back();
+		return Handle(blocks_.size() - 1);
+	}
+
+	void ReleaseBlock(Handle handle)
+	{
+		unusedBlocks_.push_back(handle);
+	}
+
+	void InsertFreeBlock(Handle handle)
+	{
+		auto& block = blocks_[handle];
+
+		uint32_t firstLevel, secondLevel;
+		MapInsert(block.size, firstLevel, secondLevel);
+
+		const auto head = freeLists_[firstLevel][secondLevel];
+		block.isFree = true;
+		block.prevFree = InvalidHandle;
+		block.nextFree = head;
+		if (head != InvalidHandle)
+			blocks_[head].prevFree = handle;
+
+		freeLists_[firstLevel][secondLevel] = handle;
+		firstLevelBitmap_ |= uint64_t(1) << firstLevel;
+		secondLevelBitmaps_[firstLevel] |= 1u << secondLevel;
+	}
+
+	void RemoveFreeBlock(Handle handle)
+	{
+		auto& block = blocks_[handle];
+
+		uint32_t firstLevel, secondLevel;
+		MapInsert(block.size, firstLevel, secondLevel);
+
+		if (block.prevFree != InvalidHandle)
+			blocks_[block.prevFree].nextFree = block.nextFree;
+		if (block.nextFree != InvalidHandle)
+			blocks_[block.nextFree].prevFree = block.prevFree;
+
+		if (freeLists_[firstLevel][secondLevel] == handle)
+		{
+			freeLists_[firstLevel][secondLevel] = block.nextFree;
+			if (block.nextFree == InvalidHandle)
+			{
+				secondLevelBitmaps_[firstLevel] &= ~(1u << secondLevel);
+				if (secondLevelBitmaps_[firstLevel] == 0)
+					firstLevelBitmap_ &= ~(uint64_t(1) << firstLevel);
+			}
+		}
+
+		block.isFree = false;
+		block.prevFree = InvalidHandle;
+		block.nextFree = InvalidHandle;
+	}
+
+	[[nodiscard]] Handle FindFreeBlock(uint64_t size) const
+	{
+		uint32_t firstLevel, secondLevel;
+		MapSearch(size, firstLevel, secondLevel);
+
+		if (firstLevel >= FirstLevelCount)
+			return InvalidHandle;
+
+		auto secondLevelMap = secondLevelBitmaps_[firstLevel] & (~0u << secondLevel);
+		if (secondLevelMap == 0)
+		{
+			const auto firstLevelMap = firstLevel + 1 < 64 ? firstLevelBitmap_ & (~uint64_t(0) << (firstLevel + 1)) : 0;
+			if (firstLevelMap == 0)
+				return InvalidHandle;
+
+			firstLevel = FindFirstSet(firstLevelMap);
+			secondLevelMap = secondLevelBitmaps_[firstLevel];
+		}
+
+		return freeLists_[firstLevel][FindFirstSet(secondLevelMap)];
+	}
+
+	// Splits the tail of a block off into a new free block.
+	void SplitTail(Handle handle, uint64_t newSize)
+	{
+		const auto tail = CreateBlock();
+		auto& block = blocks_[handle];
+		auto& tailBlock = blocks_[tail];
+
+		tailBlock.offset = block.offset + newSize;
+		tailBlock.size = block.size - newSize;
+		tailBlock.prevPhysical = handle;
+		tailBlock.nextPhysical = block.nextPhysical;
+		if (block.nextPhysical != InvalidHandle)
+			blocks_[block.nextPhysical].prevPhysical = tail;
+
+		block.size = newSize;
+		block.nextPhysical = tail;
+
+		InsertFreeBlock(tail);
+	}
+
+	// Splits the head of a block off into a new free block.
+	void SplitHead(Handle handle, uint64_t headSize)
+	{
+		const auto head = CreateBlock();
+		auto& block = blocks_[handle];
+		auto& headBlock = blocks_[head];
+
+		headBlock.offset = block.offset;
+		headBlock.size = headSize;
+		headBlock.prevPhysical = block.prevPhysical;
+		headBlock.nextPhysical = handle;
+		if (block.prevPhysical != InvalidHandle)
+			blocks_[block.prevPhysical].nextPhysical = head;
+
+		block.offset += headSize;
+		block.size -= headSize;
+		block.prevPhysical = head;
+
+		InsertFreeBlock(head);
+	}
+
+	// Absorbs the next physical block into the given one.
+	void Merge(Handle handle, Handle next)
+	{
+		auto& block = blocks_[handle];
+		auto& nextBlock = blocks_[next];
+
+		block.size += nextBlock.size;
+		block.nextPhysical = nextBlock.nextPhysical;
+		if (nextBlock.nextPhysical != InvalidHandle)
+			blocks_[nextBlock.nextPhysical].prevPhysical = handle;
+
+		ReleaseBlock(next);
+	}
+
+public:
+	explicit TlsfAllocator(uint64_t size)
+		: size_(size)
+	{
+		for (auto& firstLevel : freeLists_)
+			for (auto& head : firstLevel)
+				head = InvalidHandle;
+
+		blocks_.reserve(256);
+
+		const auto handle = CreateBlock();
+		blocks_[handle].size = size;
+		InsertFreeBlock(handle);
+	}
+
+	/**
+	\param alignment Must be a power of two.
+	\return nullopt if there is no free block large enough.
+	*/
+	[[nodiscard]] std::optional<Allocation> Allocate(uint64_t size, uint64_t alignment)
+	{
+		if (size == 0)
+			size = 1;
+		size = (size + MinBlockSize - 1) & ~(MinBlockSize - 1);
+		if (alignment < MinBlockSize)
+			alignment = MinBlockSize;
+
+		// Any free block is MinBlockSize-aligned, so only larger alignments need slack.
+		const auto handle = FindFreeBlock(size + alignment - MinBlockSize);
+		if (handle == InvalidHandle)
+			return std::nullopt;
+
+		RemoveFreeBlock(handle);
+
+		const auto padding = ((blocks_[handle].offset + alignment - 1) & ~(alignment - 1)) - blocks_[handle].offset;
+		if (padding != 0)
+			SplitHead(handle, padding);
+
+		if (blocks_[handle].size - size >= MinBlockSize)
+			SplitTail(handle, size);
+
+		usedSize_ += blocks_[handle].size;
+		++allocationCount_;
+
+		return Allocation{handle, blocks_[handle].offset, blocks_[handle].size};
+	}
+
+	void Free(Handle handle)
+	{
+		usedSize_ -= blocks_[handle].size;
+		--allocationCount_;
+
+		const auto prev = blocks_[handle].prevPhysical;
+		if (prev != InvalidHandle && blocks_[prev].isFree)
+		{
+			RemoveFreeBlock(prev);
+			Merge(prev, handle);
+			handle = prev;
+		}
+
+		const auto next = blocks_[handle].nextPhysical;
+		if (next != InvalidHandle && blocks_[next].isFree)
+		{
+			RemoveFreeBlock(next);
+			Merge(handle, next);
+		}
+
+		InsertFreeBlock(handle);
+	}
+
+	[[nodiscard]] uint64_t GetSize() const
+	{
+		return size_;
+	}
+
+	[[nodiscard]] uint64_t GetUsedSize() const
+	{
+		return usedSize_;
+	}
+
+	[[nodiscard]] uint64_t GetFreeSize() const
+	{
+		return size_ - usedSize_;
+	}
+
+	[[nodiscard]] size_t GetAllocationCount() const
+	{
+		return allocationCount_;
+	}
+
+	[[nodiscard]] bool IsEmpty() const
+	{
+		return allocationCount_ == 0;
+	}
+
+	// Not O(1): walks the highest non-empty list. Meant for statistics only.
+	[[nodiscard]] uint64_t GetLargestFreeBlockSize() const
+	{
+		if (firstLevelBitmap_ == 0)
+			return 0;
+
+		const auto firstLevel = FindLastSet(firstLevelBitmap_);
+		const auto secondLevel = FindLastSet(secondLevelBitmaps_[firstLevel]);
+
+		uint64_t largest = 0;
+		for (auto handle = freeLists_[firstLevel][secondLevel]; handle != InvalidHandle; handle = blocks_[handle].nextFree)
+			largest = std::max(largest, blocks_[handle].size);
+
+		return largest;
+	}
+};
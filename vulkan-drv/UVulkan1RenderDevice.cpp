@@ -2,8 +2,25 @@
 
 #include "RendererSettings.h"
 #include "SelfDestroyable.h"
+#include "DebugMessageFilter.h"
+#include "DeletionQueue.h"
+#include "DeviceMemoryAllocator.h"
+#include "DynamicResolution.h"
+#include "FrameLimiter.h"
+#include "HitRecorder.h"
+#include "LinearBufferPool.h"
+#include "PaletteTable.h"
+#include "Texture.h"
+#include "TextureConversion.h"
+#include "TextureDiskCache.h"
+#include "ThreadPool.h"
+#include "VertexPacking.h"
+#include "BcDecoder.h"
 
 #include "Pipeline.h"
+#include "PipelineState.h"
+#include "SamplerCache.h"
+#include "VulkanFunctions.h"
 
 #include "utils.hpp"
 
@@ -19,9 +36,21 @@
 #include <boost/range/algorithm/set_algorithm.hpp>
 #include <boost/range/algorithm/for_each.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cwctype>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <optional>
 #include <sstream>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 
 using namespace std::string_literals;
@@ -30,6 +59,413 @@ struct SwapChainImage
 {
 	vk::Image image;
 	vk::ImageView view;
+	vk::Framebuffer framebuffer;
+};
+
+struct FrameContext
+{
+	vk::CommandBuffer commandBuffer;
+	// Texture uploads of the frame. Submitted together with, and before, commandBuffer; or on their own when recorded outside of a frame
+	// and another viewport draws first, see UVulkan1RenderDevice::SubmitUploads().
+	vk::CommandBuffer uploadCommandBuffer;
+	vk::Fence fence;
+	vk::Semaphore imageAvailableSemaphore;
+	vk::Semaphore renderFinishedSemaphore;
+
+	// Vertex, index and uniform data that only lives until the frame's fence is signaled.
+	std::optional<LinearBufferPool> transientBuffers;
+	// Per-draw descriptor sets, reset together with transientBuffers. Pools are added when the frame needs more.
+	std::vector<vk::DescriptorPool> descriptorPools;
+	size_t usedDescriptorPoolCount = 0;
+
+	// DeletionQueue serial of the frame's last submission, retired once the fence has been waited on.
+	uint64_t serial = 0;
+
+	// The fence has been waited on and transient buffers are reset; the frame can record work.
+	bool isPrepared = false;
+	bool hasUploads = false;
+	// GPU time of the scene pass was written to the frame's timestamp queries.
+	bool hasTimestamps = false;
+	// What the GPU time depends on, for comparing frames with and without the depth pre-pass; see UpdateGpuFrameTime().
+	vk::Extent2D renderExtent;
+	bool depthPrePass = false;
+
+	// For the latency report: when the frame started and which present it ended with (0 without VK_KHR_present_wait).
+	std::chrono::steady_clock::time_point lockTime;
+	uint64_t presentId = 0;
+	bool isLatencyPending = false;
+};
+
+// Push constants of upscale.frag, which also applies the screen flash and brightness.
+struct UpscaleParameters
+{
+	float uvScale[2];
+	float texelSize[2];
+	float sharpness;
+	float inverseGamma;
+	uint32_t colorTransform; // 0 when flash and gamma are identity; the shader then skips them.
+	uint32_t padding;
+	float flashScale[4];
+	float flashFog[4];
+};
+
+// Uniforms of a scene node, written once per SetSceneNode() into the frame's scene uniform ring; see WriteSceneUniforms().
+// Set 4 of the scene pipelines and set 0 of the hit pipelines; draws select a scene node by the dynamic offset of its record.
+struct SceneUniforms
+{
+	float projection[4]; // x and y scale, depth scale and offset.
+	float viewport[4]; // Half width and height of the scene node in pixels, then their reciprocals; tile.vert maps pixels with them.
+	float nearDepth; // Gouraud, tile and hit vertices closer than this are moved to it, see gouraud.vert.
+	float padding[3];
+};
+
+// Push constants of the scene pipelines' fragment shaders.
+struct DrawParameters
+{
+	float distanceFogColor[4];
+	float distanceFogScale; // 1 / fog end distance; 0 disables distance fog.
+	uint32_t flags;
+	uint32_t paletteRows; // PaletteTable rows of the diffuse, detail and macro layers, PaletteTable::RowBits each.
+};
+
+// Rune's linear distance fog for meshes, set by PreDrawGouraud().
+struct DistanceFog
+{
+	float color[4];
+	float scale;
+};
+
+// Per-draw data of a world surface. world.vert reads it as instance attributes; the draw's firstInstance selects the record.
+struct SurfaceParameters
+{
+	float layers[5][4]; // Diffuse, lightmap, fogmap, detail, macro: pan in texels, then 1 / size in texels.
+	uint32_t flags; // DrawParameters::flags and paletteRows, which world.frag takes from world.vert instead of push constants.
+	uint32_t paletteRows;
+	uint16_t layerTextures[4]; // Lightmap, fogmap, detail and macro texture: their element of WorldQueue::layerViews.
+};
+
+// Bits of DrawParameters::flags.
+constexpr uint32_t DrawFlagAlphaTest = 1;
+constexpr uint32_t DrawFlagLightmap = 2;
+constexpr uint32_t DrawFlagFogmap = 4;
+constexpr uint32_t DrawFlagDetail = 8;
+constexpr uint32_t DrawFlagMacro = 16;
+// The diffuse, detail and macro layers are palette-indexed, in this order; see SetPaletteLayer().
+constexpr uint32_t DrawFlagDiffusePalette = 32;
+constexpr uint32_t DrawFlagDetailPalette = 64;
+constexpr uint32_t DrawFlagMacroPalette = 128;
+// Palette index 0 is transparent.
+constexpr uint32_t DrawFlagMasked = 256;
+// Palette-indexed layers are filtered bilinearly in the shader instead of point sampled.
+constexpr uint32_t DrawFlagPaletteBilinear = 512;
+// The lightmap or fogmap holds 7-bit TEXF_RGBA7 data, which the shader scales to the full range.
+constexpr uint32_t DrawFlagLightmapRGBA7 = 1024;
+constexpr uint32_t DrawFlagFogmapRGBA7 = 2048;
+
+// Shader pairs of the scene pass. Each one gets the full set of PipelineState permutations.
+enum class SceneProgram : uint8_t
+{
+	Gouraud,
+	Color,
+	World,
+	Line, // Color with a line list topology.
+	Tile, // tile.vert with gouraud.frag.
+	WorldDepth, // world.vert with depth.frag and no color writes, for the depth pre-pass.
+
+	Count
+};
+
+struct CachedTexture
+{
+	Texture texture;
+	bool masked;
+	vk::DescriptorSet descriptorSet;
+
+	// Revision of the game's data last uploaded, see GetSourceHash().
+	uint64_t sourceHash = 0;
+
+	// Palette-indexed textures are R8 images of the game's indices; masking is applied in the shader. See CachePaletteIndexedTexture().
+	std::optional<uint32_t> paletteRow;
+	bool ownsPaletteRow = false;
+	uint64_t paletteHash = 0;
+};
+
+// A texture passed to PrecacheTexture() whose conversion runs on the precache pool. The image is created at the join, see FinishPrecache().
+struct PrecachedTexture
+{
+	// Its Mips and Palette are only valid during PrecacheTexture() and are cleared; the pool reads the copies below.
+	FTextureInfo info;
+	vk::Format format;
+	bool masked;
+	bool diskCacheable;
+	vk::Extent2D extent;
+	uint32_t mipCount; // Mips the game provides.
+	uint32_t palette[256];
+	std::vector<uint8_t> source; // The game's mips one after another.
+	std::vector<size_t> sourceOffsets; // Into source; mipCount + 1 entries.
+	std::vector<size_t> mipOffsets; // Into the converted chain; mipCount + 1 entries.
+
+	// Filled by the pool: either the chain found in the disk cache or a freshly converted one, with the key to store it under.
+	const uint8_t* cachedData = nullptr;
+	std::vector<uint8_t> data;
+	std::optional<TextureDiskCache::Key> storeKey;
+};
+
+// Consecutive gouraud fans with the same texture and flags, drawn as one indexed triangle list.
+struct GouraudBatch
+{
+	QWORD cacheId = 0;
+	DWORD polyFlags = 0;
+	const CachedTexture* texture = nullptr;
+	float uvScale[2] = {};
+	std::vector<vertex_packing::GouraudVertex> vertices;
+	std::vector<uint16_t> indices;
+};
+
+// Consecutive tiles with the same texture, flags and sampler, such as the characters of HUD text.
+struct TileBatch
+{
+	QWORD cacheId = 0;
+	DWORD polyFlags = 0;
+	const CachedTexture* texture = nullptr;
+	size_t samplerIndex = 0;
+	float uvScale[2] = {};
+	std::vector<vertex_packing::TileVertex> vertices;
+	std::vector<uint16_t> indices;
+};
+
+// World surfaces with the same pipeline state, diffuse texture and sampler, drawn by one vkCmdDrawIndexedIndirect.
+struct WorldBucket
+{
+	PipelineState state;
+	DWORD polyFlags; // Of the first surface; the distance fog color depends on the blend mode only.
+	vk::DescriptorSet diffuseSet;
+	size_t samplerIndex;
+	std::vector<vk::DrawIndexedIndirectCommand> commands;
+};
+
+// Surfaces of DrawComplexSurface() wait here until something else is drawn; see FlushWorldQueue().
+struct WorldQueue
+{
+	using BucketKey = std::tuple<uint32_t, vk::DescriptorSet, size_t>;
+
+	std::vector<vertex_packing::SurfaceVertex> vertices;
+	std::vector<uint16_t> indices; // Relative to each draw's vertexOffset.
+	std::vector<SurfaceParameters> surfaces;
+	// Only the first bucketCount are in use; the others keep their capacity for the next flush.
+	std::vector<WorldBucket> buckets;
+	size_t bucketCount = 0;
+	// Buckets created since the last blended surface, which opaque surfaces may join out of order.
+	std::map<BucketKey, size_t> openBuckets;
+	// Draws of the depth pre-pass, one-sided and two-sided; their surfaces are in the buckets as well, with an equal depth test.
+	std::array<std::vector<vk::DrawIndexedIndirectCommand>, 2> depthCommands;
+	// Lightmaps, fogmaps, detail and macro textures of the queued surfaces, bound as one array for all buckets; see AddWorldLayers().
+	std::vector<vk::ImageView> layerViews;
+	std::map<vk::ImageView, uint16_t> layerIndices;
+	std::vector<vk::DescriptorImageInfo> layerImageInfos;
+};
+
+// UnrealEd's lines and points, one vertex list per combination of LINE_Transparent and LINE_DepthCued; see Draw2DLine().
+// They are drawn without indices, so all lines of a scene node with the same flags take one draw however many there are.
+struct LineBatch
+{
+	std::array<std::vector<vertex_packing::ColorVertex>, 4> lines;
+	std::array<std::vector<vertex_packing::ColorVertex>, 4> points; // Two triangles per point.
+};
+
+// How hit vertices are drawn; each mode has its own hit pipeline. Lines and points test depth only when depth-cued.
+enum class HitMode : uint8_t
+{
+	Surfaces,
+	TwoSidedSurfaces,
+	Points,
+	OverlayPoints,
+	Lines,
+	OverlayLines,
+
+	Count
+};
+
+// A primitive drawn under UnrealEd's hit stack: view space like ColorVertex, with the HitRecorder ID instead of a color.
+struct HitVertex
+{
+	float position[3];
+	uint32_t id;
+};
+
+// Consecutive hit vertices with the same mode and scene node.
+struct HitDraw
+{
+	HitMode mode;
+	// The scene node's uniforms, see SceneUniforms.
+	vk::DescriptorSet sceneSet;
+	uint32_t sceneOffset;
+	vk::Rect2D viewport; // Of the scene node, in swapchain pixels.
+	bool clearDepth; // ClearZ() was called before the draw.
+	uint32_t firstVertex;
+	uint32_t vertexCount;
+};
+
+// Everything drawn under the hit stack during a hit-testing frame, rendered into the hit target in Unlock(); see RecordHitPass().
+struct HitBatch
+{
+	std::vector<HitVertex> vertices;
+	std::vector<HitDraw> draws;
+	bool clearDepth = false;
+};
+
+// Untextured triangles drawn with one fixed state, such as Rune's fog surfaces.
+struct ColorBatch
+{
+	PipelineState state;
+	std::vector<vertex_packing::ColorVertex> vertices;
+	std::vector<uint16_t> indices;
+};
+
+struct DrawStatistics
+{
+	uint32_t gouraudPolygons = 0;
+	uint32_t gouraudDraws = 0;
+	uint32_t worldDraws = 0;
+	// Draw calls of the world queue: one per bucket with multi-draw-indirect, one per surface without.
+	uint32_t worldSubmissions = 0;
+	uint32_t depthPrePassDraws = 0; // World surfaces drawn depth-only before shading.
+	uint32_t tiles = 0;
+	uint32_t tileDraws = 0;
+	uint32_t lines = 0;
+	uint32_t points = 0;
+	// Scene nodes that changed the projection or viewport, each one record in the scene uniform ring.
+	uint32_t sceneNodes = 0;
+	uint32_t textureUploads = 0;
+	// Textures flagged as changed whose data was the same as the uploaded revision.
+	uint32_t unchangedTextureUploads = 0;
+};
+
+// PF_NoSmooth x clamp; see UVulkan1RenderDevice::GetTextureSamplerIndex().
+constexpr size_t TextureSamplerCount = 4;
+
+/**
+Everything that does not depend on a window. UnrealEd opens several viewports, each of them a render device of its own; they share
+one device, so textures are cached and uploaded once however many viewports show them.
+The first UVulkan1RenderDevice::Init() creates the context and the last Exit() destroys it. Viewports keep their surface, swapchain,
+render targets, frames and pipelines, which depend on the surface format.
+*/
+class UVulkan1RenderDevice;
+
+struct SharedContext : boost::noncopyable
+{
+	vk::Instance instance;
+	// Present when VK_EXT_debug_utils is enabled, see InitVulkanInstance(). The callback gets the filter as user data.
+	vk::DebugUtilsMessengerEXT debugMessenger;
+	std::optional<DebugMessageFilter> debugMessageFilter;
+	// Object names and command buffer labels, for graphics debuggers and profilers.
+	bool debugLabels = false;
+	vk::PhysicalDevice physicalDevice;
+	vk::Device logicalDevice;
+
+	// Picked for the first viewport's surface; the others must be able to present with the same family.
+	size_t presentationQueueFamilyIndex = 0;
+	size_t renderingQueueFamilyIndex = 0;
+	vk::Queue renderingQueue;
+	vk::Queue presentationQueue;
+
+	bool supportsExtendedDynamicState = false;
+	bool supportsTextureCompressionBC = false;
+	bool supportsPresentWait = false;
+	bool supportsSamplerAnisotropy = false;
+	bool supportsMultiDrawIndirect = false;
+	uint32_t maxDrawIndirectCount = 1;
+	// shaderSampledImageArrayDynamicIndexing; without it, world surfaces with different layer textures are not queued together.
+	bool supportsLayerIndexing = false;
+
+	std::optional<DeviceMemoryAllocator> memoryAllocator;
+	// Pipelines differ per viewport only when surface formats do; the cache makes creating them again cheap.
+	vk::PipelineCache pipelineCache;
+	// Resources that in-flight frames of any viewport may still use. All viewports submit to the same queue.
+	DeletionQueue deletionQueue;
+	// Viewports with recorded commands that are not submitted yet: the one being drawn and those with uploads recorded outside of a frame.
+	// Each of them submits once before anything it recorded can be waited on, see UVulkan1RenderDevice::Retire().
+	std::vector<UVulkan1RenderDevice*> recordingViewports;
+
+	std::unordered_map<QWORD, CachedTexture> textureCache;
+	// Converted texel data from previous runs, see UploadTexture().
+	std::optional<TextureDiskCache> textureDiskCache;
+	std::vector<uint8_t> textureConversionBuffer;
+	// Converts the textures of PrecacheTexture() while the game keeps loading; joined in FinishPrecache().
+	std::optional<ThreadPool> precachePool;
+	std::vector<std::unique_ptr<PrecachedTexture>> precachedTextures;
+	std::unordered_set<QWORD> precachedTextureIds;
+	std::chrono::steady_clock::time_point precacheStartTime;
+	// Texture descriptor sets live as long as the cache entries; a new pool is added whenever the last one is full.
+	std::vector<vk::DescriptorPool> textureDescriptorPools;
+
+	std::optional<SamplerCache> samplerCache;
+
+	// Set 0: texture image, set 1: its sampler, set 2: the layer textures of the queued world surfaces with immutable samplers.
+	vk::DescriptorSetLayout textureSetLayout;
+	vk::DescriptorSetLayout samplerSetLayout;
+	vk::DescriptorSetLayout surfaceSetLayout;
+	// Size of the layer texture array in set 2.
+	uint32_t worldLayerCount = 4;
+	// Set 4: SceneUniforms, a dynamic uniform buffer.
+	vk::DescriptorSetLayout sceneSetLayout;
+
+	// Fills the unused elements of the layer texture array, which still need a valid image.
+	std::optional<Texture> whiteTexture;
+
+	// Palettes of palette-indexed textures, bound as set 3 of every scene pipeline. Absent unless paletteIndexedTextures is set.
+	std::optional<PaletteTable> paletteTable;
+	vk::DescriptorSet paletteDescriptorSet;
+
+	// One sampler set per per-draw sampler state, written once; draws only pick the set.
+	vk::DescriptorPool samplerDescriptorPool;
+	std::array<vk::DescriptorSet, TextureSamplerCount> samplerDescriptorSets;
+
+	SharedContext() = default;
+
+	~SharedContext()
+	{
+		// Runs the remaining conversions; they still write into the pending textures.
+		precachePool.reset();
+		precachedTextures.clear();
+		precachedTextureIds.clear();
+
+		if (logicalDevice)
+		{
+			logicalDevice.waitIdle();
+			deletionQueue.Flush();
+
+			textureCache.clear();
+			whiteTexture.reset();
+			paletteTable.reset();
+			for (const auto pool : textureDescriptorPools)
+				logicalDevice.destroyDescriptorPool(pool);
+			logicalDevice.destroyDescriptorPool(samplerDescriptorPool);
+			logicalDevice.destroyDescriptorSetLayout(textureSetLayout);
+			logicalDevice.destroyDescriptorSetLayout(samplerSetLayout);
+			logicalDevice.destroyDescriptorSetLayout(surfaceSetLayout);
+			logicalDevice.destroyDescriptorSetLayout(sceneSetLayout);
+			samplerCache.reset();
+			logicalDevice.destroyPipelineCache(pipelineCache);
+			memoryAllocator.reset();
+			logicalDevice.destroy();
+		}
+		textureDiskCache.reset();
+
+		if (instance)
+		{
+			if (debugMessenger)
+				instance.destroyDebugUtilsMessengerEXT(debugMessenger);
+			instance.destroy();
+		}
+	}
+
+	// The context of the viewports that are open, if any.
+	static std::weak_ptr<SharedContext>& GetCurrent()
+	{
+		static std::weak_ptr<SharedContext> current;
+		return current;
+	}
 };
 
 class UVulkan1RenderDevice final
@@ -37,6 +473,32 @@ class UVulkan1RenderDevice final
 	, private boost::noncopyable
 {
 private:
+	static constexpr size_t MaxFramesInFlight = 2;
+	static constexpr vk::DeviceSize TransientBufferSize = 4 * 1024 * 1024;
+	static constexpr vk::DeviceSize ReservedImageMemorySize = 64 * 1024 * 1024;
+	static constexpr uint32_t TextureDescriptorPoolSize = 1024;
+	// Batches use 16-bit indices.
+	static constexpr size_t MaxBatchVertexCount = 65536;
+	static constexpr float ZNear = 1.0f;
+	static constexpr float ZFar = 32760.0f;
+	// Beyond this view depth detail textures are faded out completely, see world.frag.
+	static constexpr float DetailDistance = 380.0f;
+	static constexpr uint32_t FrameDescriptorPoolSize = 256;
+	// Layer textures a flush of the world queue holds at most. Lightmaps and fogmaps are unique per surface, so this is roughly its surface count.
+	static constexpr uint32_t MaxWorldLayerCount = 256;
+	static_assert(MaxWorldLayerCount <= FrameDescriptorPoolSize * 16, "A world layer set must fit into a frame descriptor pool");
+	// Scene nodes per block of the scene uniform ring. A game frame has a handful; UnrealEd sets one per brush view.
+	static constexpr uint32_t SceneUniformBlockSize = 64;
+	static constexpr uint64_t MaxTextureDiskCacheSize = 1024ull * 1024 * 1024;
+	// Size limit of the hit target. The editor tests a few pixels around the cursor; larger regions are cut around their center.
+	static constexpr uint32_t MaxHitExtent = 32;
+	// Characters GetStats() writes at most, terminator included; well within the stats buffers of the games.
+	static constexpr INT StatsLength = 128;
+	// Smoothing of the GPU time comparison with and without the depth pre-pass.
+	static constexpr float DepthPrePassCostWeight = 0.05f;
+	// Each validation message ID is logged this many times per second at most; see DebugMessageFilter.
+	static constexpr uint32_t MaxDebugMessagesPerId = 5;
+
 	RendererSettings settings_;
 
 	vk::Instance instance_;
@@ -57,17 +519,138 @@ private:
 	std::vector<SwapChainImage> swapChainImages_;
 	vk::Format presentationSurfaceFormat_;
 	vk::Extent2D presentationSurfaceExtent_;
+	// Acquire or present reported that the swapchain no longer matches the surface; it is recreated after the frame is presented.
+	bool isSwapChainSuboptimal_ = false;
+
+	// Owned by context_.
+	DeviceMemoryAllocator* memoryAllocator_ = nullptr;
+
+	// The scene is rendered into the top-left renderExtent_ of an offscreen target and upscaled to the swapchain in a composite pass.
+	// The target is allocated at the maximum scale, so scale changes never reallocate it.
+	DynamicResolutionController dynamicResolution_;
+	vk::Extent2D renderTargetExtent_;
+	vk::Extent2D renderExtent_;
+	vk::Image renderTargetImage_;
+	vk::ImageView renderTargetImageView_;
+	MemoryAllocation renderTargetImageMemory_;
+	vk::Framebuffer sceneFramebuffer_;
+
+	vk::Format depthFormat_;
+	vk::Image depthImage_;
+	vk::ImageView depthImageView_;
+	MemoryAllocation depthImageMemory_;
+
+	// Two timestamps per frame in flight around the scene pass; absent when the queue has no timestamp support.
+	vk::QueryPool timestampQueryPool_;
+	uint32_t timestampValidBits_ = 0;
+	float timestampPeriod_ = 0.0f;
+	float gpuFrameTime_ = 0.0f;
+	// Averaged GPU milliseconds per rendered megapixel of frames without and with the depth pre-pass; 0 until measured.
+	std::array<float, 2> depthPrePassCost_{};
+
+	FrameLimiter frameLimiter_;
+	bool supportsPresentWait_ = false;
+	// Copy of SharedContext::debugLabels; without it, labels and names cost a branch and nothing is formatted.
+	bool debugLabels_ = false;
+	uint64_t presentCount_ = 0;
+	// Averaged time from Lock() to the frame being presented (with VK_KHR_present_wait) or finished by the GPU (without it).
+	float latency_ = 0.0f;
 
 
 	vk::CommandPool presentationCommandPool_;
 	vk::CommandPool renderingCommandPool_;
 
-	vk::DebugReportCallbackEXT debugCallbackHandle_;
-
 	vk::RenderPass renderPass_;
-	std::optional<Pipeline> pipeline_;
+	vk::RenderPass compositeRenderPass_;
+
+	// Keyed by SceneProgram and PipelineState::GetKey(). With extended dynamic state, this is one pipeline per program and blend mode.
+	std::unordered_map<uint32_t, Pipeline> pipelines_;
+	bool supportsExtendedDynamicState_ = false;
+	bool supportsTextureCompressionBC_ = false;
+
+	bool supportsSamplerAnisotropy_ = false;
+	// multiDrawIndirect and drawIndirectFirstInstance; without them the world queue loops over vkCmdDrawIndexed.
+	bool supportsMultiDrawIndirect_ = false;
+	uint32_t maxDrawIndirectCount_ = 1;
+
+	// Device, caches and the textures, shared with the other viewports. The handles above are copies of its handles.
+	std::shared_ptr<SharedContext> context_;
+
+	bool isPaletteSetBound_ = false;
+
+	// Samples the offscreen target in the composite pass; the set is allocated per frame.
+	vk::DescriptorSetLayout compositeSetLayout_;
+	std::optional<Pipeline> upscalePipeline_;
+
+	// UnrealEd hit testing, see PushHit(). The target and its pipelines are created by the first hit-testing frame, so games never have them.
+	HitRecorder hitRecorder_;
+	HitBatch hitBatch_;
+	BYTE* hitData_ = nullptr;
+	INT* hitSize_ = nullptr;
+	vk::Rect2D hitRegion_; // In swapchain pixels.
+	TransientAllocation hitReadback_{};
+	vk::RenderPass hitRenderPass_;
+	vk::Image hitImage_;
+	vk::ImageView hitImageView_;
+	MemoryAllocation hitImageMemory_;
+	vk::Image hitDepthImage_;
+	vk::ImageView hitDepthImageView_;
+	MemoryAllocation hitDepthImageMemory_;
+	vk::Framebuffer hitFramebuffer_;
+	std::vector<Pipeline> hitPipelines_; // By HitMode.
+
+	std::array<FrameContext, MaxFramesInFlight> frames_;
+	size_t currentFrameIndex_ = 0;
+	uint32_t currentImageIndex_ = 0;
+	bool isLocked_ = false;
+
+	vk::Pipeline boundPipeline_;
+	std::optional<PipelineState> boundRasterState_;
+
+	// Screen flash of the frame, see Lock(). Applied in the composite pass.
+	FPlane flashScale_;
+	FPlane flashFog_;
+
+	// The current scene node, see SetScene(). Its uniforms are at sceneUniformOffset_ in the ring block of sceneUniformSet_.
+	SceneUniforms sceneUniforms_{};
+	std::optional<FLOAT> sceneFovAngle_; // Nothing until the game sets a scene node in this frame.
+	vk::DescriptorSet sceneUniformSet_;
+	uint32_t sceneUniformOffset_ = 0;
+	TransientAllocation sceneUniformBlock_{};
+	uint32_t sceneUniformBlockUsedCount_ = SceneUniformBlockSize;
+	// Size of a SceneUniforms record rounded up to minUniformBufferOffsetAlignment, which is the alignment of blocks.
+	vk::DeviceSize sceneUniformStride_ = 0;
+	vk::DeviceSize sceneUniformAlignment_ = 0;
+	vk::DescriptorSet boundSceneUniformSet_;
+	uint32_t boundSceneUniformOffset_ = 0;
+	vk::Rect2D sceneViewport_; // In swapchain pixels, see SetViewport().
+	GouraudBatch gouraudBatch_;
+	TileBatch tileBatch_;
+	WorldQueue worldQueue_;
+	ColorBatch fogSurfaceBatch_;
+	LineBatch lineBatch_;
+	DistanceFog distanceFog_{};
+	DrawStatistics drawStatistics_;
+	DrawStatistics lastFrameDrawStatistics_;
 
 public:
+	/**@name Config properties, bound in StaticConstructor() and copied to settings_ in Init().*/
+	//@{
+	FString PreferredDevice;
+	FLOAT TargetFrameTime;
+	FLOAT MinResolutionScale;
+	FLOAT MaxResolutionScale;
+	UBOOL SharpenUpscale;
+	FLOAT UpscaleSharpness;
+	UBOOL LowLatency;
+	FLOAT FrameRateLimit;
+	UBOOL DiskTextureCache;
+	UBOOL PaletteIndexedTextures;
+	UBOOL PaletteBilinearFilter;
+	UBOOL DepthPrePass;
+	UBOOL DebugLabels;
+	INT DebugMessageSeverity;
+	//@}
 
 	/**
 	Constructor called by the game when the renderer is first created.
@@ -78,6 +661,37 @@ public:
 	void StaticConstructor()
 	{
 		settings_.presentationMode = PresentationMode::Immediate;
+		settings_.anisotropy = 16;
+		settings_.lodBias = 0.0f;
+
+		TargetFrameTime = 0.0f;
+		MinResolutionScale = 0.5f;
+		MaxResolutionScale = 1.0f;
+		SharpenUpscale = 0;
+		UpscaleSharpness = 0.5f;
+		LowLatency = 0;
+		FrameRateLimit = 0.0f;
+		DiskTextureCache = 1;
+		PaletteIndexedTextures = 0;
+		PaletteBilinearFilter = 1;
+		DepthPrePass = 0;
+		DebugLabels = 0;
+		DebugMessageSeverity = INT(DebugMessageFilter::Severity::Warning);
+
+		new(GetClass(), TEXT("PreferredDevice"), RF_Public) UStrProperty(CPP_PROPERTY(PreferredDevice), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("TargetFrameTime"), RF_Public) UFloatProperty(CPP_PROPERTY(TargetFrameTime), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("MinResolutionScale"), RF_Public) UFloatProperty(CPP_PROPERTY(MinResolutionScale), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("MaxResolutionScale"), RF_Public) UFloatProperty(CPP_PROPERTY(MaxResolutionScale), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("SharpenUpscale"), RF_Public) UBoolProperty(CPP_PROPERTY(SharpenUpscale), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("UpscaleSharpness"), RF_Public) UFloatProperty(CPP_PROPERTY(UpscaleSharpness), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("LowLatency"), RF_Public) UBoolProperty(CPP_PROPERTY(LowLatency), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("FrameRateLimit"), RF_Public) UFloatProperty(CPP_PROPERTY(FrameRateLimit), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("DiskTextureCache"), RF_Public) UBoolProperty(CPP_PROPERTY(DiskTextureCache), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("PaletteIndexedTextures"), RF_Public) UBoolProperty(CPP_PROPERTY(PaletteIndexedTextures), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("PaletteBilinearFilter"), RF_Public) UBoolProperty(CPP_PROPERTY(PaletteBilinearFilter), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("DepthPrePass"), RF_Public) UBoolProperty(CPP_PROPERTY(DepthPrePass), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("DebugLabels"), RF_Public) UBoolProperty(CPP_PROPERTY(DebugLabels), TEXT("Options"), CPF_Config);
+		new(GetClass(), TEXT("DebugMessageSeverity"), RF_Public) UIntProperty(CPP_PROPERTY(DebugMessageSeverity), TEXT("Options"), CPF_Config);
 	}
 
 	UVulkan1RenderDevice()
@@ -148,12 +762,38 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 			//Do some nice compatibility fixing: set processor affinity to single-cpu
 			//SetProcessAffinityMask(GetCurrentProcess(), 0x1);
 
-			InitVulkanInstance();
-
-			InitLogicalDevice(InViewport);
+			settings_.preferredDevice = *PreferredDevice;
+			settings_.targetFrameTime = TargetFrameTime;
+			settings_.minResolutionScale = MinResolutionScale;
+			settings_.maxResolutionScale = MaxResolutionScale;
+			settings_.upscaleFilter = SharpenUpscale ? UpscaleFilter::Sharpen : UpscaleFilter::Bilinear;
+			settings_.sharpness = std::clamp(UpscaleSharpness, 0.0f, 1.0f);
+			dynamicResolution_.Configure(settings_.targetFrameTime, settings_.minResolutionScale, settings_.maxResolutionScale);
+			settings_.lowLatency = LowLatency;
+			settings_.frameRateLimit = std::max(0.0f, FrameRateLimit);
+			frameLimiter_.SetFrameRate(settings_.frameRateLimit);
+			settings_.diskTextureCache = DiskTextureCache;
+			settings_.paletteIndexedTextures = PaletteIndexedTextures;
+			settings_.paletteBilinearFilter = PaletteBilinearFilter;
+			settings_.depthPrePass = DepthPrePass;
+			settings_.debugLabels = DebugLabels;
+			settings_.debugMessageSeverity = uint32_t(std::clamp(DebugMessageSeverity, 0, INT(DebugMessageFilter::Severity::Error)));
+
+			const bool isNewContext = InitSharedContext(InViewport);
+
+			InitFrames();
+			InitTimestampQueries();
+			if (isNewContext)
+			{
+				InitSamplers();
+				InitWhiteTexture();
+				InitPaletteTable();
+				InitTextureDiskCache();
 
-			//renderingCommandPool_ = logicalDevice_.createCommandPool(vk::CommandPoolCreateInfo().setQueueFamilyIndex(renderingQueueFamilyIndex_));
-			//presentationCommandPool_ = logicalDevice_.createCommandPool(vk::CommandPoolCreateInfo().setQueueFamilyIndex(presentationQueueFamilyIndex_));
+				// The game thread helps at the join, so one worker less than there are cores.
+				context_->precachePool.emplace(std::max(2u, std::thread::hardware_concurrency()) - 1);
+			}
+			InitCompositeDescriptors();
 
 			return SetRes(NewX, NewY, NewColorBytes, Fullscreen);
 		}
@@ -179,12 +819,20 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 
 		try
 		{
-			InitSwapChain();
+			InitSwapChain(vk::Extent2D(NewX, NewY));
 
 			// Because we need surface format first.
-			InitRenderPass();
-			
-			InitPipeline();
+			// Neither depends on the extent, so they survive resolution changes.
+			if (!renderPass_)
+			{
+				InitRenderPasses();
+				InitPipelines();
+			}
+
+			InitRenderTarget();
+			InitDepthBuffer();
+			InitSceneFramebuffer();
+			InitFramebuffers();
 
 			return true;
 		}
@@ -197,39 +845,90 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 
 	/**
 	Cleanup.
+	\note Only destroys what belongs to this viewport. The shared context goes with the last viewport, see SharedContext.
+	\note The only place that waits for the device to go idle; everything retired until now is destroyed here at the latest.
 	*/
 	void Exit() override
 	{
-		for (auto& swapChainImage : swapChainImages_)
+		// Other viewports may use the textures they fill.
+		SubmitUploads();
+		logicalDevice_.waitIdle();
+		SetRecording(false);
+
+		DebugPrint(FormatMemoryStatistics());
+		DebugPrint(FormatDebugMessageStatistics());
+
+		RetireSwapChainImages();
+		context_->deletionQueue.Flush();
+
+		gouraudBatch_ = {};
+		tileBatch_ = {};
+		worldQueue_ = {};
+		fogSurfaceBatch_ = {};
+		lineBatch_ = {};
+		hitBatch_ = {};
+		DestroyHitTarget();
+
+		for (auto& frame : frames_)
 		{
-			logicalDevice_.destroyImageView(swapChainImage.view);
+			logicalDevice_.destroyFence(frame.fence);
+			logicalDevice_.destroySemaphore(frame.imageAvailableSemaphore);
+			logicalDevice_.destroySemaphore(frame.renderFinishedSemaphore);
+			frame.transientBuffers.reset();
+			for (const auto pool : frame.descriptorPools)
+				logicalDevice_.destroyDescriptorPool(pool);
+			frame.descriptorPools.clear();
 		}
+		logicalDevice_.destroyCommandPool(renderingCommandPool_);
 
-		pipeline_.reset();
+		pipelines_.clear();
+		upscalePipeline_.reset();
+		logicalDevice_.destroyDescriptorSetLayout(compositeSetLayout_);
+		logicalDevice_.destroyQueryPool(timestampQueryPool_);
 		logicalDevice_.destroyRenderPass(renderPass_);
+		logicalDevice_.destroyRenderPass(compositeRenderPass_);
 		logicalDevice_.destroySwapchainKHR(swapChain_);
-		logicalDevice_.destroy();
-		instance_.destroyDebugReportCallbackEXT(debugCallbackHandle_);
-		instance_.destroy();
+		instance_.destroySurfaceKHR(presentationSurface_);
+
+		memoryAllocator_ = nullptr;
+		context_.reset();
 	}
 
 	/**
 	Empty texture cache.
 	\param AllowPrecache Enabled if the game allows us to precache; respond by setting URenderDevice::PrecacheOnFlip = 1 if wanted. This does make load times longer.
+	\note The game reuses cache IDs for other textures and lightmaps after a level change, so every entry goes; nothing else evicts them.
 	*/
 #if UNREALGOLD || UNREAL
 	void Flush();
 #else
 	void Flush(UBOOL AllowPrecache) override
 	{
+		// Batches still refer to cached textures.
+		FlushBatches();
+
+		// Conversions still running were asked for under the old IDs too.
+		if (!context_->precachedTextures.empty())
 		{
-			return;
-			//If caching is allowed, tell the game to make caching calls (PrecacheTexture() function)
+			context_->precachePool->Wait();
+			context_->precachedTextures.clear();
+			context_->precachedTextureIds.clear();
+		}
+
+		RetireTextureCache();
+		// Queued after the textures, so it runs once their memory is free: the blocks the old level needed go back to the driver.
+		Retire([allocator = memoryAllocator_] { allocator->Trim(); });
+
+		// Level changes are when textures have just been stored; make sure they survive a crash.
+		if (context_->textureDiskCache)
+			context_->textureDiskCache->Flush();
+
+		//If caching is allowed, tell the game to make caching calls (PrecacheTexture() function)
+		//Conversion runs on the shared precache pool, so this costs the game thread little.
 #if (!UNREALGOLD)
-			if (AllowPrecache)
-				PrecacheOnFlip = 1;
+		if (AllowPrecache)
+			PrecacheOnFlip = 1;
 #endif
-		}
 	}
 #endif
 
@@ -239,8 +938,8 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	\param FlashFog To do with flash effects, see notes.
 	\param ScreenClear The color with which to clear the screen. Used for Rune fog.
 	\param RenderLockFlags Signify whether the screen should be cleared. Depth buffer should always be cleared.
-	\param InHitData Something to do with clipping planes; safe to ignore.
-	\param InHitSize Something to do with clipping planes; safe to ignore.
+	\param HitData For UnrealEd's hit testing: receives the hit stack of what is under the cursor, see PushHit(). nullptr when not hit testing.
+	\param HitSize Capacity of HitData; receives the size of the hit, 0 for none.
 	
 	\note 'Flash' effects are fullscreen colorization, for example when the player is underwater (blue) or being hit (red).
 	Depending on the values of the related parameters (see source code) this should be drawn; the games don't always send a blank flash when none should be drawn.
@@ -249,6 +948,87 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	void Lock(FPlane FlashScale, FPlane FlashFog, FPlane ScreenClear, DWORD RenderLockFlags, BYTE* HitData, INT* HitSize) override
 	{
+		flashScale_ = FlashScale;
+		flashFog_ = FlashFog;
+
+		frameLimiter_.Wait();
+
+		// This frame may draw textures that other viewports uploaded outside of their frames.
+		for (auto* viewport : std::vector<UVulkan1RenderDevice*>(context_->recordingViewports))
+		{
+			if (viewport != this)
+				viewport->SubmitUploads();
+		}
+
+		// Starting only once the previous frame is done means no frame is ever queued behind another, and the game has sampled
+		// input as late as possible.
+		if (settings_.lowLatency)
+			WaitForPreviousFrame();
+
+		// Textures precached since the last frame are uploaded with this one.
+		FinishPrecache();
+
+		auto& frame = PrepareFrame();
+		frame.lockTime = std::chrono::steady_clock::now();
+
+		if (!AcquireSwapChainImage(frame))
+		{
+			// Nothing is drawn while the window is minimized; every draw and Unlock() check isLocked_.
+			if (HitSize)
+				*HitSize = 0;
+			return;
+		}
+
+		// Reset only after a successful acquire, otherwise the next wait on this fence never returns.
+		logicalDevice_.resetFences(frame.fence);
+
+		frame.commandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+		SetRecording(true);
+
+		if (timestampQueryPool_)
+		{
+			const auto firstQuery = uint32_t(currentFrameIndex_ * 2);
+			frame.commandBuffer.resetQueryPool(timestampQueryPool_, firstQuery, 2);
+			frame.commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestampQueryPool_, firstQuery);
+		}
+
+		renderExtent_ = GetRenderExtent();
+		frame.renderExtent = renderExtent_;
+		frame.depthPrePass = settings_.depthPrePass;
+
+		const auto clearValues = utils::make_array<vk::ClearValue>(
+			vk::ClearColorValue(std::array<float, 4>{ScreenClear.X, ScreenClear.Y, ScreenClear.Z, ScreenClear.W}),
+			vk::ClearDepthStencilValue(1.0f, 0));
+
+		frame.commandBuffer.beginRenderPass(
+			vk::RenderPassBeginInfo()
+			.setRenderPass(renderPass_)
+			.setFramebuffer(sceneFramebuffer_)
+			.setRenderArea(vk::Rect2D({0, 0}, renderExtent_))
+			.setClearValueCount(uint32_t(clearValues.size()))
+			.setPClearValues(clearValues.data()),
+			vk::SubpassContents::eInline);
+		BeginLabel(frame.commandBuffer, "Scene");
+
+		boundPipeline_ = nullptr;
+		boundRasterState_.reset();
+		isPaletteSetBound_ = false;
+		boundSceneUniformSet_ = nullptr;
+		drawStatistics_ = {};
+		isLocked_ = true;
+
+		hitData_ = HitData;
+		hitSize_ = HitSize;
+		hitRecorder_.Reset();
+		if (IsHitTesting())
+			BeginHitTesting();
+
+		// Viewport and scissor are dynamic; cover the whole surface until the game sets a scene node. The previous frame's uniforms
+		// stay in use until then, in a block of this frame's ring.
+		SetViewport(0, 0, presentationSurfaceExtent_.width, presentationSurfaceExtent_.height);
+		sceneFovAngle_.reset();
+		sceneUniformBlockUsedCount_ = SceneUniformBlockSize;
+		WriteSceneUniforms();
 	}
 
 	/**
@@ -257,6 +1037,149 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	void Unlock(UBOOL Blit) override
 	{
+		if (!isLocked_)
+			return;
+
+		auto& frame = frames_[currentFrameIndex_];
+
+		FlushBatches();
+		lastFrameDrawStatistics_ = drawStatistics_;
+
+		EndLabel(frame.commandBuffer);
+		frame.commandBuffer.endRenderPass();
+
+		if (timestampQueryPool_)
+		{
+			frame.commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestampQueryPool_, uint32_t(currentFrameIndex_ * 2 + 1));
+			frame.hasTimestamps = true;
+		}
+
+		if (IsHitTesting())
+			RecordHitPass(frame.commandBuffer);
+
+		RecordComposite(frame.commandBuffer);
+
+		frame.commandBuffer.end();
+
+		// Uploads recorded during the frame (or before Lock()) run ahead of the draws that sample them.
+		std::vector<vk::CommandBuffer> commandBuffers;
+		if (frame.hasUploads)
+		{
+			EndLabel(frame.uploadCommandBuffer);
+			frame.uploadCommandBuffer.end();
+			commandBuffers.push_back(frame.uploadCommandBuffer);
+		}
+		commandBuffers.push_back(frame.commandBuffer);
+
+		frame.serial = context_->deletionQueue.Submit();
+
+		const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		renderingQueue_.submit(
+			vk::SubmitInfo()
+			.setWaitSemaphoreCount(1)
+			.setPWaitSemaphores(&frame.imageAvailableSemaphore)
+			.setPWaitDstStageMask(&waitStage)
+			.setCommandBufferCount(uint32_t(commandBuffers.size()))
+			.setPCommandBuffers(commandBuffers.data())
+			.setSignalSemaphoreCount(1)
+			.setPSignalSemaphores(&frame.renderFinishedSemaphore),
+			frame.fence);
+		SetRecording(false);
+
+		auto presentInfo = vk::PresentInfoKHR()
+		                   .setWaitSemaphoreCount(1)
+		                   .setPWaitSemaphores(&frame.renderFinishedSemaphore)
+		                   .setSwapchainCount(1)
+		                   .setPSwapchains(&swapChain_)
+		                   .setPImageIndices(&currentImageIndex_);
+
+		frame.presentId = 0;
+#ifdef VK_KHR_present_wait
+		const auto presentId = presentCount_ + 1;
+		auto presentIdInfo = vk::PresentIdKHR().setSwapchainCount(1).setPPresentIds(&presentId);
+		if (supportsPresentWait_)
+			presentInfo.setPNext(&presentIdInfo);
+#endif
+
+		// The image is presented even without Blit because an acquired image can only be given back by presenting it.
+		try
+		{
+			if (presentationQueue_.presentKHR(presentInfo) == vk::Result::eSuboptimalKHR)
+				isSwapChainSuboptimal_ = true;
+#ifdef VK_KHR_present_wait
+			if (supportsPresentWait_)
+				frame.presentId = ++presentCount_;
+#endif
+		}
+		catch (const vk::OutOfDateKHRError&)
+		{
+			// The game calls SetRes() when it resizes the window, but not when the surface changes otherwise.
+			isSwapChainSuboptimal_ = true;
+		}
+
+		frame.isLatencyPending = true;
+
+		if (IsHitTesting())
+			ResolveHit(frame);
+
+		frame.isPrepared = false;
+		frame.hasUploads = false;
+		isLocked_ = false;
+		currentFrameIndex_ = (currentFrameIndex_ + 1) % MaxFramesInFlight;
+
+		if (isSwapChainSuboptimal_)
+			(void)RecreateSwapChain();
+	}
+
+	/**
+	Acquires the next swapchain image for the frame. A swapchain that is out of date is recreated and the acquire retried once.
+	\return Whether an image was acquired; not while the window is minimized.
+	\note A suboptimal swapchain is still presented to; it is recreated afterwards, see Unlock().
+	*/
+	[[nodiscard]] bool AcquireSwapChainImage(const FrameContext& frame)
+	{
+		for (int attempt = 0; attempt < 2; ++attempt)
+		{
+			try
+			{
+				const auto result = logicalDevice_.acquireNextImageKHR(
+					swapChain_,
+					std::numeric_limits<uint64_t>::max(),
+					frame.imageAvailableSemaphore,
+					nullptr);
+
+				currentImageIndex_ = result.value;
+				if (result.result == vk::Result::eSuboptimalKHR)
+					isSwapChainSuboptimal_ = true;
+				return true;
+			}
+			catch (const vk::OutOfDateKHRError&)
+			{
+				if (!RecreateSwapChain())
+					return false;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	Rebuilds the swapchain and what depends on its extent for the surface as it is now, e.g. after alt-tab or a move to another monitor.
+	\return false while the surface has no area, i.e. the window is minimized; the old swapchain is kept.
+	*/
+	bool RecreateSwapChain()
+	{
+		const auto currentExtent = physicalDevice_.getSurfaceCapabilitiesKHR(presentationSurface_).currentExtent;
+		if (currentExtent.width == 0 || currentExtent.height == 0)
+			return false;
+
+		InitSwapChain(presentationSurfaceExtent_);
+		InitRenderTarget();
+		InitDepthBuffer();
+		InitSceneFramebuffer();
+		InitFramebuffers();
+
+		return true;
 	}
 
 
@@ -276,9 +1199,152 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	
 	\note DetailTexture and FogMap are mutually exclusive.
 	\note Check if submitted polygons are valid (3 or more points).
+	\note All layers are combined by world.frag in a single draw per facet instead of one blended pass per layer.
 	*/
 	void DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) override
 	{
+		if (!isLocked_ || Surface.Texture == nullptr)
+			return;
+
+		FlushGouraudBatch();
+		FlushTileBatch();
+		FlushColorBatch(fogSurfaceBatch_);
+		FlushLineBatch();
+
+		const auto* diffuse = CacheTexture(*Surface.Texture, Surface.PolyFlags);
+		if (diffuse == nullptr)
+			return;
+
+		// Surface coordinates in texels along the map axes; every layer pans and scales them in world.vert.
+		const auto& coords = Facet.MapCoords;
+		const auto uDot = coords.XAxis | coords.Origin;
+		const auto vDot = coords.YAxis | coords.Origin;
+
+		// Detail textures only show up close, so the facet's nearest point decides whether it gets one.
+		auto minDepth = std::numeric_limits<float>::max();
+		for (FSavedPoly* Poly = Facet.Polys; Poly; Poly = Poly->Next)
+		{
+			if (Poly->NumPts < 3 || size_t(Poly->NumPts) > MaxBatchVertexCount)
+				continue;
+
+			for (int i = 0; i < Poly->NumPts; ++i)
+				minDepth = std::min(minDepth, Poly->Pts[i]->Point.Z);
+		}
+
+		if (minDepth == std::numeric_limits<float>::max())
+			return;
+
+		auto drawParameters = GetDrawParameters(Surface.PolyFlags);
+		SetPaletteLayer(drawParameters, *diffuse, 0);
+		SurfaceParameters surfaceParameters{};
+		SetSurfaceLayer(surfaceParameters, 0, *Surface.Texture, 0.0f);
+
+		// Layers 1 to 4; absent ones stay null.
+		std::array<vk::ImageView, 4> layerViews{};
+
+		const auto addLayer = [&](FTextureInfo* info, uint32_t layer, uint32_t flag, uint32_t rgba7Flag, float panOffset)
+		{
+			if (info == nullptr)
+				return;
+
+			const auto* texture = CacheTexture(*info, 0);
+			if (texture == nullptr)
+				return;
+
+			layerViews[layer - 1] = texture->texture.GetView();
+			SetSurfaceLayer(surfaceParameters, layer, *info, panOffset);
+			SetPaletteLayer(drawParameters, *texture, layer);
+			drawParameters.flags |= flag;
+			if (info->Format == TEXF_RGBA7)
+				drawParameters.flags |= rgba7Flag;
+		};
+
+		// Lightmaps and fogmaps are drawn with a -.5 pan offset. Detail textures never show up together with fog.
+		addLayer(Surface.LightMap, 1, DrawFlagLightmap, DrawFlagLightmapRGBA7, -0.5f);
+		addLayer(Surface.FogMap, 2, DrawFlagFogmap, DrawFlagFogmapRGBA7, -0.5f);
+		if (Surface.FogMap == nullptr && minDepth < DetailDistance)
+			addLayer(Surface.DetailTexture, 3, DrawFlagDetail, 0, 0.0f);
+		addLayer(Surface.MacroTexture, 4, DrawFlagMacro, 0, 0.0f);
+
+		surfaceParameters.flags = drawParameters.flags;
+		surfaceParameters.paletteRows = drawParameters.paletteRows;
+		// May flush the queue, so nothing of this surface is queued before.
+		AddWorldLayers(layerViews, surfaceParameters);
+
+		// Alpha-tested surfaces are left out of the depth pre-pass; they write their depth when shaded, as without it.
+		const auto shadeState = PipelineState::FromPolyFlags(Surface.PolyFlags);
+		const bool depthPrePass = settings_.depthPrePass && shadeState.blendMode == BlendMode::Opaque && shadeState.depthWrite && !(Surface.PolyFlags & PF_Masked);
+		const auto state = depthPrePass ? GetDepthEqualState(shadeState.twoSided) : shadeState;
+		const auto diffuseSet = diffuse->descriptorSet;
+		const auto samplerIndex = GetTextureSamplerIndex(Surface.PolyFlags, false);
+
+		// Every command of the facet shares its surface parameters.
+		auto& queue = worldQueue_;
+		auto& vertices = queue.vertices;
+		auto& indices = queue.indices;
+		const auto surfaceIndex = uint32_t(queue.surfaces.size());
+		queue.surfaces.push_back(surfaceParameters);
+
+		// The facet's vertices and indices go straight to the queue; indices are relative to the first vertex of the current command.
+		auto commandFirstVertex = vertices.size();
+		auto commandFirstIndex = indices.size();
+
+		const auto queueCommand = [&]
+		{
+			const auto indexCount = indices.size() - commandFirstIndex;
+			if (indexCount == 0)
+				return;
+
+			if (auto* hitVertices = AddHitVertices(Surface.PolyFlags & PF_TwoSided ? HitMode::TwoSidedSurfaces : HitMode::Surfaces, indexCount))
+			{
+				for (size_t i = 0; i < indexCount; ++i)
+					std::memcpy(hitVertices[i].position, vertices[commandFirstVertex + indices[commandFirstIndex + i]].position, sizeof(HitVertex::position));
+			}
+
+			const auto command = vk::DrawIndexedIndirectCommand(
+				uint32_t(indexCount),
+				1,
+				uint32_t(commandFirstIndex),
+				int32_t(commandFirstVertex),
+				surfaceIndex);
+
+			if (depthPrePass)
+				queue.depthCommands[shadeState.twoSided ? 1 : 0].push_back(command);
+
+			QueueWorldDraw(state, Surface.PolyFlags, diffuseSet, samplerIndex, command);
+
+			commandFirstVertex = vertices.size();
+			commandFirstIndex = indices.size();
+		};
+
+		for (FSavedPoly* Poly = Facet.Polys; Poly; Poly = Poly->Next)
+		{
+			if (Poly->NumPts < 3 || size_t(Poly->NumPts) > MaxBatchVertexCount)
+				continue;
+
+			// 16-bit indices only reach so far; large facets are split across several commands.
+			if (vertices.size() - commandFirstVertex + Poly->NumPts > MaxBatchVertexCount)
+				queueCommand();
+
+			const auto firstVertex = vertices.size();
+			vertices.resize(firstVertex + Poly->NumPts);
+			for (int i = 0; i < Poly->NumPts; ++i)
+			{
+				const auto& point = Poly->Pts[i]->Point;
+				auto& vertex = vertices[firstVertex + i];
+				vertex.position[0] = point.X;
+				vertex.position[1] = point.Y;
+				vertex.position[2] = point.Z;
+				vertex.uv[0] = (coords.XAxis | point) - uDot;
+				vertex.uv[1] = (coords.YAxis | point) - vDot;
+			}
+
+			const auto firstIndex = indices.size();
+			indices.resize(firstIndex + (Poly->NumPts - 2) * 3);
+			vertex_packing::WriteFanIndices(uint16_t(firstVertex - commandFirstVertex), uint32_t(Poly->NumPts), indices.data() + firstIndex);
+		}
+
+		queueCommand();
 	}
 
 	/**
@@ -296,6 +1362,65 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	void DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, int NumPts, DWORD PolyFlags, FSpanBuffer* Span) override
 	{
+		if (!isLocked_ || NumPts < 3)
+			return;
+
+		FlushWorldQueue();
+		FlushTileBatch();
+		FlushColorBatch(fogSurfaceBatch_);
+		FlushLineBatch();
+
+		auto& batch = gouraudBatch_;
+
+		// A mesh arrives as many small fans in a row; the texture is only looked up when the batch changes.
+		if (batch.texture == nullptr || batch.cacheId != Info.CacheID || batch.polyFlags != PolyFlags || Info.bRealtimeChanged ||
+			batch.vertices.size() + NumPts > MaxBatchVertexCount)
+		{
+			FlushGouraudBatch();
+
+			batch.texture = CacheTexture(Info, PolyFlags);
+			if (batch.texture == nullptr)
+				return;
+
+			batch.cacheId = Info.CacheID;
+			batch.polyFlags = PolyFlags;
+			batch.uvScale[0] = 1.0f / (Info.UScale * float(Info.USize));
+			batch.uvScale[1] = 1.0f / (Info.VScale * float(Info.VSize));
+		}
+
+		// Modulated models must not be tinted, and fog only applies to plain ones.
+		const bool lit = !(PolyFlags & PF_Modulated);
+		const bool fogged = IsFogged(PolyFlags);
+
+		const auto firstVertex = batch.vertices.size();
+		batch.vertices.resize(firstVertex + NumPts);
+		for (int i = 0; i < NumPts; ++i)
+		{
+			const auto& point = *Pts[i];
+			vertex_packing::PackGouraudVertex(
+				&point.Point.X,
+				point.U,
+				point.V,
+				lit ? &point.Light.X : nullptr,
+				fogged ? &point.Fog.X : nullptr,
+				batch.uvScale,
+				batch.vertices[firstVertex + i]);
+		}
+
+		const auto firstIndex = batch.indices.size();
+		batch.indices.resize(firstIndex + (NumPts - 2) * 3);
+		vertex_packing::WriteFanIndices(uint16_t(firstVertex), uint32_t(NumPts), batch.indices.data() + firstIndex);
+
+		if (auto* hitVertices = AddHitVertices(PolyFlags & PF_TwoSided ? HitMode::TwoSidedSurfaces : HitMode::Surfaces, (NumPts - 2) * 3))
+		{
+			for (int i = 1; i + 1 < NumPts; ++i)
+			{
+				for (const auto* point : {Pts[0], Pts[i], Pts[i + 1]})
+					std::memcpy((hitVertices++)->position, &point->Point.X, sizeof(HitVertex::position));
+			}
+		}
+
+		++drawStatistics_.gouraudPolygons;
 	}
 
 	/**
@@ -318,8 +1443,9 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 
 	\note Need to set scene node here otherwise Deus Ex dialogue letterboxes will look wrong; they aren't properly sent to SetSceneNode() it seems.
 	\note Drawn by converting pixel coordinates to -1,1 ranges in vertex shader and drawing quads with X/Y perspective transform disabled.
-	The Z coordinate however is transformed and divided by W; then W is set to 1 in the shader to get correct depth and yet preserve X and Y.
+	The Z coordinate however is transformed like other primitives' and X and Y are multiplied by W, so the divide preserves them; see tile.vert.
 	Other renderers take the opposite approach and multiply X by RProjZ*Z and Y by RProjZ*Z*aspect so they are preserved and then transform everything.
+	\note Consecutive tiles with the same texture and flags are drawn together; see FlushTileBatch().
 	*/
 	void DrawTile(
 		FSceneNode* Frame,
@@ -338,20 +1464,128 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 		FPlane Fog,
 		DWORD PolyFlags) override
 	{
+		if (!isLocked_ || XL <= 0.0f || YL <= 0.0f)
+			return;
+
+		SetScene(*Frame);
+
+		FlushWorldQueue();
+		FlushGouraudBatch();
+		FlushColorBatch(fogSurfaceBatch_);
+		FlushLineBatch();
+
+		// Tiles within the texture are clamped, so that HUD elements and fonts do not pick up texels of the opposite edge.
+		const auto textureWidth = Info.UScale * float(Info.USize);
+		const auto textureHeight = Info.VScale * float(Info.VSize);
+		const bool clamp = U >= 0.0f && V >= 0.0f && U + UL <= textureWidth && V + VL <= textureHeight;
+		const auto samplerIndex = GetTextureSamplerIndex(PolyFlags, clamp);
+
+		auto& batch = tileBatch_;
+		if (batch.texture == nullptr || batch.cacheId != Info.CacheID || batch.polyFlags != PolyFlags || batch.samplerIndex != samplerIndex ||
+			Info.bRealtimeChanged || batch.vertices.size() + 4 > MaxBatchVertexCount)
+		{
+			FlushTileBatch();
+
+			batch.texture = CacheTexture(Info, PolyFlags);
+			if (batch.texture == nullptr)
+				return;
+
+			batch.cacheId = Info.CacheID;
+			batch.polyFlags = PolyFlags;
+			batch.samplerIndex = samplerIndex;
+			batch.uvScale[0] = 1.0f / textureWidth;
+			batch.uvScale[1] = 1.0f / textureHeight;
+		}
+
+		// Modulated tiles must not be tinted.
+		const float rgba[4] = {Color.X, Color.Y, Color.Z, 1.0f};
+		const auto color = PolyFlags & PF_Modulated ? 0xFFFFFFFFu : vertex_packing::ToColor(rgba);
+
+		const auto left = U * batch.uvScale[0];
+		const auto right = (U + UL) * batch.uvScale[0];
+		const auto top = V * batch.uvScale[1];
+		const auto bottom = (V + VL) * batch.uvScale[1];
+
+		const auto firstVertex = batch.vertices.size();
+		batch.vertices.insert(
+			batch.vertices.end(),
+			{
+				vertex_packing::TileVertex{{X, Y, Z}, {left, top}, color},
+				vertex_packing::TileVertex{{X + XL, Y, Z}, {right, top}, color},
+				vertex_packing::TileVertex{{X + XL, Y + YL, Z}, {right, bottom}, color},
+				vertex_packing::TileVertex{{X, Y + YL, Z}, {left, bottom}, color}
+			});
+
+		const auto firstIndex = batch.indices.size();
+		batch.indices.resize(firstIndex + 6);
+		vertex_packing::WriteFanIndices(uint16_t(firstVertex), 4, batch.indices.data() + firstIndex);
+
+		if (auto* hitVertices = AddHitVertices(HitMode::TwoSidedSurfaces, 6))
+		{
+			for (size_t i = 0; i < 6; ++i)
+			{
+				const auto& position = batch.vertices[batch.indices[firstIndex + i]].position;
+				UnprojectPixel(*Frame, position[0], position[1], position[2], hitVertices[i].position);
+			}
+		}
+
+		++drawStatistics_.tiles;
 	}
 
 	/**
-	For UnrealED.
+	For UnrealED. Wireframe and brush views send tens of thousands of these per frame.
+	\param P1 Start in pixels of the scene node, with the view depth in Z.
+	\param P2 End, likewise.
+	\param LineFlags LINE_DepthCued lines are hidden behind geometry, others are drawn on top. LINE_Transparent lines are blended additively.
+	\note Lines accumulate until the scene node changes or something else is drawn; see FlushLineBatch().
 	*/
 	void Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2) override
 	{
+		if (!isLocked_)
+			return;
+
+		FlushWorldQueue();
+		FlushGouraudBatch();
+		FlushTileBatch();
+		FlushColorBatch(fogSurfaceBatch_);
+
+		const auto color = GetLineColor(Color);
+		auto& vertices = lineBatch_.lines[GetLineBatchIndex(LineFlags)];
+		vertices.push_back(GetLineVertex(*Frame, P1.X, P1.Y, P1.Z, color));
+		vertices.push_back(GetLineVertex(*Frame, P2.X, P2.Y, P2.Z, color));
+		AddHitVertices(LineFlags & LINE_DepthCued ? HitMode::Lines : HitMode::OverlayLines, vertices.end() - 2, vertices.end());
+
+		++drawStatistics_.lines;
 	}
 
 	/**
-	For UnrealED.
+	For UnrealED: vertices, pivots and the like.
+	\param X1 Left of the rectangle in pixels of the scene node. X2 is the right, Y1 and Y2 are the top and bottom; all are inclusive.
+	\param Z View depth.
+	\param LineFlags See Draw2DLine().
 	*/
 	void Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z) override
 	{
+		if (!isLocked_)
+			return;
+
+		FlushWorldQueue();
+		FlushGouraudBatch();
+		FlushTileBatch();
+		FlushColorBatch(fogSurfaceBatch_);
+
+		// The software renderer fills the last row and column too.
+		const auto color = GetLineColor(Color);
+		const auto topLeft = GetLineVertex(*Frame, X1, Y1, Z, color);
+		const auto topRight = GetLineVertex(*Frame, X2 + 1.0f, Y1, Z, color);
+		const auto bottomLeft = GetLineVertex(*Frame, X1, Y2 + 1.0f, Z, color);
+		const auto bottomRight = GetLineVertex(*Frame, X2 + 1.0f, Y2 + 1.0f, Z, color);
+
+		auto& vertices = lineBatch_.points[GetLineBatchIndex(LineFlags)];
+		vertices.insert(vertices.end(), {topLeft, topRight, bottomRight, topLeft, bottomRight, bottomLeft});
+		AddHitVertices(LineFlags & LINE_DepthCued ? HitMode::Points : HitMode::OverlayPoints, vertices.end() - 6, vertices.end());
+
+		++drawStatistics_.points;
 	}
 
 	/**
@@ -360,27 +1594,60 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	void ClearZ(FSceneNode* Frame) override
 	{
+		if (!isLocked_)
+			return;
+
+		FlushBatches();
+
+		if (IsHitTesting())
+			hitBatch_.clearDepth = true;
+
+		frames_[currentFrameIndex_].commandBuffer.clearAttachments(
+			vk::ClearAttachment().setAspectMask(vk::ImageAspectFlagBits::eDepth).setClearValue(vk::ClearDepthStencilValue(1.0f, 0)),
+			vk::ClearRect(vk::Rect2D({0, 0}, renderExtent_), 0, 1));
 	}
 
 	/**
-	Something to do with clipping planes, not needed.
+	For UnrealEd's hit testing (selection by clicking): what is drawn until the matching PopHit() belongs to this hit record.
+	Records nest, e.g. a surface inside a level; a hit returns the whole stack.
+	\param Data The record, e.g. HActor.
+	\param Count Its size in bytes.
+	\note Only called between Lock() and Unlock() of a frame that got HitData. The primitives drawn meanwhile also go into the hit batch,
+	which Unlock() renders as IDs into a small target around the cursor; see RecordHitPass().
 	*/
 	void PushHit(const BYTE* Data, INT Count) override
 	{
+		if (IsHitTesting())
+			hitRecorder_.Push(Data, size_t(Count));
 	}
 
 	/**
-	Something to do with clipping planes, not needed.
+	Ends the hit record pushed last.
+	\param Count Its size in bytes.
+	\param bForce The record is a hit even if nothing drawn under it is under the cursor, unless something else is.
 	*/
 	void PopHit(INT Count, UBOOL bForce) override
 	{
+		if (IsHitTesting())
+			hitRecorder_.Pop(size_t(Count), bForce != 0);
 	}
 
 	/**
-	Something to do with FPS counters etc, not needed.
+	A line for the game's stats display.
+	\param Result The engine's buffer, whose size is not passed; the line is cut to StatsLength characters.
+	\note Only a summary fits; VKFRAMESTATS, VKMEMSTATS, VKLATENCY and VKDEPTHPREPASS log the full reports.
 	*/
 	void GetStats(TCHAR* Result) override
 	{
+		const auto memory = memoryAllocator_->GetStatistics();
+		const auto draws = lastFrameDrawStatistics_.gouraudDraws + lastFrameDrawStatistics_.worldSubmissions + lastFrameDrawStatistics_.tileDraws;
+
+		std::wstringstream text;
+		text
+			<< "Vulkan: GPU " << std::fixed << std::setprecision(2) << gpuFrameTime_ << " ms at " << renderExtent_.width << "x"
+			<< renderExtent_.height << ", " << draws << " draws, latency " << latency_ << " ms, " << memory.usedSize / (1024 * 1024) << " MiB";
+
+		appStrncpy(Result, text.str().c_str(), StatsLength);
 	}
 
 	/**
@@ -404,18 +1671,66 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	UBOOL Exec(const TCHAR* Cmd, FOutputDevice& Ar) override
 	{
-		return URenderDevice::Exec(Cmd, Ar);
-	}
+		if (URenderDevice::Exec(Cmd, Ar))
+			return true;
 
-	/**
-	This optional function can be used to set the frustum and viewport parameters per scene change instead of per drawXXXX() call.
-	\param Frame Contains various information with which to build frustum and viewport.
-	\note Standard Z parameters: near 1, far 32760. However, it seems ComplexSurfaces (except water's surface when in it) are at least at Z = ~13; models in DX cut scenes ~7. Can be utilized to gain increased z-buffer precision.
+		if (ParseCommand(&Cmd, TEXT("VKFRAMESTATS")))
+		{
+			Ar.Log(FormatFrameStatistics().c_str());
+			return true;
+		}
+
+		if (ParseCommand(&Cmd, TEXT("VKMEMSTATS")))
+		{
+			Ar.Log(FormatMemoryStatistics().c_str());
+			return true;
+		}
+
+		if (ParseCommand(&Cmd, TEXT("VKLATENCY")))
+		{
+			Ar.Log(FormatLatencyStatistics().c_str());
+			return true;
+		}
+
+		if (ParseCommand(&Cmd, TEXT("VKDEBUGMESSAGES")))
+		{
+			Ar.Log(FormatDebugMessageStatistics().c_str());
+			return true;
+		}
+
+		// VKDEPTHPREPASS [ON|OFF] switches the depth pre-pass, toggling it without an argument, and logs how it compares.
+		if (ParseCommand(&Cmd, TEXT("VKDEPTHPREPASS")))
+		{
+			if (ParseCommand(&Cmd, TEXT("ON")))
+				settings_.depthPrePass = true;
+			else if (ParseCommand(&Cmd, TEXT("OFF")))
+				settings_.depthPrePass = false;
+			else
+				settings_.depthPrePass = !settings_.depthPrePass;
+
+			DepthPrePass = settings_.depthPrePass;
+			Ar.Log(FormatDepthPrePassStatistics().c_str());
+			return true;
+		}
+
+		return false;
+	}
+
+	/**
+	This optional function can be used to set the frustum and viewport parameters per scene change instead of per drawXXXX() call.
+	\param Frame Contains various information with which to build frustum and viewport.
+	\note The parameters become a SceneUniforms record that every vertex shader projects with; draws only pass its dynamic offset.
+	\note Standard Z parameters: near 1, far 32760. However, it seems ComplexSurfaces (except water's surface when in it) are at least at Z = ~13; models in DX cut scenes ~7. Can be utilized to gain increased z-buffer precision.
 	Unreal/UT weapons all seem to fall within ZWeapons: Z<12. Can be used to detect, clear depth (to prevent intersecting world) and move them. Only disadvantage of using increased zNear is that water surfaces the player is bobbing in don't look as good.
 	The D3D10 renderer moves gouraud polygons and tiles with Z < zNear (or Z < ZWeapons if needed) inside the range, allowing Unreal/UT weapons (after a depth clear) and tiles to be displayed correctly. ComplexSurfaces are not moved as this results in odd looking water surfaces.
+	This renderer does the same in gouraud.vert and tile.vert with SceneUniforms::nearDepth.
 	*/
 	void SetSceneNode(FSceneNode* Frame) override
 	{
+		if (!isLocked_)
+			return;
+
+		SetScene(*Frame);
 	}
 
 	/**
@@ -426,13 +1741,64 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	\note Already cached textures are skipped, unless it's a dynamic texture, in which case it is updated.
 	\note Extra care is taken to recache textures that aren't saved as masked, but now have flags indicating they should be (masking is not always properly set).
 		as this couldn't be anticipated in advance, the texture needs to be deleted and recreated.
+	\note New textures are only queued: their conversion runs on the shared precache pool, and the next Lock() or draw that needs one creates and uploads them.
 	*/
 	void PrecacheTexture(FTextureInfo& Info, DWORD PolyFlags) override
 	{
+		if (context_->precachedTextureIds.count(Info.CacheID) != 0)
+			return;
+
+		// Palette-indexed textures are uploaded as they are; there is nothing to convert.
+		const auto format = GetTextureFormat(Info);
+		if (context_->textureCache.count(Info.CacheID) != 0 || !format || (context_->paletteTable && Info.Format == TEXF_P8))
+		{
+			// Precaching may overwrite a texture the pending batch samples.
+			FlushBatches();
+			(void)CacheTexture(Info, PolyFlags);
+			return;
+		}
+
+		if (context_->precachedTextures.empty())
+			context_->precacheStartTime = std::chrono::steady_clock::now();
+
+		auto& pending = *context_->precachedTextures.emplace_back(std::make_unique<PrecachedTexture>());
+		context_->precachedTextureIds.insert(Info.CacheID);
+
+		pending.info = Info;
+		pending.info.Mips = nullptr;
+		pending.info.Palette = nullptr;
+		pending.format = *format;
+		pending.masked = Info.Format == TEXF_P8 && (PolyFlags & PF_Masked);
+		pending.diskCacheable = IsDiskCacheable(Info);
+		pending.extent = vk::Extent2D(Info.Mips[0]->USize, Info.Mips[0]->VSize);
+		pending.mipCount = std::min(uint32_t(Info.NumMips), Texture::GetFullMipCount(pending.extent));
+		CopyPalette(Info, pending.palette);
+
+		pending.sourceOffsets.resize(pending.mipCount + 1);
+		pending.mipOffsets.resize(pending.mipCount + 1);
+		for (uint32_t mip = 0; mip < pending.mipCount; ++mip)
+		{
+			const auto extent = Texture::GetMipExtent(pending.extent, mip);
+			pending.sourceOffsets[mip + 1] = pending.sourceOffsets[mip] + GetSourceMipSize(Info, extent);
+			pending.mipOffsets[mip + 1] = pending.mipOffsets[mip] + Texture::GetMipSize(pending.format, extent.width, extent.height);
+		}
+
+		// The engine may unload the mips once this returns; a copy costs far less than converting them.
+		pending.source.resize(pending.sourceOffsets.back());
+		for (uint32_t mip = 0; mip < pending.mipCount; ++mip)
+		{
+			std::memcpy(
+				pending.source.data() + pending.sourceOffsets[mip],
+				Info.Mips[mip]->DataPtr,
+				pending.sourceOffsets[mip + 1] - pending.sourceOffsets[mip]);
+		}
+
+		context_->precachePool->Submit([&context = *context_, &pending] { ConvertPrecachedTexture(context, pending); });
+		Info.bRealtimeChanged = 0;
 	}
 
 	/**
-	Other renderers handle flashes here by saving the related structures; this one does it in Lock().
+	Other renderers handle flashes here by saving the related structures; this one saves them in Lock() and applies them in the composite pass.
 	*/
 	void EndFlash() override
 	{
@@ -442,40 +1808,74 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	{
 		vk::ApplicationInfo appInfo;
 		appInfo
-			.setApiVersion(VK_API_VERSION_1_0)
+			.setApiVersion(VK_API_VERSION_1_1)
 			.setPApplicationName("unreal98-Vulkan1Drv")
 			.setApplicationVersion(VK_MAKE_VERSION(1, 0, 0))
 			.setEngineVersion(VK_MAKE_VERSION(1, 0, 0));
 
-		constexpr auto extensions = utils::make_array<const char*>(
-			VK_KHR_SURFACE_EXTENSION_NAME,
-			VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+		// Debug builds always have messages and labels; release builds only with DebugLabels, e.g. to read a capture.
 #if defined(_DEBUG)
-			VK_EXT_DEBUG_REPORT_EXTENSION_NAME
+		const bool wantsDebugUtils = true;
+#else
+		const bool wantsDebugUtils = settings_.debugLabels;
 #endif
-		);
-
-		constexpr auto layers = utils::make_array<const char*>(
+		const auto availableExtensions = vk::enumerateInstanceExtensionProperties();
+		const bool useDebugUtils = wantsDebugUtils && std::any_of(
+			availableExtensions.begin(),
+			availableExtensions.end(),
+			[](const vk::ExtensionProperties& props) { return std::string_view(props.extensionName) == VK_EXT_DEBUG_UTILS_EXTENSION_NAME; });
+
+		std::vector<const char*> extensions = {VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME};
+		if (useDebugUtils)
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+
+		// Only when installed, so that debug builds still start without the SDK.
+		std::vector<const char*> layers;
 #if defined(_DEBUG)
-			"VK_LAYER_LUNARG_standard_validation"
+		const auto availableLayers = vk::enumerateInstanceLayerProperties();
+		if (std::any_of(
+			availableLayers.begin(),
+			availableLayers.end(),
+			[](const vk::LayerProperties& props) { return std::string_view(props.layerName) == "VK_LAYER_KHRONOS_validation"; }))
+		{
+			layers.push_back("VK_LAYER_KHRONOS_validation");
+		}
 #endif
-		);
 
-		instance_ = vk::createInstance(
+		context_->instance = vk::createInstance(
 			vk::InstanceCreateInfo()
 			.setPApplicationInfo(&appInfo)
 			.setPpEnabledExtensionNames(extensions.data())
-			.setEnabledExtensionCount(extensions.size())
+			.setEnabledExtensionCount(uint32_t(extensions.size()))
 			.setPpEnabledLayerNames(layers.data())
-			.setEnabledLayerCount(layers.size()));
+			.setEnabledLayerCount(uint32_t(layers.size())));
+
+		if (!useDebugUtils)
+			return;
 
-		debugCallbackHandle_ = instance_.createDebugReportCallbackEXT(
-			vk::DebugReportCallbackCreateInfoEXT()
-			.setFlags(
-				vk::DebugReportFlagBitsEXT::eWarning | vk::DebugReportFlagBitsEXT::eError | vk::DebugReportFlagBitsEXT::ePerformanceWarning | vk::
-				DebugReportFlagBitsEXT::eDebug | vk::DebugReportFlagBitsEXT::eInformation)
-			.setPfnCallback(VulkanDebugCallback)
-			.setPUserData(this));
+		LoadVulkanDebugUtilsFunctions(context_->instance);
+		context_->debugLabels = settings_.debugLabels;
+
+		// Messages below the minimum severity are not even sent to the callback.
+		const auto minimumSeverity = DebugMessageFilter::Severity(settings_.debugMessageSeverity);
+		context_->debugMessageFilter.emplace(minimumSeverity, MaxDebugMessagesPerId, std::chrono::seconds(1));
+
+		auto severities = vk::DebugUtilsMessageSeverityFlagsEXT(vk::DebugUtilsMessageSeverityFlagBitsEXT::eError);
+		if (minimumSeverity <= DebugMessageFilter::Severity::Warning)
+			severities |= vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning;
+		if (minimumSeverity <= DebugMessageFilter::Severity::Info)
+			severities |= vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo;
+		if (minimumSeverity <= DebugMessageFilter::Severity::Verbose)
+			severities |= vk::DebugUtilsMessageSeverityFlagBitsEXT::eVerbose;
+
+		context_->debugMessenger = context_->instance.createDebugUtilsMessengerEXT(
+			vk::DebugUtilsMessengerCreateInfoEXT()
+			.setMessageSeverity(severities)
+			.setMessageType(
+				vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral | vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation |
+				vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance)
+			.setPfnUserCallback(VulkanDebugCallback)
+			.setPUserData(&*context_->debugMessageFilter));
 	}
 
 
@@ -485,7 +1885,7 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	/**
 	Rune world fog is drawn by clearing the screen in the fog color, clipping the world geometry outside the view distance
 	and then overlaying alpha blended planes. Unfortunately this function is only called once it's actually time to draw the
-	fog, as such it's difficult to move this into a shader.
+	fog, as such it's difficult to move this into a shader. Consecutive fog surfaces are collected into one alpha blended draw instead.
 
 	\param Frame The scene. See SetSceneNode().
 	\param ForSurf Fog plane information. Should be drawn with alpha blending enabled, color alpha = position.z/FogDistance.
@@ -493,33 +1893,51 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	void DrawFogSurface(FSceneNode* Frame, FFogSurf& FogSurf)
 	{
-		float mult = 1.0 / FogSurf.FogDistance;
-		_d3d->setProjectionMode(D3D::PROJ_NORMAL);
+		if (!isLocked_)
+			return;
+
+		FlushWorldQueue();
+		FlushGouraudBatch();
+		FlushTileBatch();
+		FlushLineBatch();
+
+		// Fog planes share one fixed state, so they accumulate until something else is drawn.
+		auto& batch = fogSurfaceBatch_;
+		batch.state.blendMode = BlendMode::AlphaBlend;
+		batch.state.depthWrite = false;
+
+		const auto scale = 1.0f / FogSurf.FogDistance;
+		float color[4] = {FogSurf.FogColor.X, FogSurf.FogColor.Y, FogSurf.FogColor.Z, 0.0f};
 
-		_d3d->setFlags(PF_AlphaBlend, 0);
-		_d3d->setTexture(D3D::PASS_DIFFUSE, NULL);
-		_d3d->setTexture(D3D::PASS_LIGHT, NULL);
-		_d3d->setTexture(D3D::PASS_DETAIL, NULL);
-		_d3d->setTexture(D3D::PASS_FOG, NULL);
-		_d3d->setTexture(D3D::PASS_MACRO, NULL);
 		for (FSavedPoly* Poly = FogSurf.Polys; Poly; Poly = Poly->Next)
 		{
-			_d3d->indexTriangleFan(Poly->NumPts);
-			for (int i = 0; i < Poly->NumPts; i++)
+			if (Poly->NumPts < 3)
+				continue;
+
+			if (batch.vertices.size() + Poly->NumPts > MaxBatchVertexCount)
+				FlushColorBatch(batch);
+
+			const auto firstVertex = batch.vertices.size();
+			batch.vertices.resize(firstVertex + Poly->NumPts);
+			for (int i = 0; i < Poly->NumPts; ++i)
 			{
-				D3D::Vertex* v = _d3d->getVertex();
-				v->flags = FogSurf.PolyFlags;
-				v->Color = *((d3dmath::Vec4*)&FogSurf.FogColor.X);
-				v->Pos = *(d3dmath::Vec3*)&Poly->Pts[i]->Point.X;
-				v->Color.w = v->Pos.z * mult;
-				v->flags = PF_AlphaBlend;
+				const auto& point = Poly->Pts[i]->Point;
+				color[3] = point.Z * scale;
+
+				auto& vertex = batch.vertices[firstVertex + i];
+				std::memcpy(vertex.position, &point.X, sizeof(vertex.position));
+				vertex.color = vertex_packing::ToColor(color);
 			}
+
+			const auto firstIndex = batch.indices.size();
+			batch.indices.resize(firstIndex + (Poly->NumPts - 2) * 3);
+			vertex_packing::WriteFanIndices(uint16_t(firstVertex), uint32_t(Poly->NumPts), batch.indices.data() + firstIndex);
 		}
 	}
 
 	/**
-	Rune object fog is normally drawn using the API's linear fog methods. In the D3D10 case, in the shader.
-	This function tells us how to configure the fog.
+	Rune object fog is normally drawn using the API's linear fog methods. Here it is applied by the gouraud shader,
+	the parameters go into push constants so fogged actors need no pipeline switch.
 
 	\param Frame The scene. See SetSceneNode().
 	\param FogDistance The end distance of the fog (start distance is always 0)
@@ -527,11 +1945,13 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	void PreDrawGouraud(FSceneNode* Frame, FLOAT FogDistance, FPlane FogColor)
 	{
-		if (FogDistance > 0)
-		{
-			d3dmath::Vec4* color = ((d3dmath::Vec4*)&FogColor.X);
-			_d3d->fog(FogDistance, color);
-		}
+		if (FogDistance <= 0)
+			return;
+
+		// Fans and surfaces drawn so far are not fogged.
+		FlushWorldQueue();
+		FlushGouraudBatch();
+		distanceFog_ = {{FogColor.X, FogColor.Y, FogColor.Z, 1.0f}, 1.0f / FogDistance};
 	}
 
 	/**
@@ -540,10 +1960,12 @@ DECLARE_CLASS(UVulkan1RenderDevice, URenderDevice, CLASS_Config)
 	*/
 	void PostDrawGouraud(FLOAT FogDistance)
 	{
-		if (FogDistance > 0)
-		{
-			_d3d->fog(0, nullptr);
-		}
+		if (FogDistance <= 0)
+			return;
+
+		FlushWorldQueue();
+		FlushGouraudBatch();
+		distanceFog_ = {};
 	}
 
 	//@}
@@ -556,6 +1978,14 @@ private:
 		vk::PhysicalDeviceProperties deviceProperties;
 		size_t renderingQueueFamilyIndex;
 		size_t presentationQueueFamilyIndex;
+		bool supportsExtendedDynamicState;
+		bool supportsTextureCompressionBC;
+		bool supportsPresentWait;
+
+		// Ranking criteria, see RankPhysicalDevices().
+		vk::DeviceSize deviceLocalHeapSize;
+		std::optional<size_t> transferQueueFamilyIndex; // A family with transfer support but no graphics or compute.
+		std::wstring uuid; // Empty for Vulkan 1.0 devices.
 
 		vk::SurfaceCapabilitiesKHR presentationSurfaceCaps;
 		std::vector<vk::SurfaceFormatKHR> presentationSurfaceFormats;
@@ -564,67 +1994,186 @@ private:
 
 
 private:
+	// Filtered before anything is formatted, so that repeated messages cost a counter and a map lookup.
 	static VkBool32 VKAPI_CALL VulkanDebugCallback(
-		VkDebugReportFlagsEXT flags,
-		VkDebugReportObjectTypeEXT objType,
-		uint64_t srcObject,
-		size_t location,
-		int32_t msgCode,
-		const char* pLayerPrefix,
-		const char* pMsg,
+		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+		VkDebugUtilsMessageTypeFlagsEXT messageTypes,
+		const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
 		void* pUserData)
 	{
-		// Select prefix depending on flags passed to the callback
-		// Note that multiple flags may be set for a single validation message
-		std::wstringstream text;
+		const auto severity = messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT
+			                      ? DebugMessageFilter::Severity::Error
+			                      : messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
+			                      ? DebugMessageFilter::Severity::Warning
+			                      : messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT
+			                      ? DebugMessageFilter::Severity::Info
+			                      : DebugMessageFilter::Severity::Verbose;
+
+		const auto suppressedCount = static_cast<DebugMessageFilter*>(pUserData)->Accept(severity, pCallbackData->messageIdNumber);
+		if (!suppressedCount)
+			return VK_FALSE;
+
+		constexpr const char* SeverityNames[] = {"VERBOSE", "INFO", "WARNING", "ERROR"};
+		const auto* idName = pCallbackData->pMessageIdName ? pCallbackData->pMessageIdName : "";
+		if (*suppressedCount > 0)
+			DebugPrint("[Vulkan] ", SeverityNames[size_t(severity)], " ", idName, ": ", pCallbackData->pMessage, " (", *suppressedCount, " suppressed since)");
+		else
+			DebugPrint("[Vulkan] ", SeverityNames[size_t(severity)], " ", idName, ": ", pCallbackData->pMessage);
 
-		text << "[Vulkan.Debug_extension] ";
+		return VK_FALSE;
+	}
 
-		// Error that may result in undefined behaviour
-		if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
+	static constexpr vk::PresentModeKHR ToVulkanMode(PresentationMode presentationMode)
+	{
+		switch (presentationMode)
 		{
-			text << "ERROR:";
+		case PresentationMode::Immediate: return vk::PresentModeKHR::eImmediate;
+		case PresentationMode::VSyncDoubleBuffering: return vk::PresentModeKHR::eFifo;
+		case PresentationMode::RelaxedVSyncDoubleBuffering: return vk::PresentModeKHR::eFifoRelaxed;
+		case PresentationMode::VSyncTripleBuffering: return vk::PresentModeKHR::eMailbox;
+		default: throw std::runtime_error("Unknown presentation mode");
 		}
-		// Warnings may hint at unexpected / non-spec API usage
-		if (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
+	}
+
+	// Checks whether a device can run the renderer at all.
+	[[nodiscard]] std::optional<DeviceSearchResult> EvaluatePhysicalDevice(
+		const vk::PhysicalDevice& physicalDevice,
+		const vk::SurfaceKHR& presentationSurface,
+		const std::unordered_set<std::string_view>& requiredExtensions) const
+	{
+		// BC textures are decoded in software on devices without textureCompressionBC.
+		const auto features = physicalDevice.getFeatures();
+
+		const auto properties = physicalDevice.getProperties();
+
+		const auto extensionProperties = physicalDevice.enumerateDeviceExtensionProperties();
+
+		if (!boost::includes(
+			extensionProperties | boost::adaptors::transformed([](const vk::ExtensionProperties& props) { return std::string_view(props.extensionName); }),
+			requiredExtensions))
 		{
-			text << "WARNING:";
+			return std::nullopt;
 		}
-		// May indicate sub-optimal usage of the API
-		if (flags & VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT)
+
+		auto presentationSurfaceFormats = physicalDevice.getSurfaceFormatsKHR(presentationSurface);
+
+		if (!utils::contains(
+			presentationSurfaceFormats,
+			[](const vk::SurfaceFormatKHR& format)
+			{
+				return format.format == vk::Format::eB8G8R8A8Unorm && format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
+			}))
 		{
-			text << "PERFORMANCE:";
+			return std::nullopt;
 		}
-		// Informal messages that may become handy during debugging
-		if (flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT)
+
+		auto presentationSurfaceCaps = physicalDevice.getSurfaceCapabilitiesKHR(presentationSurface);
+
+		auto presentationModes = physicalDevice.getSurfacePresentModesKHR(presentationSurface);
+
+		if (!utils::contains(presentationModes, [this](const vk::PresentModeKHR mode) { return mode == ToVulkanMode(settings_.presentationMode); }))
 		{
-			text << "INFO:";
+			return std::nullopt;
 		}
-		// Diagnostic info from the Vulkan loader and layers
-		// Usually not helpful in terms of API usage, but may help to debug layer and loader problems 
-		if (flags & VK_DEBUG_REPORT_DEBUG_BIT_EXT)
+
+		const auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+
+		const auto isGraphicsFamily = [](const auto& props)
 		{
-			text << "DEBUG:";
+			return props.value().queueCount != 0 && props.value().queueFlags & vk::QueueFlagBits::eGraphics;
+		};
+		const auto isPresentationFamily = [&](const auto& props)
+		{
+			return props.value().queueCount != 0 && physicalDevice.getSurfaceSupportKHR(uint32_t(props.index()), presentationSurface);
+		};
+
+		// A family that does both avoids sharing swapchain images between queues.
+		auto suitableQueueFamily = utils::maybeFirst(
+			queueFamilies | boost::adaptors::indexed(),
+			[&](const auto& props) { return isGraphicsFamily(props) && isPresentationFamily(props); });
+
+		if (!suitableQueueFamily)
+			suitableQueueFamily = utils::maybeFirst(queueFamilies | boost::adaptors::indexed(), isGraphicsFamily);
+
+		if (!suitableQueueFamily)
+		{
+			return std::nullopt;
 		}
 
-		// Display message to default output (console if activated)
-		text << " [" << pLayerPrefix << "] Code " << msgCode << " : " << pMsg;
+		auto suitablePresentationQueue = suitableQueueFamily;
+		if (!isPresentationFamily(*suitableQueueFamily))
+			suitablePresentationQueue = utils::maybeFirst(queueFamilies | boost::adaptors::indexed(), isPresentationFamily);
 
-		DebugPrint(text.str());
+		if (!suitablePresentationQueue)
+			return std::nullopt;
 
-		return VK_FALSE;
+		const auto transferQueueFamily = utils::maybeFirst(
+			queueFamilies | boost::adaptors::indexed(),
+			[](const auto& props)
+			{
+				const auto flags = props.value().queueFlags;
+				return props.value().queueCount != 0 && flags & vk::QueueFlagBits::eTransfer &&
+					!(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+			});
+
+		return DeviceSearchResult{
+			physicalDevice,
+			properties,
+			size_t(suitableQueueFamily->index()),
+			size_t(suitablePresentationQueue->index()),
+			SupportsExtendedDynamicState(physicalDevice, properties, extensionProperties),
+			bool(features.textureCompressionBC),
+			SupportsPresentWait(physicalDevice, properties, extensionProperties),
+			GetDeviceLocalHeapSize(physicalDevice),
+			transferQueueFamily ? std::optional<size_t>(transferQueueFamily->index()) : std::nullopt,
+			GetDeviceUuid(physicalDevice, properties),
+			std::move(presentationSurfaceCaps),
+			std::move(presentationSurfaceFormats),
+			std::move(presentationModes)
+		};
 	}
 
-	static constexpr vk::PresentModeKHR ToVulkanMode(PresentationMode presentationMode)
+	/**
+	Sorts usable devices best first: discrete GPUs, then larger device-local heaps, then a dedicated transfer family,
+	then a queue family that does both graphics and presentation. Integrated GPUs of hybrid laptops end up last.
+	*/
+	static void RankPhysicalDevices(std::vector<DeviceSearchResult>& candidates)
 	{
-		switch (presentationMode)
+		const auto getRank = [](const DeviceSearchResult& candidate)
 		{
-		case PresentationMode::Immediate: return vk::PresentModeKHR::eImmediate;
-		case PresentationMode::VSyncDoubleBuffering: return vk::PresentModeKHR::eFifo;
-		case PresentationMode::RelaxedVSyncDoubleBuffering: return vk::PresentModeKHR::eFifoRelaxed;
-		case PresentationMode::VSyncTripleBuffering: return vk::PresentModeKHR::eMailbox;
-		default: throw std::runtime_error("Unknown presentation mode");
-		}
+			return std::make_tuple(
+				candidate.deviceProperties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu,
+				candidate.deviceLocalHeapSize,
+				candidate.transferQueueFamilyIndex.has_value(),
+				candidate.renderingQueueFamilyIndex == candidate.presentationQueueFamilyIndex);
+		};
+
+		std::stable_sort(
+			candidates.begin(),
+			candidates.end(),
+			[&](const DeviceSearchResult& a, const DeviceSearchResult& b) { return getRank(a) > getRank(b); });
+	}
+
+	// PreferredDevice matches a device name or UUID, case-insensitively. UUID dashes are optional.
+	[[nodiscard]] static bool MatchesPreferredDevice(const DeviceSearchResult& candidate, const std::wstring& preferredDevice)
+	{
+		const auto normalize = [](const std::wstring& text, bool removeDashes)
+		{
+			std::wstring result;
+			for (const auto c : text)
+			{
+				if (removeDashes && c == L'-')
+					continue;
+				result.push_back(wchar_t(std::towlower(c)));
+			}
+			return result;
+		};
+
+		const auto name = std::string(candidate.deviceProperties.deviceName);
+		if (normalize(std::wstring(name.begin(), name.end()), false) == normalize(preferredDevice, false))
+			return true;
+
+		return !candidate.uuid.empty() && normalize(candidate.uuid, true) == normalize(preferredDevice, true);
 	}
 
 	[[nodiscard]] std::optional<DeviceSearchResult> FindRequiredPhysicalDevice(
@@ -632,95 +2181,146 @@ private:
 		const vk::SurfaceKHR& presentationSurface,
 		const std::unordered_set<std::string_view>& requiredExtensions) const
 	{
+		std::vector<DeviceSearchResult> candidates;
 		for (const auto& physicalDevice : physicalDevices)
 		{
-			const auto features = physicalDevice.getFeatures();
-			if (!features.textureCompressionBC)
-				continue;
+			if (auto candidate = EvaluatePhysicalDevice(physicalDevice, presentationSurface, requiredExtensions))
+				candidates.push_back(std::move(*candidate));
+			else
+				DebugPrint("Device \"", physicalDevice.getProperties().deviceName, "\" is not supported.");
+		}
 
-			const auto properties = physicalDevice.getProperties();
+		if (candidates.empty())
+			return std::nullopt;
 
-			const auto extensionProperties = physicalDevice.enumerateDeviceExtensionProperties();
+		RankPhysicalDevices(candidates);
+
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			const auto& candidate = candidates[i];
+			DebugPrint(
+				"Device rank #",
+				i + 1,
+				": \"",
+				candidate.deviceProperties.deviceName,
+				"\" ",
+				vk::to_string(candidate.deviceProperties.deviceType).c_str(),
+				", ",
+				candidate.deviceLocalHeapSize / (1024 * 1024),
+				" MiB device-local, ",
+				candidate.transferQueueFamilyIndex ? "dedicated transfer family, " : "",
+				candidate.renderingQueueFamilyIndex == candidate.presentationQueueFamilyIndex ? "combined graphics/present family, " : "",
+				"UUID ",
+				candidate.uuid.empty() ? L"unknown" : candidate.uuid);
+		}
 
-			if (!boost::includes(
-				extensionProperties | boost::adaptors::transformed([](const vk::ExtensionProperties& props) { return std::string_view(props.extensionName); }),
-				requiredExtensions))
+		if (!settings_.preferredDevice.empty())
+		{
+			for (auto& candidate : candidates)
 			{
-				continue;
+				if (MatchesPreferredDevice(candidate, settings_.preferredDevice))
+					return std::move(candidate);
 			}
 
-			auto presentationSurfaceFormats = physicalDevice.getSurfaceFormatsKHR(presentationSurface);
+			DebugPrint("PreferredDevice \"", settings_.preferredDevice, "\" is not available, using the best ranked device.");
+		}
 
-			if (!utils::contains(
-				presentationSurfaceFormats,
-				[](const vk::SurfaceFormatKHR& format)
-				{
-					return format.format == vk::Format::eB8G8R8A8Unorm && format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
-				}))
-			{
-				continue;
-			}
+		return std::move(candidates.front());
+	}
 
-			auto presentationSurfaceCaps = physicalDevice.getSurfaceCapabilitiesKHR(presentationSurface);
+	[[nodiscard]] static vk::DeviceSize GetDeviceLocalHeapSize(const vk::PhysicalDevice& physicalDevice)
+	{
+		const auto memoryProperties = physicalDevice.getMemoryProperties();
 
-			auto presentationModes = physicalDevice.getSurfacePresentModesKHR(presentationSurface);
+		vk::DeviceSize size = 0;
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+		{
+			if (memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+				size += memoryProperties.memoryHeaps[i].size;
+		}
 
-			if (!utils::contains(presentationModes, [this](const vk::PresentModeKHR mode) { return mode == ToVulkanMode(settings_.presentationMode); }))
-			{
-				continue;
-			}
+		return size;
+	}
 
-			const auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+	// Formatted as 8-4-4-4-12 hex digits, the way vulkaninfo prints deviceUUID.
+	[[nodiscard]] static std::wstring GetDeviceUuid(const vk::PhysicalDevice& physicalDevice, const vk::PhysicalDeviceProperties& properties)
+	{
+		if (properties.apiVersion < VK_API_VERSION_1_1)
+			return {};
 
-			const auto suitableQueueFamily = utils::maybeFirst(
-				queueFamilies | boost::adaptors::indexed(),
-				[](const auto& props)
-				{
-					return props.value().queueCount != 0 && props.value().queueFlags & vk::QueueFlagBits::eGraphics;
-				});
+		const auto properties2 = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+		const auto& uuid = properties2.get<vk::PhysicalDeviceIDProperties>().deviceUUID;
 
-			if (!suitableQueueFamily)
-			{
-				continue;
-			}
+		std::wstringstream text;
+		text << std::hex << std::setfill(L'0');
+		for (size_t i = 0; i < VK_UUID_SIZE; ++i)
+		{
+			if (i == 4 || i == 6 || i == 8 || i == 10)
+				text << L'-';
+			text << std::setw(2) << uint32_t(uuid[i]);
+		}
 
-			const auto suitablePresentationQueue = utils::maybeFirst(
-				queueFamilies | boost::adaptors::indexed(),
-				[&](const auto& props)
-				{
-					return props.value().queueCount != 0 && physicalDevice.getSurfaceSupportKHR(props.index(), presentationSurface);
-				});
+		return text.str();
+	}
 
-			if (!suitablePresentationQueue)
-				continue;
+	[[nodiscard]] static bool SupportsExtendedDynamicState(
+		const vk::PhysicalDevice& physicalDevice,
+		const vk::PhysicalDeviceProperties& properties,
+		const std::vector<vk::ExtensionProperties>& extensionProperties)
+	{
+#ifdef VK_EXT_extended_dynamic_state
+		if (properties.apiVersion < VK_API_VERSION_1_1)
+			return false;
 
-			return DeviceSearchResult{
-				physicalDevice,
-				properties,
-				size_t(suitableQueueFamily->index()),
-				size_t(suitablePresentationQueue->index()),
-				std::move(presentationSurfaceCaps),
-				std::move(presentationSurfaceFormats),
-				std::move(presentationModes)
-			};
+		if (!utils::contains(
+			extensionProperties,
+			[](const vk::ExtensionProperties& props) { return std::string_view(props.extensionName) == VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME; }))
+		{
+			return false;
 		}
 
-		return std::nullopt;
+		const auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>();
+		return features.get<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>().extendedDynamicState;
+#else
+		return false;
+#endif
 	}
 
 
-	void InitLogicalDevice(UViewport* inViewport)
+	[[nodiscard]] static bool SupportsPresentWait(
+		const vk::PhysicalDevice& physicalDevice,
+		const vk::PhysicalDeviceProperties& properties,
+		const std::vector<vk::ExtensionProperties>& extensionProperties)
 	{
-		constexpr auto deviceExtensions = utils::make_array<const char *>(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+#ifdef VK_KHR_present_wait
+		if (properties.apiVersion < VK_API_VERSION_1_1)
+			return false;
 
-		vk::Win32SurfaceCreateInfoKHR surfaceInfo;
-		surfaceInfo
-			.setHinstance(GetModuleHandle(nullptr))
-			.setHwnd(static_cast<HWND>(inViewport->GetWindow()));
+		for (const auto* extension : {VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME})
+		{
+			if (!utils::contains(
+				extensionProperties,
+				[&](const vk::ExtensionProperties& props) { return std::string_view(props.extensionName) == extension; }))
+			{
+				return false;
+			}
+		}
 
-		auto presentationSurface = instance_.createWin32SurfaceKHR(surfaceInfo);
+		const auto features = physicalDevice.getFeatures2<
+			vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePresentIdFeaturesKHR, vk::PhysicalDevicePresentWaitFeaturesKHR>();
+		return features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId &&
+			features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+#else
+		return false;
+#endif
+	}
+
+	// Picks the device for the first viewport's surface and creates it in context_.
+	void InitLogicalDevice(vk::SurfaceKHR presentationSurface)
+	{
+		constexpr auto deviceExtensions = utils::make_array<const char *>(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
-		const auto physicalDevices = instance_.enumeratePhysicalDevices();
+		const auto physicalDevices = context_->instance.enumeratePhysicalDevices();
 		if (physicalDevices.empty())
 			throw std::runtime_error{"Vulkan reported no devices."};
 
@@ -737,81 +2337,1671 @@ private:
 
 		DebugPrint(
 			"Picked device: \"",
-			deviceSearchResult->device.getProperties().deviceName,
+			deviceSearchResult->deviceProperties.deviceName,
 			"\" with rendering queue family #",
-			deviceSearchResult->
-			renderingQueueFamilyIndex,
+			deviceSearchResult->renderingQueueFamilyIndex,
 			" and presentation queue family #",
 			deviceSearchResult->presentationQueueFamilyIndex);
 
 		const float priority = 1.0f;
 		std::vector<vk::DeviceQueueCreateInfo> queueInfos;
 
-		queueInfos.push_back(vk::DeviceQueueCreateInfo{vk::DeviceQueueCreateFlags(), deviceSearchResult->presentationQueueFamilyIndex, 1, &priority});
+		queueInfos.push_back(vk::DeviceQueueCreateInfo{vk::DeviceQueueCreateFlags(), uint32_t(deviceSearchResult->presentationQueueFamilyIndex), 1, &priority});
 		if (deviceSearchResult->presentationQueueFamilyIndex != deviceSearchResult->renderingQueueFamilyIndex)
-			queueInfos.push_back(vk::DeviceQueueCreateInfo{vk::DeviceQueueCreateFlags(), deviceSearchResult->presentationQueueFamilyIndex, 1, &priority});
+			queueInfos.push_back(vk::DeviceQueueCreateInfo{vk::DeviceQueueCreateFlags(), uint32_t(deviceSearchResult->renderingQueueFamilyIndex), 1, &priority});
 
+		auto enabledExtensions = std::vector<const char*>(deviceExtensions.begin(), deviceExtensions.end());
+
+		const auto supportedFeatures = deviceSearchResult->device.getFeatures();
 
 		vk::PhysicalDeviceFeatures features;
-		features.setTextureCompressionBC(VK_TRUE);
-		logicalDevice_ = deviceSearchResult->device.createDevice(
-			vk::DeviceCreateInfo()
-			.setPpEnabledExtensionNames(&deviceExtensions[0])
-			.setEnabledExtensionCount(deviceExtensions.size())
-			.setPQueueCreateInfos(queueInfos.data())
-			.setQueueCreateInfoCount(queueInfos.size())
-			.setPEnabledFeatures(&features));
-
-		physicalDevice_ = deviceSearchResult->device;
-		presentationQueueFamilyIndex_ = deviceSearchResult->presentationQueueFamilyIndex;
-		renderingQueueFamilyIndex_ = deviceSearchResult->renderingQueueFamilyIndex;
-
-		renderingQueue_ = logicalDevice_.getQueue(renderingQueueFamilyIndex_, 0);
-		presentationQueue_ = logicalDevice_.getQueue(presentationQueueFamilyIndex_, 0);
-
-		presentationSurface_ = std::move(presentationSurface);
+		features.setTextureCompressionBC(deviceSearchResult->supportsTextureCompressionBC);
+		features.setSamplerAnisotropy(supportedFeatures.samplerAnisotropy);
+		// World surfaces are drawn indirectly with their record index in firstInstance, so both are needed together.
+		const bool supportsMultiDrawIndirect = supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+		features.setMultiDrawIndirect(supportsMultiDrawIndirect);
+		features.setDrawIndirectFirstInstance(supportsMultiDrawIndirect);
+		features.setShaderSampledImageArrayDynamicIndexing(supportedFeatures.shaderSampledImageArrayDynamicIndexing);
+
+		auto deviceCreateInfo = vk::DeviceCreateInfo()
+		                        .setPQueueCreateInfos(queueInfos.data())
+		                        .setQueueCreateInfoCount(uint32_t(queueInfos.size()))
+		                        .setPEnabledFeatures(&features);
+
+		// Feature structures of optional extensions are chained in front of each other.
+		void* featureChain = nullptr;
+
+#ifdef VK_EXT_extended_dynamic_state
+		auto extendedDynamicStateFeatures = vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT().setExtendedDynamicState(true);
+		if (deviceSearchResult->supportsExtendedDynamicState)
+		{
+			enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+			extendedDynamicStateFeatures.setPNext(featureChain);
+			featureChain = &extendedDynamicStateFeatures;
+		}
+#endif
+
+#ifdef VK_KHR_present_wait
+		auto presentIdFeatures = vk::PhysicalDevicePresentIdFeaturesKHR().setPresentId(true);
+		auto presentWaitFeatures = vk::PhysicalDevicePresentWaitFeaturesKHR().setPresentWait(true);
+		if (deviceSearchResult->supportsPresentWait)
+		{
+			enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			presentIdFeatures.setPNext(featureChain);
+			presentWaitFeatures.setPNext(&presentIdFeatures);
+			featureChain = &presentWaitFeatures;
+		}
+#endif
+
+		deviceCreateInfo.setPNext(featureChain);
+
+		auto& context = *context_;
+		context.logicalDevice = deviceSearchResult->device.createDevice(
+			deviceCreateInfo
+			.setPpEnabledExtensionNames(enabledExtensions.data())
+			.setEnabledExtensionCount(uint32_t(enabledExtensions.size())));
+
+		LoadVulkanDeviceFunctions(context.logicalDevice);
+
+		context.supportsExtendedDynamicState = deviceSearchResult->supportsExtendedDynamicState;
+		context.supportsTextureCompressionBC = deviceSearchResult->supportsTextureCompressionBC;
+		context.supportsPresentWait = deviceSearchResult->supportsPresentWait;
+		context.supportsSamplerAnisotropy = supportedFeatures.samplerAnisotropy;
+		context.supportsMultiDrawIndirect = supportsMultiDrawIndirect;
+		context.maxDrawIndirectCount = supportsMultiDrawIndirect ? deviceSearchResult->deviceProperties.limits.maxDrawIndirectCount : 1;
+		context.supportsLayerIndexing = supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+		context.physicalDevice = deviceSearchResult->device;
+		context.presentationQueueFamilyIndex = deviceSearchResult->presentationQueueFamilyIndex;
+		context.renderingQueueFamilyIndex = deviceSearchResult->renderingQueueFamilyIndex;
+
+		context.renderingQueue = context.logicalDevice.getQueue(uint32_t(context.renderingQueueFamilyIndex), 0);
+		context.presentationQueue = context.logicalDevice.getQueue(uint32_t(context.presentationQueueFamilyIndex), 0);
+
+		context.memoryAllocator.emplace(context.physicalDevice, context.logicalDevice);
+		context.memoryAllocator->Reserve(vk::MemoryPropertyFlagBits::eDeviceLocal, true, ReservedImageMemorySize);
+		context.pipelineCache = context.logicalDevice.createPipelineCache(vk::PipelineCacheCreateInfo());
+
+		DebugPrint(
+			"Device created. Extended dynamic state: ",
+			context.supportsExtendedDynamicState,
+			", BC texture compression: ",
+			context.supportsTextureCompressionBC ? "native" : "software decode",
+			", present wait: ",
+			context.supportsPresentWait,
+			", multi-draw-indirect: ",
+			context.supportsMultiDrawIndirect,
+			", layer indexing: ",
+			context.supportsLayerIndexing);
+	}
+
+	/**
+	Joins the context of the viewports that are already open, or creates it for the first one. Either way the viewport gets a
+	presentation surface of its own.
+	\return Whether the context is new, in which case Init() still has to create the shared caches.
+	*/
+	bool InitSharedContext(UViewport* inViewport)
+	{
+		auto& current = SharedContext::GetCurrent();
+		context_ = current.lock();
+
+		const bool isNew = !context_;
+		if (isNew)
+		{
+			context_ = std::make_shared<SharedContext>();
+			InitVulkanInstance();
+		}
+
+		vk::Win32SurfaceCreateInfoKHR surfaceInfo;
+		surfaceInfo
+			.setHinstance(GetModuleHandle(nullptr))
+			.setHwnd(static_cast<HWND>(inViewport->GetWindow()));
+		presentationSurface_ = context_->instance.createWin32SurfaceKHR(surfaceInfo);
+
+		if (isNew)
+		{
+			InitLogicalDevice(presentationSurface_);
+			current = context_;
+		}
+		else if (!context_->physicalDevice.getSurfaceSupportKHR(uint32_t(context_->presentationQueueFamilyIndex), presentationSurface_))
+		{
+			throw std::runtime_error{"The shared device can't present to this viewport"};
+		}
+
+		const auto& context = *context_;
+		instance_ = context.instance;
+		physicalDevice_ = context.physicalDevice;
+		logicalDevice_ = context.logicalDevice;
+		presentationQueueFamilyIndex_ = context.presentationQueueFamilyIndex;
+		renderingQueueFamilyIndex_ = context.renderingQueueFamilyIndex;
+		renderingQueue_ = context.renderingQueue;
+		presentationQueue_ = context.presentationQueue;
+		supportsExtendedDynamicState_ = context.supportsExtendedDynamicState;
+		supportsTextureCompressionBC_ = context.supportsTextureCompressionBC;
+		supportsPresentWait_ = context.supportsPresentWait;
+		debugLabels_ = context.debugLabels;
+		supportsSamplerAnisotropy_ = context.supportsSamplerAnisotropy;
+		supportsMultiDrawIndirect_ = context.supportsMultiDrawIndirect;
+		maxDrawIndirectCount_ = context.maxDrawIndirectCount;
+		memoryAllocator_ = &*context_->memoryAllocator;
+
 		presentationSurfaceCaps_ = physicalDevice_.getSurfaceCapabilitiesKHR(presentationSurface_);
 		availablePresentationSurfaceFormats_ = physicalDevice_.getSurfaceFormatsKHR(presentationSurface_);
 		availablePresentationModes_ = physicalDevice_.getSurfacePresentModesKHR(presentationSurface_);
 
-		DebugPrint("Device created.");
+		DebugPrint(isNew ? "Created" : "Joined", " the shared context, viewports: ", context_.use_count());
+		return isNew;
+	}
+
+	void InitFrames()
+	{
+		renderingCommandPool_ = logicalDevice_.createCommandPool(
+			vk::CommandPoolCreateInfo()
+			.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
+			.setQueueFamilyIndex(uint32_t(renderingQueueFamilyIndex_)));
+
+		const auto commandBuffers = logicalDevice_.allocateCommandBuffers(
+			vk::CommandBufferAllocateInfo()
+			.setCommandPool(renderingCommandPool_)
+			.setLevel(vk::CommandBufferLevel::ePrimary)
+			.setCommandBufferCount(uint32_t(frames_.size() * 2)));
+
+		for (size_t i = 0; i < frames_.size(); ++i)
+		{
+			auto& frame = frames_[i];
+			frame.commandBuffer = commandBuffers[i * 2];
+			frame.uploadCommandBuffer = commandBuffers[i * 2 + 1];
+			frame.fence = logicalDevice_.createFence(vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled));
+			frame.imageAvailableSemaphore = logicalDevice_.createSemaphore(vk::SemaphoreCreateInfo());
+			frame.renderFinishedSemaphore = logicalDevice_.createSemaphore(vk::SemaphoreCreateInfo());
+			frame.transientBuffers.emplace(
+				logicalDevice_,
+				*memoryAllocator_,
+				vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eUniformBuffer |
+				vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+				TransientBufferSize);
+		}
+
+		// Vulkan guarantees a power of two, which LinearBufferPool::Allocate() needs.
+		sceneUniformAlignment_ = std::max<vk::DeviceSize>(physicalDevice_.getProperties().limits.minUniformBufferOffsetAlignment, alignof(SceneUniforms));
+		sceneUniformStride_ = (sizeof(SceneUniforms) + sceneUniformAlignment_ - 1) & ~(sceneUniformAlignment_ - 1);
 	}
 
+	[[nodiscard]] static size_t GetTextureSamplerIndex(DWORD PolyFlags, bool clamp)
+	{
+		return (PolyFlags & PF_NoSmooth ? 1 : 0) | (clamp ? 2 : 0);
+	}
 
-	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+	[[nodiscard]] SamplerState GetTextureSamplerState(size_t index) const
 	{
-		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+		const auto limits = physicalDevice_.getProperties().limits;
+
+		SamplerState state;
+		state.nearest = index & 1;
+		state.clamp = index & 2;
+		state.maxAnisotropy = supportsSamplerAnisotropy_
+			                      ? uint8_t(std::clamp(float(settings_.anisotropy), 1.0f, limits.maxSamplerAnisotropy))
+			                      : uint8_t(1);
+		state.lodBias = SamplerState::ToLodBias(std::clamp(settings_.lodBias, -limits.maxSamplerLodBias, limits.maxSamplerLodBias));
+		return state;
+	}
+
+	// All samplers the renderer uses are created here, so draws never create or look one up.
+	void InitSamplers()
+	{
+		const auto limits = physicalDevice_.getProperties().limits;
+		context_->samplerCache.emplace(logicalDevice_, limits.maxSamplerAllocationCount);
+
+		context_->textureSetLayout = CreateSingleDescriptorSetLayout(vk::DescriptorType::eSampledImage, nullptr);
+		context_->samplerSetLayout = CreateSingleDescriptorSetLayout(vk::DescriptorType::eSampler, nullptr);
+
+		// Lightmaps and fogmaps are always filtered and clamped, detail and macro textures filtered and wrapped,
+		// so their samplers are baked into the layout.
+		SamplerState lightmapSamplerState;
+		lightmapSamplerState.clamp = true;
+		const auto lightmapSampler = context_->samplerCache->Get(lightmapSamplerState);
+		const auto layerSampler = context_->samplerCache->Get(GetTextureSamplerState(GetTextureSamplerIndex(0, false)));
+
+		// The layer array gets what the fragment stage has left next to the diffuse and palette textures, the three samplers and the color attachment.
+		// Without dynamic indexing it holds the four layers of one surface.
+		context_->worldLayerCount = 4;
+		if (context_->supportsLayerIndexing)
 		{
-			return capabilities.currentExtent;
+			context_->worldLayerCount = std::min({
+				MaxWorldLayerCount,
+				limits.maxPerStageDescriptorSampledImages - 2,
+				limits.maxDescriptorSetSampledImages - 2,
+				limits.maxPerStageResources - 6});
 		}
-		else
+
+		const auto surfaceBindings = utils::make_array<vk::DescriptorSetLayoutBinding>(
+			vk::DescriptorSetLayoutBinding()
+			.setBinding(0)
+			.setDescriptorType(vk::DescriptorType::eSampledImage)
+			.setDescriptorCount(context_->worldLayerCount)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+			vk::DescriptorSetLayoutBinding()
+			.setBinding(1)
+			.setDescriptorType(vk::DescriptorType::eSampler)
+			.setDescriptorCount(1)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment)
+			.setPImmutableSamplers(&lightmapSampler),
+			vk::DescriptorSetLayoutBinding()
+			.setBinding(2)
+			.setDescriptorType(vk::DescriptorType::eSampler)
+			.setDescriptorCount(1)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment)
+			.setPImmutableSamplers(&layerSampler));
+		context_->surfaceSetLayout = logicalDevice_.createDescriptorSetLayout(
+			vk::DescriptorSetLayoutCreateInfo().setBindingCount(uint32_t(surfaceBindings.size())).setPBindings(surfaceBindings.data()));
+
+		const auto sceneBinding = vk::DescriptorSetLayoutBinding()
+		                          .setBinding(0)
+		                          .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+		                          .setDescriptorCount(1)
+		                          .setStageFlags(vk::ShaderStageFlagBits::eVertex);
+		context_->sceneSetLayout = logicalDevice_.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo().setBindingCount(1).setPBindings(&sceneBinding));
+
+		const auto poolSize = vk::DescriptorPoolSize(vk::DescriptorType::eSampler, uint32_t(TextureSamplerCount));
+		context_->samplerDescriptorPool = logicalDevice_.createDescriptorPool(
+			vk::DescriptorPoolCreateInfo()
+			.setMaxSets(uint32_t(TextureSamplerCount))
+			.setPoolSizeCount(1)
+			.setPPoolSizes(&poolSize));
+
+		const auto setLayouts = std::vector<vk::DescriptorSetLayout>(TextureSamplerCount, context_->samplerSetLayout);
+		const auto descriptorSets = logicalDevice_.allocateDescriptorSets(
+			vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(context_->samplerDescriptorPool)
+			.setDescriptorSetCount(uint32_t(setLayouts.size()))
+			.setPSetLayouts(setLayouts.data()));
+
+		for (size_t i = 0; i < TextureSamplerCount; ++i)
 		{
-			// This case was simply copy-pasted from https://vulkan-tutorial.com/en/Drawing_a_triangle/Presentation/Swap_chain
-			// So it makes sense to rewrite it
-			VkExtent2D actualExtent = {640, 480};
+			context_->samplerDescriptorSets[i] = descriptorSets[i];
+
+			const auto imageInfo = vk::DescriptorImageInfo().setSampler(context_->samplerCache->Get(GetTextureSamplerState(i)));
+			logicalDevice_.updateDescriptorSets(
+				vk::WriteDescriptorSet()
+				.setDstSet(context_->samplerDescriptorSets[i])
+				.setDstBinding(0)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eSampler)
+				.setPImageInfo(&imageInfo),
+				nullptr);
+		}
 
-			actualExtent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actualExtent.width));
-			actualExtent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actualExtent.height));
+		DebugPrint(
+			"Created ",
+			context_->samplerCache->GetCount(),
+			" samplers, device limit is ",
+			limits.maxSamplerAllocationCount,
+			"; world layer textures per flush: ",
+			context_->worldLayerCount);
+	}
 
-			return actualExtent;
-		}
+	void InitWhiteTexture()
+	{
+		context_->whiteTexture.emplace(logicalDevice_, *memoryAllocator_, vk::Format::eR8G8B8A8Unorm, vk::Extent2D(1, 1), 1);
+
+		const auto commandBuffer = GetUploadCommandBuffer();
+		context_->whiteTexture->BeginUpload(commandBuffer);
+		const uint32_t white = 0xFFFFFFFFu;
+		std::memcpy(context_->whiteTexture->UploadMip(commandBuffer, *frames_[currentFrameIndex_].transientBuffers, 0), &white, sizeof(white));
+		context_->whiteTexture->EndUpload(commandBuffer, 1);
 	}
 
+	void InitPaletteTable()
+	{
+		if (settings_.paletteIndexedTextures)
+			context_->paletteTable.emplace(logicalDevice_, *memoryAllocator_, GetUploadCommandBuffer(), *frames_[currentFrameIndex_].transientBuffers);
+
+		// Shaders declare the set whether or not they look anything up in it.
+		context_->paletteDescriptorSet = AllocateTextureDescriptorSet(context_->paletteTable ? context_->paletteTable->GetView() : context_->whiteTexture->GetView());
+	}
 
-	void InitSwapChain()
+	[[nodiscard]] vk::DescriptorSetLayout CreateSingleDescriptorSetLayout(vk::DescriptorType type, const vk::Sampler* immutableSampler) const
 	{
-		const auto preferredFormat = utils::maybeFirst(
-			availablePresentationSurfaceFormats_,
-			[](const vk::SurfaceFormatKHR& format)
-			{
-				return format.format == vk::Format::eB8G8R8A8Unorm && format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
-			});
+		const auto binding = vk::DescriptorSetLayoutBinding()
+		                     .setBinding(0)
+		                     .setDescriptorType(type)
+		                     .setDescriptorCount(1)
+		                     .setStageFlags(vk::ShaderStageFlagBits::eFragment)
+		                     .setPImmutableSamplers(immutableSampler);
+
+		return logicalDevice_.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo().setBindingCount(1).setPBindings(&binding));
+	}
 
-		const auto extent = chooseSwapExtent(presentationSurfaceCaps_);
+	// Waits until the GPU is done with the current frame's previous use. Called by whichever comes first: Lock() or an upload.
+	FrameContext& PrepareFrame()
+	{
+		auto& frame = frames_[currentFrameIndex_];
+		if (frame.isPrepared)
+			return frame;
 
-		const size_t imageCount = settings_.presentationMode == PresentationMode::VSyncTripleBuffering ? 3 : 2;
+		(void)logicalDevice_.waitForFences(frame.fence, true, std::numeric_limits<uint64_t>::max());
+		context_->deletionQueue.Retire(frame.serial);
 
-		vk::SwapchainCreateInfoKHR swapChainCreateInfo;
+		if (frame.hasTimestamps)
+		{
+			UpdateGpuFrameTime();
+			frame.hasTimestamps = false;
+		}
+
+		if (frame.isLatencyPending)
+			RecordLatency(frame);
+
+		frame.transientBuffers->Reset();
+		for (size_t i = 0; i < frame.usedDescriptorPoolCount; ++i)
+			logicalDevice_.resetDescriptorPool(frame.descriptorPools[i]);
+		frame.usedDescriptorPoolCount = 0;
+		frame.isPrepared = true;
+
+		return frame;
+	}
+
+	vk::CommandBuffer GetUploadCommandBuffer()
+	{
+		auto& frame = PrepareFrame();
+		if (!frame.hasUploads)
+		{
+			frame.uploadCommandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+			BeginLabel(frame.uploadCommandBuffer, "Uploads");
+			frame.hasUploads = true;
+			SetRecording(true);
+		}
+
+		return frame.uploadCommandBuffer;
+	}
+
+	/**
+	Submits the uploads recorded outside of a frame on their own, for another viewport that is about to draw the textures they fill.
+	The frame's fence tracks them, so its next use waits for them; see PrepareFrame().
+	*/
+	void SubmitUploads()
+	{
+		auto& frame = frames_[currentFrameIndex_];
+		if (isLocked_ || !frame.hasUploads)
+			return;
+
+		EndLabel(frame.uploadCommandBuffer);
+		frame.uploadCommandBuffer.end();
+
+		// The fence was waited on when the frame was prepared and has not been reset since.
+		frame.serial = context_->deletionQueue.Submit();
+		logicalDevice_.resetFences(frame.fence);
+		renderingQueue_.submit(vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(&frame.uploadCommandBuffer), frame.fence);
+
+		frame.hasUploads = false;
+		frame.isPrepared = false;
+		SetRecording(false);
+	}
+
+	// Keeps SharedContext::recordingViewports up to date.
+	void SetRecording(bool recording)
+	{
+		auto& viewports = context_->recordingViewports;
+		const auto it = std::find(viewports.begin(), viewports.end(), this);
+		if (recording && it == viewports.end())
+			viewports.push_back(this);
+		else if (!recording && it != viewports.end())
+			viewports.erase(it);
+	}
+
+	[[nodiscard]] std::optional<vk::Format> GetTextureFormat(const FTextureInfo& Info) const
+	{
+		switch (Info.Format)
+		{
+		case TEXF_P8:
+			return vk::Format::eR8G8B8A8Unorm;
+		case TEXF_RGBA7:
+		case TEXF_RGBA8:
+			return vk::Format::eB8G8R8A8Unorm;
+		case TEXF_DXT1:
+			return supportsTextureCompressionBC_ ? vk::Format::eBc1RgbaUnormBlock : vk::Format::eR8G8B8A8Unorm;
+		default:
+			return std::nullopt;
+		}
+	}
+
+	/**
+	Returns the texture for Info, uploading it if it is not cached yet or its contents changed.
+	\return nullptr for formats the renderer does not support.
+	*/
+	const CachedTexture* CacheTexture(FTextureInfo& Info, DWORD PolyFlags)
+	{
+		const bool masked = Info.Format == TEXF_P8 && (PolyFlags & PF_Masked);
+
+		auto it = context_->textureCache.find(Info.CacheID);
+		if (it == context_->textureCache.end() && context_->precachedTextureIds.count(Info.CacheID) != 0)
+		{
+			// The first draw that needs a precached texture is a join point too, should the game draw before Lock().
+			FinishPrecache();
+			it = context_->textureCache.find(Info.CacheID);
+		}
+		// A reused cache ID may describe another image; uploading into the old one would overrun it.
+		if (it != context_->textureCache.end() && (Info.bRealtimeChanged || it->second.masked != masked) && !MatchesCachedTexture(Info, it->second))
+		{
+			RetireTexture(std::move(it->second.texture));
+			context_->textureCache.erase(it);
+			it = context_->textureCache.end();
+		}
+
+		if (it != context_->textureCache.end() && it->second.paletteRow)
+		{
+			if (Info.bRealtimeChanged)
+				UpdatePaletteIndexedTexture(Info, it->second);
+			Info.bRealtimeChanged = 0;
+			return &it->second;
+		}
+
+		if (it != context_->textureCache.end() && !Info.bRealtimeChanged && it->second.masked == masked)
+			return &it->second;
+
+		if (it == context_->textureCache.end() && context_->paletteTable && Info.Format == TEXF_P8)
+		{
+			// Falls back to RGBA when the palette table is full.
+			if (auto* cachedTexture = CachePaletteIndexedTexture(Info, masked))
+				return cachedTexture;
+		}
+
+		const auto format = GetTextureFormat(Info);
+		if (!format)
+			return nullptr;
+
+		const auto extent = vk::Extent2D(Info.Mips[0]->USize, Info.Mips[0]->VSize);
+		auto& cachedTexture = it != context_->textureCache.end()
+			                      ? it->second
+			                      : CreateCachedTexture(Info, *format, extent, uint32_t(Info.NumMips), masked);
+
+		Info.bRealtimeChanged = 0;
+
+		// Dynamic lights make the engine regenerate lightmaps and flag them as changed, often with the same result as before.
+		const auto sourceHash = GetSourceHash(Info, extent, std::min(cachedTexture.texture.GetMipCount(), uint32_t(Info.NumMips)));
+		if (it != context_->textureCache.end() && cachedTexture.masked == masked && cachedTexture.sourceHash == sourceHash)
+		{
+			++drawStatistics_.unchangedTextureUploads;
+			return &cachedTexture;
+		}
+
+		// Masking only changes palette entry 0, so a texture cached with the wrong flag keeps its image and is just reuploaded.
+		cachedTexture.masked = masked;
+		cachedTexture.sourceHash = sourceHash;
+		UploadTexture(Info, cachedTexture.texture, masked);
+		++drawStatistics_.textureUploads;
+
+		return &cachedTexture;
+	}
+
+	/**
+	Stores the game's indices as they are and the palette as a PaletteTable row, a quarter of the memory of an RGBA copy.
+	Textures with animated contents get a row of their own that palette changes rewrite; all others share rows by palette contents.
+	\return nullptr when the palette table is full.
+	*/
+	const CachedTexture* CachePaletteIndexedTexture(const FTextureInfo& Info, bool masked)
+	{
+		uint32_t palette[256];
+		CopyPalette(Info, palette);
+		const auto paletteHash = TextureDiskCache::Hash(palette, sizeof(palette));
+
+		const auto commandBuffer = GetUploadCommandBuffer();
+		auto& staging = *frames_[currentFrameIndex_].transientBuffers;
+
+		const bool ownsRow = Info.bRealtime;
+		const auto row = ownsRow ? context_->paletteTable->AllocatePrivateRow() : context_->paletteTable->GetSharedRow(paletteHash, palette, commandBuffer, staging);
+		if (!row)
+			return nullptr;
+		if (ownsRow)
+			context_->paletteTable->WriteRow(*row, palette, commandBuffer, staging);
+
+		// Averaging indices makes no sense, so only the mips the game provides exist.
+		const auto extent = vk::Extent2D(Info.Mips[0]->USize, Info.Mips[0]->VSize);
+		auto& cachedTexture = context_->textureCache.emplace(
+			Info.CacheID,
+			CachedTexture{
+				Texture(
+					logicalDevice_,
+					*memoryAllocator_,
+					vk::Format::eR8Unorm,
+					extent,
+					std::min(uint32_t(Info.NumMips), Texture::GetFullMipCount(extent))),
+				masked
+			}).first->second;
+
+		cachedTexture.descriptorSet = AllocateTextureDescriptorSet(cachedTexture.texture.GetView());
+		NameObject(vk::ObjectType::eImage, cachedTexture.texture.GetImage(), [&] { return GetTextureDebugName(Info) + " (indices)"; });
+		cachedTexture.paletteRow = row;
+		cachedTexture.ownsPaletteRow = ownsRow;
+		cachedTexture.paletteHash = paletteHash;
+		cachedTexture.sourceHash = GetSourceHash(Info, extent, cachedTexture.texture.GetMipCount());
+		UploadIndices(Info, cachedTexture.texture);
+		++drawStatistics_.textureUploads;
+
+		return &cachedTexture;
+	}
+
+	// A palette change costs a row upload; the indices are only uploaded again when they changed too.
+	void UpdatePaletteIndexedTexture(const FTextureInfo& Info, CachedTexture& cachedTexture)
+	{
+		uint32_t palette[256];
+		CopyPalette(Info, palette);
+		const auto paletteHash = TextureDiskCache::Hash(palette, sizeof(palette));
+
+		const auto commandBuffer = GetUploadCommandBuffer();
+		auto& staging = *frames_[currentFrameIndex_].transientBuffers;
+
+		if (paletteHash != cachedTexture.paletteHash)
+		{
+			if (cachedTexture.ownsPaletteRow)
+				context_->paletteTable->WriteRow(*cachedTexture.paletteRow, palette, commandBuffer, staging);
+			else if (const auto row = context_->paletteTable->GetSharedRow(paletteHash, palette, commandBuffer, staging))
+				cachedTexture.paletteRow = row;
+			// With the table full, the texture keeps its old palette.
+
+			cachedTexture.paletteHash = paletteHash;
+		}
+
+		const auto sourceHash = GetSourceHash(Info, cachedTexture.texture.GetExtent(), cachedTexture.texture.GetMipCount());
+		if (sourceHash == cachedTexture.sourceHash)
+		{
+			++drawStatistics_.unchangedTextureUploads;
+			return;
+		}
+
+		UploadIndices(Info, cachedTexture.texture);
+		cachedTexture.sourceHash = sourceHash;
+		++drawStatistics_.textureUploads;
+	}
+
+	// Tells revisions of a texture apart; hashing is far cheaper than uploading.
+	[[nodiscard]] static uint64_t GetSourceHash(const FTextureInfo& Info, vk::Extent2D extent, uint32_t mipCount)
+	{
+		uint64_t hash = 0;
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+			hash = TextureDiskCache::Hash(Info.Mips[mip]->DataPtr, GetSourceMipSize(Info, Texture::GetMipExtent(extent, mip)), hash);
+		return hash;
+	}
+
+	void UploadIndices(const FTextureInfo& Info, const Texture& texture)
+	{
+		const auto commandBuffer = GetUploadCommandBuffer();
+		auto& staging = *frames_[currentFrameIndex_].transientBuffers;
+
+		texture.BeginUpload(commandBuffer);
+		for (uint32_t mip = 0; mip < texture.GetMipCount(); ++mip)
+			std::memcpy(texture.UploadMip(commandBuffer, staging, mip), Info.Mips[mip]->DataPtr, texture.GetMipSize(mip));
+		texture.EndUpload(commandBuffer, texture.GetMipCount());
+	}
+
+	// Incomplete mip chains (lightmaps, scripted textures, single-mip imports) are completed on the GPU, see UploadTexture().
+	[[nodiscard]] uint32_t GetCachedMipCount(vk::Format format, vk::Extent2D extent, uint32_t providedMipCount) const
+	{
+		const auto fullMipCount = Texture::GetFullMipCount(extent);
+		return providedMipCount < fullMipCount && SupportsMipGeneration(format) ? fullMipCount : std::min(providedMipCount, fullMipCount);
+	}
+
+	// Whether the entry's image is the one CacheTexture() would create for Info now.
+	[[nodiscard]] bool MatchesCachedTexture(const FTextureInfo& Info, const CachedTexture& cachedTexture) const
+	{
+		const auto& texture = cachedTexture.texture;
+		const auto extent = vk::Extent2D(Info.Mips[0]->USize, Info.Mips[0]->VSize);
+		if (texture.GetExtent() != extent)
+			return false;
+
+		if (cachedTexture.paletteRow)
+			return Info.Format == TEXF_P8 && texture.GetMipCount() == std::min(uint32_t(Info.NumMips), Texture::GetFullMipCount(extent));
+
+		const auto format = GetTextureFormat(Info);
+		return format == texture.GetFormat() && texture.GetMipCount() == GetCachedMipCount(*format, extent, uint32_t(Info.NumMips));
+	}
+
+	CachedTexture& CreateCachedTexture(const FTextureInfo& Info, vk::Format format, vk::Extent2D extent, uint32_t providedMipCount, bool masked)
+	{
+		const auto mipCount = GetCachedMipCount(format, extent, providedMipCount);
+		const bool generateMips = mipCount > providedMipCount;
+
+		auto& cachedTexture = context_->textureCache.emplace(
+			Info.CacheID,
+			CachedTexture{
+				Texture(
+					logicalDevice_,
+					*memoryAllocator_,
+					format,
+					extent,
+					mipCount,
+					generateMips ? vk::ImageUsageFlagBits::eTransferSrc : vk::ImageUsageFlags()),
+				masked
+			}).first->second;
+
+		cachedTexture.descriptorSet = AllocateTextureDescriptorSet(cachedTexture.texture.GetView());
+		NameObject(vk::ObjectType::eImage, cachedTexture.texture.GetImage(), [&] { return GetTextureDebugName(Info); });
+		return cachedTexture;
+	}
+
+	[[nodiscard]] vk::DescriptorSet AllocateTextureDescriptorSet(vk::ImageView view)
+	{
+		std::optional<vk::DescriptorSet> descriptorSet;
+		if (!context_->textureDescriptorPools.empty())
+		{
+			try
+			{
+				descriptorSet = logicalDevice_.allocateDescriptorSets(
+					vk::DescriptorSetAllocateInfo()
+					.setDescriptorPool(context_->textureDescriptorPools.back())
+					.setDescriptorSetCount(1)
+					.setPSetLayouts(&context_->textureSetLayout)).front();
+			}
+			catch (const vk::OutOfPoolMemoryError&)
+			{
+			}
+		}
+
+		if (!descriptorSet)
+		{
+			const auto poolSize = vk::DescriptorPoolSize(vk::DescriptorType::eSampledImage, TextureDescriptorPoolSize);
+			context_->textureDescriptorPools.push_back(
+				logicalDevice_.createDescriptorPool(
+					vk::DescriptorPoolCreateInfo()
+					.setMaxSets(TextureDescriptorPoolSize)
+					.setPoolSizeCount(1)
+					.setPPoolSizes(&poolSize)));
+
+			descriptorSet = logicalDevice_.allocateDescriptorSets(
+				vk::DescriptorSetAllocateInfo()
+				.setDescriptorPool(context_->textureDescriptorPools.back())
+				.setDescriptorSetCount(1)
+				.setPSetLayouts(&context_->textureSetLayout)).front();
+		}
+
+		const auto imageInfo = vk::DescriptorImageInfo().setImageView(view).setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+		logicalDevice_.updateDescriptorSets(
+			vk::WriteDescriptorSet()
+			.setDstSet(*descriptorSet)
+			.setDstBinding(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eSampledImage)
+			.setPImageInfo(&imageInfo),
+			nullptr);
+
+		return *descriptorSet;
+	}
+
+	[[nodiscard]] vk::DescriptorSet AllocateFrameDescriptorSet(vk::DescriptorSetLayout layout)
+	{
+		auto& frame = frames_[currentFrameIndex_];
+
+		if (frame.usedDescriptorPoolCount > 0)
+		{
+			try
+			{
+				return logicalDevice_.allocateDescriptorSets(
+					vk::DescriptorSetAllocateInfo()
+					.setDescriptorPool(frame.descriptorPools[frame.usedDescriptorPoolCount - 1])
+					.setDescriptorSetCount(1)
+					.setPSetLayouts(&layout)).front();
+			}
+			catch (const vk::OutOfPoolMemoryError&)
+			{
+			}
+		}
+
+		if (frame.usedDescriptorPoolCount == frame.descriptorPools.size())
+		{
+			// World layer sets with their immutable samplers, composite sets, and the blocks of the scene uniform ring.
+			const auto poolSizes = utils::make_array<vk::DescriptorPoolSize>(
+				vk::DescriptorPoolSize(vk::DescriptorType::eSampledImage, FrameDescriptorPoolSize * 16),
+				vk::DescriptorPoolSize(vk::DescriptorType::eSampler, FrameDescriptorPoolSize / 2),
+				vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, FrameDescriptorPoolSize / 4),
+				vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, FrameDescriptorPoolSize / 4));
+			frame.descriptorPools.push_back(
+				logicalDevice_.createDescriptorPool(
+					vk::DescriptorPoolCreateInfo()
+					.setMaxSets(FrameDescriptorPoolSize)
+					.setPoolSizeCount(uint32_t(poolSizes.size()))
+					.setPPoolSizes(poolSizes.data())));
+		}
+
+		return logicalDevice_.allocateDescriptorSets(
+			vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(frame.descriptorPools[frame.usedDescriptorPoolCount++])
+			.setDescriptorSetCount(1)
+			.setPSetLayouts(&layout)).front();
+	}
+
+	// The pan offset is in units of the layer's scale.
+	static void SetSurfaceLayer(SurfaceParameters& parameters, size_t layer, const FTextureInfo& Info, float panOffset)
+	{
+		parameters.layers[layer][0] = Info.Pan.X + panOffset * Info.UScale;
+		parameters.layers[layer][1] = Info.Pan.Y + panOffset * Info.VScale;
+		parameters.layers[layer][2] = 1.0f / (Info.UScale * float(Info.USize));
+		parameters.layers[layer][3] = 1.0f / (Info.VScale * float(Info.VSize));
+	}
+
+	// See polyflags.h.
+	[[nodiscard]] static bool IsFogged(DWORD PolyFlags)
+	{
+#ifdef RUNE
+		constexpr DWORD ExcludingFlags = PF_Translucent | PF_Modulated | PF_AlphaBlend;
+#else
+		constexpr DWORD ExcludingFlags = PF_Translucent | PF_Modulated;
+#endif
+		return (PolyFlags & (PF_RenderFog | ExcludingFlags)) == PF_RenderFog;
+	}
+
+	[[nodiscard]] DrawParameters GetDrawParameters(DWORD PolyFlags) const
+	{
+#ifdef RUNE
+		constexpr DWORD BlendedFlags = PF_Translucent | PF_AlphaBlend;
+#else
+		constexpr DWORD BlendedFlags = PF_Translucent;
+#endif
+		DrawParameters parameters{};
+		parameters.flags = (PolyFlags & PF_Masked) && !(PolyFlags & BlendedFlags) ? DrawFlagAlphaTest : 0;
+		if (PolyFlags & PF_Masked)
+			parameters.flags |= DrawFlagMasked;
+		if (settings_.paletteBilinearFilter && !(PolyFlags & PF_NoSmooth))
+			parameters.flags |= DrawFlagPaletteBilinear;
+
+		parameters.distanceFogScale = distanceFog_.scale;
+		std::memcpy(parameters.distanceFogColor, distanceFog_.color, sizeof(parameters.distanceFogColor));
+
+		// Blended polygons fade to the color that leaves the destination unchanged instead of to the fog color.
+		const auto blendMode = PipelineState::FromPolyFlags(PolyFlags).blendMode;
+		if (blendMode == BlendMode::Translucent)
+			std::fill(std::begin(parameters.distanceFogColor), std::end(parameters.distanceFogColor), 0.0f);
+		else if (blendMode == BlendMode::Modulated)
+			std::fill(std::begin(parameters.distanceFogColor), std::end(parameters.distanceFogColor), 0.5f);
+
+		return parameters;
+	}
+
+	// Only the diffuse, detail and macro layers (0, 3 and 4) can be palette-indexed; lightmaps and fogmaps are never P8.
+	static void SetPaletteLayer(DrawParameters& parameters, const CachedTexture& texture, uint32_t layer)
+	{
+		if (!texture.paletteRow)
+			return;
+
+		const auto slot = layer == 0 ? 0 : layer - 2;
+		parameters.flags |= DrawFlagDiffusePalette << slot;
+		parameters.paletteRows |= *texture.paletteRow << (slot * PaletteTable::RowBits);
+	}
+
+	// Makes Frame the current scene node. DrawTile() calls it for every tile, so an unchanged node costs a few comparisons only.
+	void SetScene(const FSceneNode& Frame)
+	{
+		const auto fovAngle = Frame.Viewport->Actor->FovAngle;
+		const auto viewport = vk::Rect2D({Frame.XB, Frame.YB}, {uint32_t(Frame.X), uint32_t(Frame.Y)});
+		if (sceneFovAngle_ == fovAngle && sceneViewport_ == viewport && sceneUniforms_.viewport[0] == Frame.FX2 &&
+			sceneUniforms_.viewport[1] == Frame.FY2)
+		{
+			return;
+		}
+
+		// Batched draws bind the scene node current when they are flushed.
+		FlushBatches();
+
+		SetViewport(viewport.offset.x, viewport.offset.y, viewport.extent.width, viewport.extent.height);
+		sceneFovAngle_ = fovAngle;
+
+		// View space to clip space; x and y are divided by z in hardware, depth maps [ZNear, ZFar] to [0, 1].
+		auto& uniforms = sceneUniforms_;
+		const auto projectionZ = std::tan(fovAngle * float(PI) / 360.0f);
+		uniforms.projection[0] = 1.0f / projectionZ;
+		uniforms.projection[1] = Frame.FX / (Frame.FY * projectionZ);
+		uniforms.projection[2] = ZFar / (ZFar - ZNear);
+		uniforms.projection[3] = -ZNear * ZFar / (ZFar - ZNear);
+		uniforms.viewport[0] = Frame.FX2;
+		uniforms.viewport[1] = Frame.FY2;
+		uniforms.viewport[2] = 1.0f / Frame.FX2;
+		uniforms.viewport[3] = 1.0f / Frame.FY2;
+		uniforms.nearDepth = ZNear;
+
+		WriteSceneUniforms();
+		++drawStatistics_.sceneNodes;
+	}
+
+	/**
+	Copies sceneUniforms_ into the next record of the frame's scene uniform ring and makes it current. The ring is a list of blocks of
+	SceneUniformBlockSize records in the transient buffers, each with a descriptor set from the frame's pools, so it lives exactly as
+	long as the frame; BindPipelineState() binds it.
+	*/
+	void WriteSceneUniforms()
+	{
+		if (sceneUniformBlockUsedCount_ == SceneUniformBlockSize)
+		{
+			sceneUniformBlock_ = frames_[currentFrameIndex_].transientBuffers->Allocate(
+				sceneUniformStride_ * SceneUniformBlockSize,
+				sceneUniformAlignment_);
+			sceneUniformSet_ = AllocateFrameDescriptorSet(context_->sceneSetLayout);
+			sceneUniformBlockUsedCount_ = 0;
+
+			const auto bufferInfo = vk::DescriptorBufferInfo(sceneUniformBlock_.buffer, sceneUniformBlock_.offset, sizeof(SceneUniforms));
+			logicalDevice_.updateDescriptorSets(
+				vk::WriteDescriptorSet()
+				.setDstSet(sceneUniformSet_)
+				.setDstBinding(0)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+				.setPBufferInfo(&bufferInfo),
+				nullptr);
+		}
+
+		sceneUniformOffset_ = uint32_t(sceneUniformBlockUsedCount_++ * sceneUniformStride_);
+		std::memcpy(static_cast<uint8_t*>(sceneUniformBlock_.data) + sceneUniformOffset_, &sceneUniforms_, sizeof(SceneUniforms));
+	}
+
+	void FlushBatches()
+	{
+		FlushWorldQueue();
+		FlushGouraudBatch();
+		FlushTileBatch();
+		FlushColorBatch(fogSurfaceBatch_);
+		FlushLineBatch();
+	}
+
+	// Index into LineBatch by the flags that change the pipeline state.
+	[[nodiscard]] static size_t GetLineBatchIndex(DWORD LineFlags)
+	{
+		return (LineFlags & LINE_Transparent ? 1 : 0) | (LineFlags & LINE_DepthCued ? 2 : 0);
+	}
+
+	// Lines never write depth, so they do not hide each other or the geometry drawn after them.
+	[[nodiscard]] static PipelineState GetLineState(size_t batchIndex)
+	{
+		PipelineState state;
+		state.blendMode = batchIndex & 1 ? BlendMode::Translucent : BlendMode::Opaque;
+		state.depthWrite = false;
+		state.twoSided = true;
+		state.depthCompare = batchIndex & 2 ? vk::CompareOp::eLessOrEqual : vk::CompareOp::eAlways;
+		return state;
+	}
+
+	// The editor leaves alpha at 0.
+	[[nodiscard]] static uint32_t GetLineColor(const FPlane& Color)
+	{
+		const float rgba[4] = {Color.X, Color.Y, Color.Z, 1.0f};
+		return vertex_packing::ToColor(rgba);
+	}
+
+	// Pixels of the scene node back to view space, so that the scene node's projection puts the point on the same pixel.
+	void UnprojectPixel(const FSceneNode& Frame, float x, float y, float z, float* position) const
+	{
+		// Orthogonal views send depths outside the clip range.
+		z = std::clamp(z, ZNear, ZFar);
+
+		position[0] = (x - Frame.FX2) / Frame.FX2 * z / sceneUniforms_.projection[0];
+		position[1] = (y - Frame.FY2) / Frame.FY2 * z / sceneUniforms_.projection[1];
+		position[2] = z;
+	}
+
+	// Lines share color.vert and the hit batch with view space geometry, so they are unprojected like tiles' hit vertices.
+	[[nodiscard]] vertex_packing::ColorVertex GetLineVertex(const FSceneNode& Frame, float x, float y, float z, uint32_t color) const
+	{
+		vertex_packing::ColorVertex vertex;
+		UnprojectPixel(Frame, x, y, z, vertex.position);
+		vertex.color = color;
+		return vertex;
+	}
+
+	void FlushLineBatch()
+	{
+		for (size_t i = 0; i < lineBatch_.lines.size(); ++i)
+		{
+			auto& lines = lineBatch_.lines[i];
+			auto& points = lineBatch_.points[i];
+			if (lines.empty() && points.empty())
+				continue;
+
+			const auto commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+			BeginLabel(commandBuffer, "Editor lines");
+			const auto state = GetLineState(i);
+			if (!points.empty())
+			{
+				const auto& pipeline = BindPipelineState(SceneProgram::Color, state);
+				PushParameters(pipeline, DrawParameters{});
+				Draw(points);
+				points.clear();
+			}
+			if (!lines.empty())
+			{
+				const auto& pipeline = BindPipelineState(SceneProgram::Line, state);
+				PushParameters(pipeline, DrawParameters{});
+				Draw(lines);
+				lines.clear();
+			}
+			EndLabel(commandBuffer);
+		}
+	}
+
+	/**
+	Adds a surface to the bucket of its state. Opaque surfaces write depth, so their order does not matter and they join any bucket
+	opened since the last blended surface. Blended surfaces keep their order: they only join the last bucket.
+	\note Surfaces of the depth pre-pass count as opaque: their depth is already written.
+	*/
+	void QueueWorldDraw(
+		const PipelineState& state,
+		DWORD PolyFlags,
+		vk::DescriptorSet diffuseSet,
+		size_t samplerIndex,
+		const vk::DrawIndexedIndirectCommand& command)
+	{
+		auto& queue = worldQueue_;
+		const bool opaque = state.blendMode == BlendMode::Opaque && (state.depthWrite || state.depthCompare == vk::CompareOp::eEqual);
+		const auto key = WorldQueue::BucketKey(state.GetKey(false), diffuseSet, samplerIndex);
+
+		std::optional<size_t> bucketIndex;
+		if (opaque)
+		{
+			const auto it = queue.openBuckets.find(key);
+			if (it != queue.openBuckets.end())
+				bucketIndex = it->second;
+		}
+		else
+		{
+			if (queue.bucketCount > 0)
+			{
+				const auto& last = queue.buckets[queue.bucketCount - 1];
+				if (WorldQueue::BucketKey(last.state.GetKey(false), last.diffuseSet, last.samplerIndex) == key)
+					bucketIndex = queue.bucketCount - 1;
+			}
+			queue.openBuckets.clear();
+		}
+
+		if (!bucketIndex)
+		{
+			bucketIndex = queue.bucketCount++;
+			if (queue.buckets.size() < queue.bucketCount)
+				queue.buckets.emplace_back();
+
+			auto& bucket = queue.buckets[*bucketIndex];
+			bucket.state = state;
+			bucket.polyFlags = PolyFlags;
+			bucket.diffuseSet = diffuseSet;
+			bucket.samplerIndex = samplerIndex;
+			bucket.commands.clear();
+
+			if (opaque)
+				queue.openBuckets.emplace(key, *bucketIndex);
+		}
+
+		queue.buckets[*bucketIndex].commands.push_back(command);
+	}
+
+	// Draws the queued surfaces with one vkCmdDrawIndexedIndirect per bucket, sharing one vertex, index and surface buffer.
+	void FlushWorldQueue()
+	{
+		auto& queue = worldQueue_;
+		if (queue.bucketCount == 0)
+			return;
+
+		auto& frame = frames_[currentFrameIndex_];
+		auto& transientBuffers = *frame.transientBuffers;
+
+		const auto vertexDataSize = queue.vertices.size() * sizeof(vertex_packing::SurfaceVertex);
+		const auto vertices = transientBuffers.Allocate(vertexDataSize, sizeof(float));
+		std::memcpy(vertices.data, queue.vertices.data(), vertexDataSize);
+
+		const auto surfaceDataSize = queue.surfaces.size() * sizeof(SurfaceParameters);
+		const auto surfaces = transientBuffers.Allocate(surfaceDataSize, sizeof(float));
+		std::memcpy(surfaces.data, queue.surfaces.data(), surfaceDataSize);
+
+		const auto indexDataSize = queue.indices.size() * sizeof(uint16_t);
+		const auto indices = transientBuffers.Allocate(indexDataSize, sizeof(uint32_t));
+		std::memcpy(indices.data, queue.indices.data(), indexDataSize);
+
+		// The depth pre-pass commands come first, then the commands of each bucket, contiguous and in bucket order.
+		TransientAllocation commands{};
+		if (supportsMultiDrawIndirect_)
+		{
+			size_t commandCount = queue.depthCommands[0].size() + queue.depthCommands[1].size();
+			for (size_t i = 0; i < queue.bucketCount; ++i)
+				commandCount += queue.buckets[i].commands.size();
+
+			commands = transientBuffers.Allocate(commandCount * sizeof(vk::DrawIndexedIndirectCommand), sizeof(uint32_t));
+			auto* destination = reinterpret_cast<vk::DrawIndexedIndirectCommand*>(commands.data);
+			for (const auto& depthCommands : queue.depthCommands)
+				destination = std::copy(depthCommands.begin(), depthCommands.end(), destination);
+			for (size_t i = 0; i < queue.bucketCount; ++i)
+				destination = std::copy(queue.buckets[i].commands.begin(), queue.buckets[i].commands.end(), destination);
+		}
+
+		const auto layerSet = AllocateWorldLayerDescriptorSet();
+
+		const auto commandBuffer = frame.commandBuffer;
+		BeginLabel(commandBuffer, "World surfaces");
+		commandBuffer.bindVertexBuffers(
+			0,
+			utils::make_array<vk::Buffer>(vertices.buffer, surfaces.buffer),
+			utils::make_array<vk::DeviceSize>(vertices.offset, surfaces.offset));
+		commandBuffer.bindIndexBuffer(indices.buffer, indices.offset, vk::IndexType::eUint16);
+
+		auto commandOffset = commands.offset;
+
+		// Depth first, so that the buckets below shade each pixel of these surfaces once, with an equal depth test.
+		if (!queue.depthCommands[0].empty() || !queue.depthCommands[1].empty())
+		{
+			BeginLabel(commandBuffer, "Depth pre-pass");
+			for (size_t twoSided = 0; twoSided < queue.depthCommands.size(); ++twoSided)
+			{
+				auto& depthCommands = queue.depthCommands[twoSided];
+				if (depthCommands.empty())
+					continue;
+
+				(void)BindPipelineState(SceneProgram::WorldDepth, GetDepthPrePassState(twoSided != 0));
+				DrawWorldCommands(depthCommands, commands, commandOffset);
+				drawStatistics_.depthPrePassDraws += uint32_t(depthCommands.size());
+				depthCommands.clear();
+			}
+			EndLabel(commandBuffer);
+		}
+
+		for (size_t i = 0; i < queue.bucketCount; ++i)
+		{
+			const auto& bucket = queue.buckets[i];
+
+			const auto& pipeline = BindPipelineState(SceneProgram::World, bucket.state);
+			const auto descriptorSets = utils::make_array<vk::DescriptorSet>(
+				bucket.diffuseSet,
+				context_->samplerDescriptorSets[bucket.samplerIndex],
+				layerSet);
+			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.GetLayout(), 0, descriptorSets, nullptr);
+			PushParameters(pipeline, GetDrawParameters(bucket.polyFlags));
+			DrawWorldCommands(bucket.commands, commands, commandOffset);
+
+			drawStatistics_.worldDraws += uint32_t(bucket.commands.size());
+		}
+		EndLabel(commandBuffer);
+
+		queue.vertices.clear();
+		queue.indices.clear();
+		queue.surfaces.clear();
+		queue.bucketCount = 0;
+		queue.openBuckets.clear();
+		queue.layerViews.clear();
+		queue.layerIndices.clear();
+	}
+
+	/**
+	Draws world surfaces with the pipeline that is bound: with multi-draw-indirect from their copy in the indirect buffer, otherwise one by one.
+	\param commandOffset Of their copy in indirectCommands; advanced past them.
+	*/
+	void DrawWorldCommands(
+		const std::vector<vk::DrawIndexedIndirectCommand>& worldCommands,
+		const TransientAllocation& indirectCommands,
+		vk::DeviceSize& commandOffset)
+	{
+		const auto commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+
+		if (supportsMultiDrawIndirect_)
+		{
+			for (size_t first = 0; first < worldCommands.size(); first += maxDrawIndirectCount_)
+			{
+				const auto count = uint32_t(std::min<size_t>(worldCommands.size() - first, maxDrawIndirectCount_));
+				commandBuffer.drawIndexedIndirect(
+					indirectCommands.buffer,
+					commandOffset + first * sizeof(vk::DrawIndexedIndirectCommand),
+					count,
+					sizeof(vk::DrawIndexedIndirectCommand));
+				++drawStatistics_.worldSubmissions;
+			}
+			commandOffset += worldCommands.size() * sizeof(vk::DrawIndexedIndirectCommand);
+		}
+		else
+		{
+			for (const auto& command : worldCommands)
+			{
+				commandBuffer.drawIndexed(command.indexCount, 1, command.firstIndex, command.vertexOffset, command.firstInstance);
+				++drawStatistics_.worldSubmissions;
+			}
+		}
+	}
+
+	// Opaque world surfaces in the depth pre-pass.
+	[[nodiscard]] static PipelineState GetDepthPrePassState(bool twoSided)
+	{
+		PipelineState state;
+		state.twoSided = twoSided;
+		return state;
+	}
+
+	// The same surfaces when they are shaded: their depth is in the buffer already.
+	[[nodiscard]] static PipelineState GetDepthEqualState(bool twoSided)
+	{
+		auto state = GetDepthPrePassState(twoSided);
+		state.depthWrite = false;
+		state.depthCompare = vk::CompareOp::eEqual;
+		return state;
+	}
+
+	/**
+	Gives the layer textures of a world surface their elements in the layer array of the world queue. Flushes the queue first when they do not fit.
+	\param layerViews Lightmap, fogmap, detail and macro texture; null when absent.
+	\param parameters The surface's record; receives the elements in layerTextures.
+	\note Without dynamic indexing, element i always holds layer i + 1, so surfaces only share a flush when their layers agree.
+	*/
+	void AddWorldLayers(const std::array<vk::ImageView, 4>& layerViews, SurfaceParameters& parameters)
+	{
+		auto& queue = worldQueue_;
+		const bool indexing = context_->supportsLayerIndexing;
+
+		bool fits = true;
+		size_t newLayerCount = 0;
+		for (size_t i = 0; i < layerViews.size(); ++i)
+		{
+			if (!layerViews[i])
+				continue;
+
+			if (indexing)
+				newLayerCount += queue.layerIndices.count(layerViews[i]) == 0 ? 1 : 0;
+			else if (i < queue.layerViews.size() && queue.layerViews[i] && queue.layerViews[i] != layerViews[i])
+				fits = false;
+		}
+
+		if (!fits || queue.layerViews.size() + newLayerCount > context_->worldLayerCount)
+			FlushWorldQueue();
+
+		for (size_t i = 0; i < layerViews.size(); ++i)
+		{
+			if (!layerViews[i])
+				continue;
+
+			if (!indexing)
+			{
+				queue.layerViews.resize(layerViews.size());
+				queue.layerViews[i] = layerViews[i];
+				parameters.layerTextures[i] = uint16_t(i);
+				continue;
+			}
+
+			const auto [it, isNew] = queue.layerIndices.try_emplace(layerViews[i], uint16_t(queue.layerViews.size()));
+			if (isNew)
+				queue.layerViews.push_back(layerViews[i]);
+			parameters.layerTextures[i] = it->second;
+		}
+	}
+
+	// Set 2 of the world pipelines for one flush. Every element of the array is bound, so the unused ones hold the white texture.
+	[[nodiscard]] vk::DescriptorSet AllocateWorldLayerDescriptorSet()
+	{
+		auto& queue = worldQueue_;
+		auto& imageInfos = queue.layerImageInfos;
+		imageInfos.assign(
+			context_->worldLayerCount,
+			vk::DescriptorImageInfo().setImageView(context_->whiteTexture->GetView()).setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal));
+		for (size_t i = 0; i < queue.layerViews.size(); ++i)
+		{
+			if (queue.layerViews[i])
+				imageInfos[i].setImageView(queue.layerViews[i]);
+		}
+
+		const auto descriptorSet = AllocateFrameDescriptorSet(context_->surfaceSetLayout);
+		logicalDevice_.updateDescriptorSets(
+			vk::WriteDescriptorSet()
+			.setDstSet(descriptorSet)
+			.setDstBinding(0)
+			.setDescriptorCount(uint32_t(imageInfos.size()))
+			.setDescriptorType(vk::DescriptorType::eSampledImage)
+			.setPImageInfo(imageInfos.data()),
+			nullptr);
+
+		return descriptorSet;
+	}
+
+	void FlushGouraudBatch()
+	{
+		auto& batch = gouraudBatch_;
+		if (batch.indices.empty())
+			return;
+
+		const auto commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+		BeginLabel(commandBuffer, "Meshes");
+
+		const auto& pipeline = BindPipelineState(SceneProgram::Gouraud, PipelineState::FromPolyFlags(batch.polyFlags));
+
+		const auto descriptorSets = utils::make_array<vk::DescriptorSet>(
+			batch.texture->descriptorSet,
+			context_->samplerDescriptorSets[GetTextureSamplerIndex(batch.polyFlags, false)]);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.GetLayout(), 0, descriptorSets, nullptr);
+
+		auto drawParameters = GetDrawParameters(batch.polyFlags);
+		SetPaletteLayer(drawParameters, *batch.texture, 0);
+		PushParameters(pipeline, drawParameters);
+		DrawIndexed(batch.vertices, batch.indices);
+		EndLabel(commandBuffer);
+
+		++drawStatistics_.gouraudDraws;
+
+		batch.vertices.clear();
+		batch.indices.clear();
+	}
+
+	void FlushTileBatch()
+	{
+		auto& batch = tileBatch_;
+		if (batch.indices.empty())
+			return;
+
+		const auto commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+		BeginLabel(commandBuffer, "Tiles");
+
+		auto state = PipelineState::FromPolyFlags(batch.polyFlags);
+		state.twoSided = true;
+		const auto& pipeline = BindPipelineState(SceneProgram::Tile, state);
+
+		const auto descriptorSets = utils::make_array<vk::DescriptorSet>(batch.texture->descriptorSet, context_->samplerDescriptorSets[batch.samplerIndex]);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.GetLayout(), 0, descriptorSets, nullptr);
+
+		auto drawParameters = GetDrawParameters(batch.polyFlags);
+		SetPaletteLayer(drawParameters, *batch.texture, 0);
+		PushParameters(pipeline, drawParameters);
+		DrawIndexed(batch.vertices, batch.indices);
+		EndLabel(commandBuffer);
+
+		++drawStatistics_.tileDraws;
+
+		batch.vertices.clear();
+		batch.indices.clear();
+	}
+
+	void FlushColorBatch(ColorBatch& batch)
+	{
+		if (batch.indices.empty())
+			return;
+
+		const auto commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+		BeginLabel(commandBuffer, "Untextured");
+		const auto& pipeline = BindPipelineState(SceneProgram::Color, batch.state);
+		PushParameters(pipeline, DrawParameters{});
+		DrawIndexed(batch.vertices, batch.indices);
+		EndLabel(commandBuffer);
+
+		batch.vertices.clear();
+		batch.indices.clear();
+	}
+
+	void PushParameters(const Pipeline& pipeline, const DrawParameters& drawParameters)
+	{
+		const auto commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+		commandBuffer.pushConstants(pipeline.GetLayout(), vk::ShaderStageFlagBits::eFragment, 0, sizeof(drawParameters), &drawParameters);
+	}
+
+	// Copies a batch into the frame's transient buffers and draws it as an indexed triangle list.
+	template <typename Vertex>
+	void DrawIndexed(const std::vector<Vertex>& vertexData, const std::vector<uint16_t>& indexData)
+	{
+		auto& frame = frames_[currentFrameIndex_];
+
+		const auto vertexDataSize = vertexData.size() * sizeof(Vertex);
+		const auto vertices = frame.transientBuffers->Allocate(vertexDataSize, sizeof(float));
+		std::memcpy(vertices.data, vertexData.data(), vertexDataSize);
+
+		const auto indexDataSize = indexData.size() * sizeof(uint16_t);
+		const auto indices = frame.transientBuffers->Allocate(indexDataSize, sizeof(uint32_t));
+		std::memcpy(indices.data, indexData.data(), indexDataSize);
+
+		frame.commandBuffer.bindVertexBuffers(0, vertices.buffer, vertices.offset);
+		frame.commandBuffer.bindIndexBuffer(indices.buffer, indices.offset, vk::IndexType::eUint16);
+		frame.commandBuffer.drawIndexed(uint32_t(indexData.size()), 1, 0, 0, 0);
+	}
+
+	// Like DrawIndexed(), for lists that are not worth indexing. The transient buffers grow to fit any amount.
+	template <typename Vertex>
+	void Draw(const std::vector<Vertex>& vertexData)
+	{
+		auto& frame = frames_[currentFrameIndex_];
+
+		const auto vertexDataSize = vertexData.size() * sizeof(Vertex);
+		const auto vertices = frame.transientBuffers->Allocate(vertexDataSize, sizeof(float));
+		std::memcpy(vertices.data, vertexData.data(), vertexDataSize);
+
+		frame.commandBuffer.bindVertexBuffers(0, vertices.buffer, vertices.offset);
+		frame.commandBuffer.draw(uint32_t(vertexData.size()), 1, 0, 0);
+	}
+
+	void InitTextureDiskCache()
+	{
+		if (!settings_.diskTextureCache)
+			return;
+
+		try
+		{
+			context_->textureDiskCache.emplace(std::filesystem::path(DRIVER_DATA_DIRECTORY_NAME) / "TextureCache.bin", MaxTextureDiskCacheSize);
+			DebugPrint(
+				"Texture disk cache: ",
+				context_->textureDiskCache->GetEntryCount(),
+				" textures, ",
+				context_->textureDiskCache->GetFileSize() / (1024 * 1024),
+				" MiB.");
+		}
+		catch (const std::exception& ex)
+		{
+			// The cache is an optimization only; a read-only or locked directory must not stop the renderer.
+			DebugPrint("Texture disk cache unavailable: ", ex.what());
+			context_->textureDiskCache.reset();
+		}
+	}
+
+	// Only textures whose conversion costs CPU time and whose contents are stable are worth persisting.
+	[[nodiscard]] bool IsDiskCacheable(const FTextureInfo& Info) const
+	{
+		if (!context_->textureDiskCache || Info.bRealtime || Info.bParametric)
+			return false;
+
+		return Info.Format == TEXF_P8 || (Info.Format == TEXF_DXT1 && !supportsTextureCompressionBC_);
+	}
+
+	[[nodiscard]] static size_t GetSourceMipSize(const FTextureInfo& Info, const vk::Extent2D& extent)
+	{
+		switch (Info.Format)
+		{
+		case TEXF_P8:
+			return Texture::GetMipSize(vk::Format::eR8Unorm, extent.width, extent.height);
+		case TEXF_DXT1:
+			return Texture::GetMipSize(vk::Format::eBc1RgbaUnormBlock, extent.width, extent.height);
+		default:
+			return Texture::GetMipSize(vk::Format::eB8G8R8A8Unorm, extent.width, extent.height);
+		}
+	}
+
+	static void CopyPalette(const FTextureInfo& Info, uint32_t* palette)
+	{
+		if (Info.Format != TEXF_P8)
+			return;
+
+		std::memcpy(palette, Info.Palette, 256 * sizeof(uint32_t));
+#ifndef RUNE
+		// Palette alpha is only meaningful for Rune's PF_AlphaBlend surfaces.
+		for (uint32_t i = 0; i < 256; ++i)
+			palette[i] |= 0xFF000000u;
+#endif
+	}
+
+	/**
+	Keyed by the texels and the palette as it is used (masking and opacity included).
+	\param Info Its mips are not read; mipData points to them or to a copy.
+	*/
+	[[nodiscard]] static TextureDiskCache::Key GetDiskCacheKey(
+		const FTextureInfo& Info,
+		const BYTE* const* mipData,
+		vk::Extent2D extent,
+		uint32_t mipCount,
+		const uint32_t* palette,
+		bool masked)
+	{
+		TextureDiskCache::Key key{Info.CacheID, 0, 0};
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+			key.contentHash = TextureDiskCache::Hash(mipData[mip], GetSourceMipSize(Info, Texture::GetMipExtent(extent, mip)), key.contentHash);
+		if (Info.Format == TEXF_P8)
+			key.paletteHash = TextureDiskCache::Hash(palette, 256 * sizeof(uint32_t), masked ? 1 : 0);
+		return key;
+	}
+
+	/**
+	\param Info Only its format is read.
+	\param source The game's mip, or a copy of it.
+	\param format Of the image, see GetTextureFormat(); DXT1 is decoded unless the image is BC1 itself.
+	\param size Of the converted mip in bytes.
+	\note Runs on the calling thread: the precache pool already converts one mip per worker, and for uploads during play spawning
+	decoder threads per mip costs more than it saves.
+	*/
+	static void ConvertMip(
+		const FTextureInfo& Info,
+		const BYTE* source,
+		vk::Format format,
+		vk::Extent2D extent,
+		size_t size,
+		const uint32_t* palette,
+		bool masked,
+		void* destination)
+	{
+		const auto pixelCount = size_t(extent.width) * extent.height;
+
+		switch (Info.Format)
+		{
+		case TEXF_P8:
+			texture_conversion::ConvertP8(source, palette, masked, static_cast<uint32_t*>(destination), pixelCount);
+			break;
+		case TEXF_DXT1:
+			if (format != vk::Format::eBc1RgbaUnormBlock)
+			{
+				bc::Decode(bc::Format::BC1, source, extent.width, extent.height, static_cast<uint32_t*>(destination), 1);
+				break;
+			}
+			[[fallthrough]];
+		default:
+			// Including TEXF_RGBA7 lightmaps: world.frag expands their range, so they go to staging memory untouched.
+			std::memcpy(destination, source, size);
+			break;
+		}
+	}
+
+	/**
+	Converts and stages the mips the game provides.
+	Converted chains of stable textures are kept in context_->textureDiskCache, see GetDiskCacheKey(); found entries are copied into staging
+	memory without conversion.
+	*/
+	void UploadTexture(const FTextureInfo& Info, const Texture& texture, bool masked)
+	{
+		const auto commandBuffer = GetUploadCommandBuffer();
+		auto& staging = *frames_[currentFrameIndex_].transientBuffers;
+
+		uint32_t palette[256];
+		CopyPalette(Info, palette);
+
+		texture.BeginUpload(commandBuffer);
+
+		const auto uploadedMipCount = std::min(texture.GetMipCount(), uint32_t(Info.NumMips));
+
+		if (IsDiskCacheable(Info))
+		{
+			std::vector<const BYTE*> mipData(uploadedMipCount);
+			for (uint32_t mip = 0; mip < uploadedMipCount; ++mip)
+				mipData[mip] = Info.Mips[mip]->DataPtr;
+			const auto key = GetDiskCacheKey(Info, mipData.data(), texture.GetExtent(), uploadedMipCount, palette, masked);
+
+			const TextureDiskCache::Description description{
+				uint32_t(texture.GetFormat()),
+				texture.GetExtent().width,
+				texture.GetExtent().height,
+				uploadedMipCount
+			};
+
+			if (const auto entry = context_->textureDiskCache->Find(key, description))
+			{
+				const auto* data = entry->data;
+				for (uint32_t mip = 0; mip < uploadedMipCount; ++mip)
+				{
+					std::memcpy(texture.UploadMip(commandBuffer, staging, mip), data, texture.GetMipSize(mip));
+					data += texture.GetMipSize(mip);
+				}
+			}
+			else
+			{
+				// Converted once into system memory: staging memory is write-combined and too slow to read back for the file.
+				size_t chainSize = 0;
+				for (uint32_t mip = 0; mip < uploadedMipCount; ++mip)
+					chainSize += texture.GetMipSize(mip);
+				context_->textureConversionBuffer.resize(chainSize);
+
+				auto* data = context_->textureConversionBuffer.data();
+				for (uint32_t mip = 0; mip < uploadedMipCount; ++mip)
+				{
+					ConvertMip(Info, Info.Mips[mip]->DataPtr, texture.GetFormat(), texture.GetMipExtent(mip), texture.GetMipSize(mip), palette, masked, data);
+					std::memcpy(texture.UploadMip(commandBuffer, staging, mip), data, texture.GetMipSize(mip));
+					data += texture.GetMipSize(mip);
+				}
+
+				context_->textureDiskCache->Store(key, description, context_->textureConversionBuffer.data(), chainSize);
+			}
+		}
+		else
+		{
+			for (uint32_t mip = 0; mip < uploadedMipCount; ++mip)
+				ConvertMip(
+					Info,
+					Info.Mips[mip]->DataPtr,
+					texture.GetFormat(),
+					texture.GetMipExtent(mip),
+					texture.GetMipSize(mip),
+					palette,
+					masked,
+					texture.UploadMip(commandBuffer, staging, mip));
+		}
+
+		// The rest of the chain is blitted inside the same upload command buffer; the CPU never downsamples.
+		texture.EndUpload(commandBuffer, uploadedMipCount);
+	}
+
+	/**
+	Runs on the shared precache pool. Touches nothing but the pending texture, the disk cache lookup and the pool.
+	\note Static because the viewport that submitted it may be closed meanwhile; the context outlives the pool, see ~SharedContext().
+	*/
+	static void ConvertPrecachedTexture(SharedContext& context, PrecachedTexture& pending)
+	{
+		// Small mips are not worth a job of their own; the tail of the chain is converted in one.
+		constexpr size_t MinMipJobSize = 64 * 1024;
+
+		if (pending.diskCacheable)
+		{
+			std::vector<const BYTE*> mipData(pending.mipCount);
+			for (uint32_t mip = 0; mip < pending.mipCount; ++mip)
+				mipData[mip] = pending.source.data() + pending.sourceOffsets[mip];
+			const auto key = GetDiskCacheKey(pending.info, mipData.data(), pending.extent, pending.mipCount, pending.palette, pending.masked);
+			if (const auto entry = context.textureDiskCache->Find(key, GetDiskCacheDescription(pending)))
+			{
+				pending.cachedData = entry->data;
+				return;
+			}
+
+			pending.storeKey = key;
+		}
+
+		pending.data.resize(pending.mipOffsets.back());
+
+		const auto convertMips = [&pending](uint32_t firstMip, uint32_t lastMip)
+		{
+			for (uint32_t mip = firstMip; mip < lastMip; ++mip)
+			{
+				ConvertMip(
+					pending.info,
+					pending.source.data() + pending.sourceOffsets[mip],
+					pending.format,
+					Texture::GetMipExtent(pending.extent, mip),
+					pending.mipOffsets[mip + 1] - pending.mipOffsets[mip],
+					pending.palette,
+					pending.masked,
+					pending.data.data() + pending.mipOffsets[mip]);
+			}
+		};
+
+		uint32_t mip = 0;
+		for (; mip + 1 < pending.mipCount && pending.mipOffsets[mip + 1] - pending.mipOffsets[mip] >= MinMipJobSize; ++mip)
+			context.precachePool->Submit([convertMips, mip] { convertMips(mip, mip + 1); });
+
+		convertMips(mip, pending.mipCount);
+	}
+
+	[[nodiscard]] static TextureDiskCache::Description GetDiskCacheDescription(const PrecachedTexture& pending)
+	{
+		return TextureDiskCache::Description{uint32_t(pending.format), pending.extent.width, pending.extent.height, pending.mipCount};
+	}
+
+	// Waits for the precache pool, helping it, then creates and uploads everything it converted. Vulkan is only used here, on the game thread.
+	void FinishPrecache()
+	{
+		if (context_->precachedTextures.empty())
+			return;
+
+		const auto precachedTextures = std::move(context_->precachedTextures);
+		context_->precachedTextures.clear();
+		context_->precachedTextureIds.clear();
+
+		context_->precachePool->Wait();
+
+		const auto commandBuffer = GetUploadCommandBuffer();
+		auto& staging = *frames_[currentFrameIndex_].transientBuffers;
+
+		size_t uploadedSize = 0;
+		for (const auto& pending : precachedTextures)
+		{
+			const auto& texture = CreateCachedTexture(pending->info, pending->format, pending->extent, pending->mipCount, pending->masked).texture;
+			const auto* data = pending->cachedData ? pending->cachedData : pending->data.data();
+
+			texture.BeginUpload(commandBuffer);
+			for (uint32_t mip = 0; mip < pending->mipCount; ++mip)
+				std::memcpy(texture.UploadMip(commandBuffer, staging, mip), data + pending->mipOffsets[mip], texture.GetMipSize(mip));
+			texture.EndUpload(commandBuffer, pending->mipCount);
+
+			if (pending->storeKey)
+				context_->textureDiskCache->Store(*pending->storeKey, GetDiskCacheDescription(*pending), pending->data.data(), pending->data.size());
+
+			uploadedSize += pending->mipOffsets.back();
+		}
+
+		DebugPrint(
+			"Precached ",
+			precachedTextures.size(),
+			" textures (",
+			uploadedSize / (1024 * 1024),
+			" MiB) in ",
+			std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - context_->precacheStartTime).count(),
+			" ms on ",
+			context_->precachePool->GetThreadCount() + 1,
+			" threads.");
+	}
+
+	// Block-compressed formats can't be blit destinations; their chains are capped at the mips the game provides.
+	[[nodiscard]] bool SupportsMipGeneration(vk::Format format) const
+	{
+		if (Texture::IsBlockCompressed(format))
+			return false;
+
+		const auto requiredFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+			vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+		return (physicalDevice_.getFormatProperties(format).optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+	}
+
+
+	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, const VkExtent2D& requestedExtent)
+	{
+		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+		{
+			return capabilities.currentExtent;
+		}
+		else
+		{
+			VkExtent2D actualExtent = requestedExtent;
+
+			actualExtent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actualExtent.width));
+			actualExtent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actualExtent.height));
+
+			return actualExtent;
+		}
+	}
+
+
+	void InitSwapChain(const vk::Extent2D& requestedExtent)
+	{
+		// Pipelines don't depend on the extent, so only the images have to be rebuilt.
+		// Frames in flight may still use the old ones, which are destroyed once those frames are done.
+		const auto oldSwapChain = swapChain_;
+		if (oldSwapChain)
+			RetireSwapChainImages();
+
+		presentationSurfaceCaps_ = physicalDevice_.getSurfaceCapabilitiesKHR(presentationSurface_);
+
+		const auto preferredFormat = utils::maybeFirst(
+			availablePresentationSurfaceFormats_,
+			[](const vk::SurfaceFormatKHR& format)
+			{
+				return format.format == vk::Format::eB8G8R8A8Unorm && format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
+			});
+
+		const auto extent = vk::Extent2D(chooseSwapExtent(presentationSurfaceCaps_, requestedExtent));
+
+		const size_t imageCount = settings_.presentationMode == PresentationMode::VSyncTripleBuffering ? 3 : 2;
+
+		vk::SwapchainCreateInfoKHR swapChainCreateInfo;
 		swapChainCreateInfo
 			.setSurface(presentationSurface_)
 			.setImageFormat(preferredFormat->format)
@@ -823,84 +4013,1259 @@ private:
 			.setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
 			.setPreTransform(presentationSurfaceCaps_.currentTransform)
 			.setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
-			.setClipped(true);
+			.setClipped(true)
+			.setOldSwapchain(oldSwapChain);
+
+		if (renderingQueueFamilyIndex_ == presentationQueueFamilyIndex_)
+		{
+			swapChainCreateInfo.setImageSharingMode(vk::SharingMode::eExclusive);
+
+			swapChain_ = logicalDevice_.createSwapchainKHR(swapChainCreateInfo);
+		}
+		else
+		{
+			const auto queueFamilyIndices = utils::make_array<size_t>(renderingQueueFamilyIndex_, presentationQueueFamilyIndex_);
+
+			swapChainCreateInfo
+				.setImageSharingMode(vk::SharingMode::eConcurrent)
+				.setPQueueFamilyIndices(queueFamilyIndices.data())
+				.setQueueFamilyIndexCount(queueFamilyIndices.size());
+
+			swapChain_ = logicalDevice_.createSwapchainKHR(swapChainCreateInfo);
+		}
+
+		if (oldSwapChain)
+		{
+			Retire(
+				[device = logicalDevice_, oldSwapChain]
+				{
+					device.destroySwapchainKHR(oldSwapChain);
+				});
+		}
+
+		// Present ids belong to the swapchain they were presented to.
+		presentCount_ = 0;
+		for (auto& frame : frames_)
+			frame.presentId = 0;
+
+		DebugPrint("Swapchain created.");
+
+		presentationSurfaceExtent_ = extent;
+		isSwapChainSuboptimal_ = false;
+		presentationSurfaceFormat_ = preferredFormat->format;
+		swapChainImages_ = utils::to_vector(
+			logicalDevice_.getSwapchainImagesKHR(swapChain_) | boost::adaptors::transformed(
+				[&](const vk::Image& image)
+				{
+					return SwapChainImage{
+						image,
+						logicalDevice_.createImageView(
+							vk::ImageViewCreateInfo()
+							.setImage(image)
+							.setFormat(this->presentationSurfaceFormat_)
+							.setViewType(vk::ImageViewType::e2D)
+							.setSubresourceRange(
+								vk::ImageSubresourceRange()
+								.setLayerCount(1)
+								.setLevelCount(1)
+								.setAspectMask(vk::ImageAspectFlagBits::eColor))),
+						nullptr
+					};
+				})
+		);
+	}
+
+	void InitRenderPasses()
+	{
+		InitSceneRenderPass();
+		InitCompositeRenderPass();
+	}
+
+	// Renders into the offscreen target, which is then sampled by the composite pass.
+	void InitSceneRenderPass()
+	{
+		const auto colorAttachment = vk::AttachmentDescription()
+		                             .setFormat(presentationSurfaceFormat_)
+		                             .setSamples(vk::SampleCountFlagBits::e1)
+		                             .setInitialLayout(vk::ImageLayout::eUndefined)
+		                             .setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		                             .setLoadOp(vk::AttachmentLoadOp::eClear)
+		                             .setStoreOp(vk::AttachmentStoreOp::eStore)
+		                             .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+		                             .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+
+		depthFormat_ = ChooseDepthFormat();
+
+		const auto depthAttachment = vk::AttachmentDescription()
+		                             .setFormat(depthFormat_)
+		                             .setSamples(vk::SampleCountFlagBits::e1)
+		                             .setInitialLayout(vk::ImageLayout::eUndefined)
+		                             .setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+		                             .setLoadOp(vk::AttachmentLoadOp::eClear)
+		                             .setStoreOp(vk::AttachmentStoreOp::eDontCare)
+		                             .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+		                             .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+
+		const auto attachments = utils::make_array<vk::AttachmentDescription>(colorAttachment, depthAttachment);
+
+		const auto colorAttachmentRef = vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+		const auto depthAttachmentRef = vk::AttachmentReference().setAttachment(1).setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+		const auto subpass = vk::SubpassDescription()
+		                     .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+		                     .setColorAttachmentCount(1)
+		                     .setPColorAttachments(&colorAttachmentRef)
+		                     .setPDepthStencilAttachment(&depthAttachmentRef);
+
+		// The offscreen target and the depth buffer are shared between frames in flight,
+		// so wait for the previous frame's depth writes and for its composite pass to finish reading the target.
+		const auto dependencies = utils::make_array<vk::SubpassDependency>(
+			vk::SubpassDependency()
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(
+				vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests |
+				vk::PipelineStageFlagBits::eFragmentShader)
+			.setDstStageMask(
+				vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests)
+			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+			vk::SubpassDependency()
+			.setSrcSubpass(0)
+			.setDstSubpass(VK_SUBPASS_EXTERNAL)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead));
+
+		renderPass_ = logicalDevice_.createRenderPass(
+			vk::RenderPassCreateInfo()
+			.setAttachmentCount(uint32_t(attachments.size()))
+			.setPAttachments(attachments.data())
+			.setSubpassCount(1)
+			.setPSubpasses(&subpass)
+			.setDependencyCount(uint32_t(dependencies.size()))
+			.setPDependencies(dependencies.data())
+		);
+	}
+
+	// Writes every pixel of the swapchain image, so its previous contents are not loaded.
+	void InitCompositeRenderPass()
+	{
+		const auto colorAttachment = vk::AttachmentDescription()
+		                             .setFormat(presentationSurfaceFormat_)
+		                             .setSamples(vk::SampleCountFlagBits::e1)
+		                             .setInitialLayout(vk::ImageLayout::eUndefined)
+		                             .setFinalLayout(vk::ImageLayout::ePresentSrcKHR)
+		                             .setLoadOp(vk::AttachmentLoadOp::eDontCare)
+		                             .setStoreOp(vk::AttachmentStoreOp::eStore)
+		                             .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+		                             .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+
+		const auto colorAttachmentRef = vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+
+		const auto subpass = vk::SubpassDescription()
+		                     .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+		                     .setColorAttachmentCount(1)
+		                     .setPColorAttachments(&colorAttachmentRef);
+
+		// Wait for the image to be acquired before writing to it.
+		const auto dependency = vk::SubpassDependency()
+		                        .setSrcSubpass(VK_SUBPASS_EXTERNAL)
+		                        .setDstSubpass(0)
+		                        .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+		                        .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+		                        .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite);
+
+		compositeRenderPass_ = logicalDevice_.createRenderPass(
+			vk::RenderPassCreateInfo()
+			.setAttachmentCount(1)
+			.setPAttachments(&colorAttachment)
+			.setSubpassCount(1)
+			.setPSubpasses(&subpass)
+			.setDependencyCount(1)
+			.setPDependencies(&dependency)
+		);
+	}
+
+	[[nodiscard]] vk::Format ChooseDepthFormat() const
+	{
+		for (const auto format : {vk::Format::eD32Sfloat, vk::Format::eX8D24UnormPack32, vk::Format::eD24UnormS8Uint, vk::Format::eD16Unorm})
+		{
+			if (physicalDevice_.getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment)
+				return format;
+		}
+
+		throw std::runtime_error("No supported depth format");
+	}
+
+	// Sized for the maximum resolution scale, clamped to the device's image size limit.
+	void InitRenderTarget()
+	{
+		const auto maxDimension = physicalDevice_.getProperties().limits.maxImageDimension2D;
+		const auto maxScale = dynamicResolution_.GetMaxScale();
+		renderTargetExtent_ = vk::Extent2D(
+			std::min(maxDimension, uint32_t(std::ceil(float(presentationSurfaceExtent_.width) * maxScale))),
+			std::min(maxDimension, uint32_t(std::ceil(float(presentationSurfaceExtent_.height) * maxScale))));
+
+		renderTargetImage_ = logicalDevice_.createImage(
+			vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setFormat(presentationSurfaceFormat_)
+			.setExtent(vk::Extent3D(renderTargetExtent_.width, renderTargetExtent_.height, 1))
+			.setMipLevels(1)
+			.setArrayLayers(1)
+			.setSamples(vk::SampleCountFlagBits::e1)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled)
+			.setSharingMode(vk::SharingMode::eExclusive)
+			.setInitialLayout(vk::ImageLayout::eUndefined));
+
+		renderTargetImageMemory_ = memoryAllocator_->AllocateForImage(renderTargetImage_, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		NameObject(vk::ObjectType::eImage, renderTargetImage_, [] { return "Render target"s; });
+
+		renderTargetImageView_ = logicalDevice_.createImageView(
+			vk::ImageViewCreateInfo()
+			.setImage(renderTargetImage_)
+			.setFormat(presentationSurfaceFormat_)
+			.setViewType(vk::ImageViewType::e2D)
+			.setSubresourceRange(Texture::GetSubresourceRange(0, 1)));
+
+		DebugPrint(
+			"Render target: ",
+			renderTargetExtent_.width,
+			"x",
+			renderTargetExtent_.height,
+			", dynamic resolution ",
+			dynamicResolution_.IsEnabled() ? "enabled" : "disabled");
+	}
+
+	void RetireRenderTarget()
+	{
+		Retire(
+			[device = logicalDevice_, allocator = memoryAllocator_, framebuffer = sceneFramebuffer_, view = renderTargetImageView_,
+				image = renderTargetImage_, memory = renderTargetImageMemory_]
+			{
+				device.destroyFramebuffer(framebuffer);
+				device.destroyImageView(view);
+				device.destroyImage(image);
+				allocator->Free(memory);
+			});
+		sceneFramebuffer_ = nullptr;
+		renderTargetImageView_ = nullptr;
+		renderTargetImage_ = nullptr;
+		renderTargetImageMemory_ = {};
+	}
+
+	void InitDepthBuffer()
+	{
+		depthImage_ = logicalDevice_.createImage(
+			vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setFormat(depthFormat_)
+			.setExtent(vk::Extent3D(renderTargetExtent_.width, renderTargetExtent_.height, 1))
+			.setMipLevels(1)
+			.setArrayLayers(1)
+			.setSamples(vk::SampleCountFlagBits::e1)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment)
+			.setSharingMode(vk::SharingMode::eExclusive)
+			.setInitialLayout(vk::ImageLayout::eUndefined));
+
+		depthImageMemory_ = memoryAllocator_->AllocateForImage(depthImage_, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		NameObject(vk::ObjectType::eImage, depthImage_, [] { return "Depth buffer"s; });
+
+		depthImageView_ = logicalDevice_.createImageView(
+			vk::ImageViewCreateInfo()
+			.setImage(depthImage_)
+			.setFormat(depthFormat_)
+			.setViewType(vk::ImageViewType::e2D)
+			.setSubresourceRange(
+				vk::ImageSubresourceRange()
+				.setLayerCount(1)
+				.setLevelCount(1)
+				.setAspectMask(vk::ImageAspectFlagBits::eDepth)));
+	}
+
+	void RetireDepthBuffer()
+	{
+		Retire(
+			[device = logicalDevice_, allocator = memoryAllocator_, view = depthImageView_, image = depthImage_, memory = depthImageMemory_]
+			{
+				device.destroyImageView(view);
+				device.destroyImage(image);
+				allocator->Free(memory);
+			});
+		depthImageView_ = nullptr;
+		depthImage_ = nullptr;
+		depthImageMemory_ = {};
+	}
+
+	void InitSceneFramebuffer()
+	{
+		const auto attachments = utils::make_array<vk::ImageView>(renderTargetImageView_, depthImageView_);
+
+		sceneFramebuffer_ = logicalDevice_.createFramebuffer(
+			vk::FramebufferCreateInfo()
+			.setRenderPass(renderPass_)
+			.setAttachmentCount(uint32_t(attachments.size()))
+			.setPAttachments(attachments.data())
+			.setWidth(renderTargetExtent_.width)
+			.setHeight(renderTargetExtent_.height)
+			.setLayers(1));
+	}
+
+	void InitFramebuffers()
+	{
+		for (auto& swapChainImage : swapChainImages_)
+		{
+			swapChainImage.framebuffer = logicalDevice_.createFramebuffer(
+				vk::FramebufferCreateInfo()
+				.setRenderPass(compositeRenderPass_)
+				.setAttachmentCount(1)
+				.setPAttachments(&swapChainImage.view)
+				.setWidth(presentationSurfaceExtent_.width)
+				.setHeight(presentationSurfaceExtent_.height)
+				.setLayers(1));
+		}
+	}
+
+	void RetireSwapChainImages()
+	{
+		for (auto& swapChainImage : swapChainImages_)
+		{
+			Retire(
+				[device = logicalDevice_, framebuffer = swapChainImage.framebuffer, view = swapChainImage.view]
+				{
+					device.destroyFramebuffer(framebuffer);
+					device.destroyImageView(view);
+				});
+		}
+		swapChainImages_.clear();
+
+		RetireRenderTarget();
+		RetireDepthBuffer();
+	}
+
+	/**
+	Destroys every cached texture once the frames in flight are done with it, together with the descriptor pools of their sets.
+	\note The palette table's set is in those pools too; it is allocated again, and the rows start over.
+	*/
+	void RetireTextureCache()
+	{
+		std::vector<Texture> textures;
+		textures.reserve(context_->textureCache.size());
+		for (auto& entry : context_->textureCache)
+			textures.push_back(std::move(entry.second.texture));
+		context_->textureCache.clear();
+		RetireTextures(std::move(textures));
+
+		Retire(
+			[device = logicalDevice_, pools = std::move(context_->textureDescriptorPools)]
+			{
+				for (const auto pool : pools)
+					device.destroyDescriptorPool(pool);
+			});
+		context_->textureDescriptorPools.clear();
+
+		if (context_->paletteTable)
+			context_->paletteTable->Clear();
+		context_->paletteDescriptorSet = AllocateTextureDescriptorSet(context_->paletteTable ? context_->paletteTable->GetView() : context_->whiteTexture->GetView());
+		isPaletteSetBound_ = false;
+	}
+
+	// A single texture's descriptor set and palette row stay allocated until the next RetireTextureCache().
+	void RetireTexture(Texture&& texture)
+	{
+		std::vector<Texture> textures;
+		textures.push_back(std::move(texture));
+		RetireTextures(std::move(textures));
+	}
+
+	void RetireTextures(std::vector<Texture> textures)
+	{
+		if (!textures.empty())
+			Retire([textures = std::make_shared<std::vector<Texture>>(std::move(textures))] { textures->clear(); });
+	}
+
+	/**
+	Destroys a resource once no frame in flight uses it anymore, see DeletionQueue.
+	Commands recorded but not submitted count as in flight, those of every viewport: the frame being drawn and uploads recorded outside
+	of a frame. Each recording viewport submits once before its commands complete, so the resource waits for that many submissions.
+	*/
+	void Retire(DeletionQueue::Destruction destroy)
+	{
+		context_->deletionQueue.Push(std::move(destroy), context_->recordingViewports.size());
+	}
 
-		if (renderingQueueFamilyIndex_ == presentationQueueFamilyIndex_)
-		{
-			swapChainCreateInfo.setImageSharingMode(vk::SharingMode::eExclusive);
+	// Command buffer labels group the commands of a phase in graphics debuggers and profilers. Names are literals, so a label costs nothing but
+	// the branch without DebugLabels.
+	void BeginLabel(vk::CommandBuffer commandBuffer, const char* name) const
+	{
+		if (debugLabels_)
+			commandBuffer.beginDebugUtilsLabelEXT(vk::DebugUtilsLabelEXT().setPLabelName(name));
+	}
 
-			swapChain_ = logicalDevice_.createSwapchainKHR(swapChainCreateInfo);
-		}
-		else
+	void EndLabel(vk::CommandBuffer commandBuffer) const
+	{
+		if (debugLabels_)
+			commandBuffer.endDebugUtilsLabelEXT();
+	}
+
+	/**
+	Names an object for graphics debuggers and profilers.
+	\param makeName Returns the name as a std::string; only called with DebugLabels.
+	*/
+	template <typename Handle, typename MakeName>
+	void NameObject(vk::ObjectType type, Handle handle, const MakeName& makeName) const
+	{
+		if (!debugLabels_)
+			return;
+
+		const std::string name = makeName();
+		logicalDevice_.setDebugUtilsObjectNameEXT(
+			vk::DebugUtilsObjectNameInfoEXT()
+			.setObjectType(type)
+			.setObjectHandle(uint64_t(static_cast<typename Handle::CType>(handle)))
+			.setPObjectName(name.c_str()));
+	}
+
+	// The texture's package path, e.g. "GenFX.LensFlar.3", which engine names keep within ASCII.
+	[[nodiscard]] static std::string GetTextureDebugName(const FTextureInfo& Info)
+	{
+		if (Info.Texture == nullptr)
+			return "Texture " + std::to_string(Info.CacheID);
+
+		std::string name;
+		for (const auto* c = Info.Texture->GetPathName(); *c; ++c)
+			name.push_back(char(*c));
+		return name;
+	}
+
+	[[nodiscard]] bool IsHitTesting() const
+	{
+		return hitData_ != nullptr && hitSize_ != nullptr;
+	}
+
+	// The hit region is the viewport's, in the same pixels as the swapchain.
+	void BeginHitTesting()
+	{
+		if (!hitRenderPass_)
+			InitHitTarget();
+
+		hitBatch_.vertices.clear();
+		hitBatch_.draws.clear();
+		hitBatch_.clearDepth = false;
+
+		const auto width = uint32_t(std::clamp(Viewport->HitXL, 1, INT(MaxHitExtent)));
+		const auto height = uint32_t(std::clamp(Viewport->HitYL, 1, INT(MaxHitExtent)));
+		hitRegion_ = vk::Rect2D(
+			{Viewport->HitX + (Viewport->HitXL - INT(width)) / 2, Viewport->HitY + (Viewport->HitYL - INT(height)) / 2},
+			{width, height});
+	}
+
+	/**
+	Makes room for hit vertices drawn under the current hit stack; the caller writes their positions.
+	\return nullptr when not hit testing or outside of any hit record, in which case the primitive can not be hit.
+	*/
+	[[nodiscard]] HitVertex* AddHitVertices(HitMode mode, size_t count)
+	{
+		if (!IsHitTesting() || !hitRecorder_.IsActive() || count == 0)
+			return nullptr;
+
+		auto& batch = hitBatch_;
+		const auto firstVertex = batch.vertices.size();
+		// Every scene node change writes a new uniform record.
+		const bool sameScene = !batch.draws.empty() && batch.draws.back().sceneSet == sceneUniformSet_ &&
+			batch.draws.back().sceneOffset == sceneUniformOffset_;
+		if (batch.clearDepth || !sameScene || batch.draws.back().mode != mode)
 		{
-			const auto queueFamilyIndices = utils::make_array<size_t>(renderingQueueFamilyIndex_, presentationQueueFamilyIndex_);
+			batch.draws.push_back(
+				HitDraw{mode, sceneUniformSet_, sceneUniformOffset_, sceneViewport_, batch.clearDepth, uint32_t(firstVertex), 0});
+			batch.clearDepth = false;
+		}
+		batch.draws.back().vertexCount += uint32_t(count);
 
-			swapChainCreateInfo
-				.setImageSharingMode(vk::SharingMode::eConcurrent)
-				.setPQueueFamilyIndices(queueFamilyIndices.data())
-				.setQueueFamilyIndexCount(queueFamilyIndices.size());
+		const auto id = hitRecorder_.GetCurrentId();
+		batch.vertices.resize(firstVertex + count);
+		for (size_t i = firstVertex; i < batch.vertices.size(); ++i)
+			batch.vertices[i].id = id;
+		return batch.vertices.data() + firstVertex;
+	}
 
-			swapChain_ = logicalDevice_.createSwapchainKHR(swapChainCreateInfo);
+	// Lines and points are already in view space.
+	void AddHitVertices(HitMode mode, std::vector<vertex_packing::ColorVertex>::const_iterator first, std::vector<vertex_packing::ColorVertex>::const_iterator last)
+	{
+		if (auto* hitVertices = AddHitVertices(mode, size_t(last - first)))
+		{
+			for (; first != last; ++first)
+				std::memcpy((hitVertices++)->position, first->position, sizeof(HitVertex::position));
 		}
+	}
 
-		DebugPrint("Swapchain created.");
+	// The IDs of the hit batch go into the hit target, of which only the hit region is copied back; see ResolveHit().
+	void RecordHitPass(vk::CommandBuffer commandBuffer)
+	{
+		auto& batch = hitBatch_;
+		auto& transientBuffers = *frames_[currentFrameIndex_].transientBuffers;
+
+		const auto clearValues = utils::make_array<vk::ClearValue>(
+			vk::ClearColorValue(std::array<uint32_t, 4>{0, 0, 0, 0}),
+			vk::ClearDepthStencilValue(1.0f, 0));
+		const auto area = vk::Rect2D({0, 0}, hitRegion_.extent);
+
+		commandBuffer.beginRenderPass(
+			vk::RenderPassBeginInfo()
+			.setRenderPass(hitRenderPass_)
+			.setFramebuffer(hitFramebuffer_)
+			.setRenderArea(area)
+			.setClearValueCount(uint32_t(clearValues.size()))
+			.setPClearValues(clearValues.data()),
+			vk::SubpassContents::eInline);
+		BeginLabel(commandBuffer, "Hit test");
+
+		if (!batch.vertices.empty())
+		{
+			const auto vertexDataSize = batch.vertices.size() * sizeof(HitVertex);
+			const auto vertices = transientBuffers.Allocate(vertexDataSize, sizeof(float));
+			std::memcpy(vertices.data, batch.vertices.data(), vertexDataSize);
+			commandBuffer.bindVertexBuffers(0, vertices.buffer, vertices.offset);
+			commandBuffer.setScissor(0, area);
 
-		presentationSurfaceExtent_ = extent;
-		presentationSurfaceFormat_ = preferredFormat->format;
-		swapChainImages_ = utils::to_vector(
-			logicalDevice_.getSwapchainImagesKHR(swapChain_) | boost::adaptors::transformed(
-				[&](const vk::Image& image)
+			for (const auto& draw : batch.draws)
+			{
+				if (draw.clearDepth)
 				{
-					return SwapChainImage{
-						image,
-						logicalDevice_.createImageView(
-							vk::ImageViewCreateInfo()
-							.setImage(image)
-							.setFormat(this->presentationSurfaceFormat_)
-							.setViewType(vk::ImageViewType::e2D)
-							.setSubresourceRange(
-								vk::ImageSubresourceRange()
-								.setLayerCount(1)
-								.setLevelCount(1)
-								.setAspectMask(vk::ImageAspectFlagBits::eColor)))
-					};
-				})
-		);
+					commandBuffer.clearAttachments(
+						vk::ClearAttachment().setAspectMask(vk::ImageAspectFlagBits::eDepth).setClearValue(vk::ClearDepthStencilValue(1.0f, 0)),
+						vk::ClearRect(area, 0, 1));
+				}
+
+				// The scene node's viewport moved so that the hit region lands on the target's origin.
+				commandBuffer.setViewport(
+					0,
+					vk::Viewport(
+						float(draw.viewport.offset.x - hitRegion_.offset.x),
+						float(draw.viewport.offset.y - hitRegion_.offset.y),
+						float(draw.viewport.extent.width),
+						float(draw.viewport.extent.height),
+						0.0f,
+						1.0f));
+
+				const auto& pipeline = hitPipelines_[size_t(draw.mode)];
+				commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.GetHandle());
+				commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.GetLayout(), 0, draw.sceneSet, draw.sceneOffset);
+				commandBuffer.draw(draw.vertexCount, 1, draw.firstVertex, 0);
+			}
+		}
+
+		EndLabel(commandBuffer);
+		commandBuffer.endRenderPass();
+
+		// The render pass leaves the target ready to be copied.
+		hitReadback_ = transientBuffers.Allocate(vk::DeviceSize(hitRegion_.extent.width) * hitRegion_.extent.height * sizeof(uint32_t), sizeof(uint32_t));
+		commandBuffer.copyImageToBuffer(
+			hitImage_,
+			vk::ImageLayout::eTransferSrcOptimal,
+			hitReadback_.buffer,
+			vk::BufferImageCopy()
+			.setBufferOffset(hitReadback_.offset)
+			.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+			.setImageExtent(vk::Extent3D(hitRegion_.extent.width, hitRegion_.extent.height, 1)));
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eHost,
+			{},
+			vk::MemoryBarrier().setSrcAccessMask(vk::AccessFlagBits::eTransferWrite).setDstAccessMask(vk::AccessFlagBits::eHostRead),
+			nullptr,
+			nullptr);
+	}
+
+	// The editor reads the hit as soon as Unlock() returns, so a hit-testing frame waits for its own fence; no other frame does.
+	void ResolveHit(FrameContext& frame)
+	{
+		(void)logicalDevice_.waitForFences(frame.fence, true, std::numeric_limits<uint64_t>::max());
+
+		const auto id = hitRecorder_.Resolve(static_cast<const uint32_t*>(hitReadback_.data), hitRegion_.extent.width, hitRegion_.extent.height);
+		const auto* record = hitRecorder_.GetRecord(id);
+		if (record != nullptr && record->size() <= size_t(*hitSize_))
+		{
+			std::memcpy(hitData_, record->data(), record->size());
+			*hitSize_ = INT(record->size());
+		}
+		else
+		{
+			*hitSize_ = 0;
+		}
+
+		hitData_ = nullptr;
+		hitSize_ = nullptr;
+		hitRecorder_.Reset();
 	}
 
-	void InitRenderPass()
+	// A R32_UINT target of MaxHitExtent with its own depth buffer, and one pipeline per HitMode.
+	void InitHitTarget()
 	{
 		const auto colorAttachment = vk::AttachmentDescription()
-		                             .setFormat(presentationSurfaceFormat_)
+		                             .setFormat(vk::Format::eR32Uint)
 		                             .setSamples(vk::SampleCountFlagBits::e1)
 		                             .setInitialLayout(vk::ImageLayout::eUndefined)
-		                             .setFinalLayout(vk::ImageLayout::ePresentSrcKHR)
+		                             .setFinalLayout(vk::ImageLayout::eTransferSrcOptimal)
 		                             .setLoadOp(vk::AttachmentLoadOp::eClear)
 		                             .setStoreOp(vk::AttachmentStoreOp::eStore)
 		                             .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 		                             .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
 
+		const auto depthAttachment = vk::AttachmentDescription()
+		                             .setFormat(depthFormat_)
+		                             .setSamples(vk::SampleCountFlagBits::e1)
+		                             .setInitialLayout(vk::ImageLayout::eUndefined)
+		                             .setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+		                             .setLoadOp(vk::AttachmentLoadOp::eClear)
+		                             .setStoreOp(vk::AttachmentStoreOp::eDontCare)
+		                             .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+		                             .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+
+		const auto attachments = utils::make_array<vk::AttachmentDescription>(colorAttachment, depthAttachment);
+
 		const auto colorAttachmentRef = vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+		const auto depthAttachmentRef = vk::AttachmentReference().setAttachment(1).setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
 
 		const auto subpass = vk::SubpassDescription()
 		                     .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
 		                     .setColorAttachmentCount(1)
-		                     .setPColorAttachments(&colorAttachmentRef);
-
-		renderPass_ = logicalDevice_.createRenderPass(
+		                     .setPColorAttachments(&colorAttachmentRef)
+		                     .setPDepthStencilAttachment(&depthAttachmentRef);
+
+		// The previous hit-testing frame copied the target and wrote the depth buffer; the copy of this one waits for the IDs.
+		const auto dependencies = utils::make_array<vk::SubpassDependency>(
+			vk::SubpassDependency()
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests)
+			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+			vk::SubpassDependency()
+			.setSrcSubpass(0)
+			.setDstSubpass(VK_SUBPASS_EXTERNAL)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstStageMask(vk::PipelineStageFlagBits::eTransfer)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eTransferRead));
+
+		hitRenderPass_ = logicalDevice_.createRenderPass(
 			vk::RenderPassCreateInfo()
-			.setAttachmentCount(1)
-			.setPAttachments(&colorAttachment)
+			.setAttachmentCount(uint32_t(attachments.size()))
+			.setPAttachments(attachments.data())
 			.setSubpassCount(1)
 			.setPSubpasses(&subpass)
-		);
+			.setDependencyCount(uint32_t(dependencies.size()))
+			.setPDependencies(dependencies.data()));
+
+		const auto createImage = [&](vk::Format format, vk::ImageUsageFlags usage, vk::ImageAspectFlags aspect, vk::Image& image, vk::ImageView& view,
+		                             MemoryAllocation& memory)
+		{
+			image = logicalDevice_.createImage(
+				vk::ImageCreateInfo()
+				.setImageType(vk::ImageType::e2D)
+				.setFormat(format)
+				.setExtent(vk::Extent3D(MaxHitExtent, MaxHitExtent, 1))
+				.setMipLevels(1)
+				.setArrayLayers(1)
+				.setSamples(vk::SampleCountFlagBits::e1)
+				.setTiling(vk::ImageTiling::eOptimal)
+				.setUsage(usage)
+				.setSharingMode(vk::SharingMode::eExclusive)
+				.setInitialLayout(vk::ImageLayout::eUndefined));
+
+			memory = memoryAllocator_->AllocateForImage(image, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+			view = logicalDevice_.createImageView(
+				vk::ImageViewCreateInfo()
+				.setImage(image)
+				.setFormat(format)
+				.setViewType(vk::ImageViewType::e2D)
+				.setSubresourceRange(vk::ImageSubresourceRange().setAspectMask(aspect).setLevelCount(1).setLayerCount(1)));
+		};
+
+		createImage(
+			vk::Format::eR32Uint,
+			vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+			vk::ImageAspectFlagBits::eColor,
+			hitImage_,
+			hitImageView_,
+			hitImageMemory_);
+		createImage(
+			depthFormat_,
+			vk::ImageUsageFlagBits::eDepthStencilAttachment,
+			vk::ImageAspectFlagBits::eDepth,
+			hitDepthImage_,
+			hitDepthImageView_,
+			hitDepthImageMemory_);
+
+		const auto views = utils::make_array<vk::ImageView>(hitImageView_, hitDepthImageView_);
+		hitFramebuffer_ = logicalDevice_.createFramebuffer(
+			vk::FramebufferCreateInfo()
+			.setRenderPass(hitRenderPass_)
+			.setAttachmentCount(uint32_t(views.size()))
+			.setPAttachments(views.data())
+			.setWidth(MaxHitExtent)
+			.setHeight(MaxHitExtent)
+			.setLayers(1));
+
+		PipelineDescription description;
+		description.vertexShader = "hit.vert";
+		description.fragmentShader = "hit.frag";
+		description.vertexBindings = {vk::VertexInputBindingDescription(0, sizeof(HitVertex), vk::VertexInputRate::eVertex)};
+		description.vertexAttributes = {
+			vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(HitVertex, position)),
+			vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32Uint, offsetof(HitVertex, id))
+		};
+		description.descriptorSetLayouts = {context_->sceneSetLayout};
+
+		// Surfaces hide what is behind them like in the scene; lines and points never do, see GetLineState().
+		for (size_t mode = 0; mode < size_t(HitMode::Count); ++mode)
+		{
+			const bool surfaces = HitMode(mode) == HitMode::Surfaces || HitMode(mode) == HitMode::TwoSidedSurfaces;
+			const bool lines = HitMode(mode) == HitMode::Lines || HitMode(mode) == HitMode::OverlayLines;
+
+			description.topology = lines ? vk::PrimitiveTopology::eLineList : vk::PrimitiveTopology::eTriangleList;
+			description.depthTest = HitMode(mode) != HitMode::OverlayPoints && HitMode(mode) != HitMode::OverlayLines;
+
+			PipelineState state;
+			state.depthWrite = surfaces;
+			state.twoSided = HitMode(mode) != HitMode::Surfaces;
+
+			hitPipelines_.emplace_back(logicalDevice_, context_->pipelineCache, presentationSurfaceFormat_, hitRenderPass_, 0, description, state, false);
+			NameObject(vk::ObjectType::ePipeline, hitPipelines_.back().GetHandle(), [&] { return "Hit mode " + std::to_string(mode); });
+		}
+		NameObject(vk::ObjectType::eImage, hitImage_, [] { return "Hit target"s; });
+	}
+
+	void DestroyHitTarget()
+	{
+		hitPipelines_.clear();
+		logicalDevice_.destroyFramebuffer(hitFramebuffer_);
+		logicalDevice_.destroyImageView(hitImageView_);
+		logicalDevice_.destroyImage(hitImage_);
+		logicalDevice_.destroyImageView(hitDepthImageView_);
+		logicalDevice_.destroyImage(hitDepthImage_);
+		memoryAllocator_->Free(hitImageMemory_);
+		memoryAllocator_->Free(hitDepthImageMemory_);
+		logicalDevice_.destroyRenderPass(hitRenderPass_);
+		hitRenderPass_ = nullptr;
+	}
+
+	// Creates every pipeline state the draw calls use up front so that draws never stall on pipeline creation:
+	// all blend/depth write/cull permutations, the depth pre-pass states and the line and point states.
+	// With extended dynamic state, cull mode and depth write/compare are not part of the pipeline, which leaves one pipeline per program and blend mode.
+	void InitPipelines()
+	{
+		for (size_t program = 0; program < size_t(SceneProgram::Count); ++program)
+		{
+			// Only ever used with the states below.
+			if (SceneProgram(program) == SceneProgram::WorldDepth)
+				continue;
+
+			for (size_t blendMode = 0; blendMode < size_t(BlendMode::Count); ++blendMode)
+			{
+				for (const bool depthWrite : {false, true})
+				{
+					for (const bool twoSided : {false, true})
+					{
+						PipelineState state;
+						state.blendMode = BlendMode(blendMode);
+						state.depthWrite = depthWrite;
+						state.twoSided = twoSided;
+						(void)GetPipeline(SceneProgram(program), state);
+					}
+				}
+			}
+		}
+
+		// The depth pre-pass can be switched on at any time, see VKDEPTHPREPASS.
+		for (const bool twoSided : {false, true})
+		{
+			(void)GetPipeline(SceneProgram::WorldDepth, GetDepthPrePassState(twoSided));
+			(void)GetPipeline(SceneProgram::World, GetDepthEqualState(twoSided));
+		}
+
+		// Editor lines and points only test depth when depth-cued, see GetLineState().
+		for (size_t batchIndex = 0; batchIndex < std::tuple_size_v<decltype(LineBatch::lines)>; ++batchIndex)
+		{
+			(void)GetPipeline(SceneProgram::Line, GetLineState(batchIndex));
+			(void)GetPipeline(SceneProgram::Color, GetLineState(batchIndex));
+		}
+
+		PipelineDescription upscaleDescription;
+		upscaleDescription.vertexShader = "upscale.vert";
+		upscaleDescription.fragmentShader = "upscale.frag";
+		upscaleDescription.descriptorSetLayouts = {compositeSetLayout_};
+		upscaleDescription.pushConstantRanges = {vk::PushConstantRange(vk::ShaderStageFlagBits::eFragment, 0, sizeof(UpscaleParameters))};
+		upscaleDescription.depthTest = false;
+
+		PipelineState upscaleState;
+		upscaleState.depthWrite = false;
+		upscaleState.twoSided = true;
+
+		upscalePipeline_.emplace(logicalDevice_, context_->pipelineCache, presentationSurfaceFormat_, compositeRenderPass_, 0, std::move(upscaleDescription), upscaleState, false);
+		NameObject(vk::ObjectType::ePipeline, upscalePipeline_->GetHandle(), [] { return "Upscale"s; });
+
+		DebugPrint("Created ", pipelines_.size(), " pipelines.");
+	}
+
+	const Pipeline& GetPipeline(SceneProgram program, const PipelineState& state)
+	{
+		// PipelineState keys fit in 8 bits.
+		const auto key = state.GetKey(supportsExtendedDynamicState_) | uint32_t(program) << 8;
+
+		auto it = pipelines_.find(key);
+		if (it == pipelines_.end())
+		{
+			it = pipelines_.emplace(
+				key,
+				Pipeline(
+					logicalDevice_,
+					context_->pipelineCache,
+					presentationSurfaceFormat_,
+					renderPass_,
+					0,
+					GetScenePipelineDescription(program),
+					state,
+					supportsExtendedDynamicState_)).first;
+			NameObject(
+				vk::ObjectType::ePipeline,
+				it->second.GetHandle(),
+				[&]
+				{
+					constexpr const char* ProgramNames[] = {"Gouraud", "Color", "World", "Line", "Tile", "World depth"};
+					static_assert(std::size(ProgramNames) == size_t(SceneProgram::Count));
+					return ProgramNames[size_t(program)] + " state "s + std::to_string(key & 0xFF);
+				});
+		}
+
+		return it->second;
+	}
+
+	const Pipeline& BindPipelineState(SceneProgram program, const PipelineState& state)
+	{
+		auto& commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+
+		const auto& pipeline = GetPipeline(program, state);
+		if (pipeline.GetHandle() != boundPipeline_)
+		{
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.GetHandle());
+			boundPipeline_ = pipeline.GetHandle();
+		}
+
+		// The same for every draw; scene pipelines share one layout, so the set stays bound across pipeline switches.
+		if (!isPaletteSetBound_)
+		{
+			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.GetLayout(), 3, context_->paletteDescriptorSet, nullptr);
+			isPaletteSetBound_ = true;
+		}
+
+		// Changes with the scene node only.
+		if (boundSceneUniformSet_ != sceneUniformSet_ || boundSceneUniformOffset_ != sceneUniformOffset_)
+		{
+			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.GetLayout(), 4, sceneUniformSet_, sceneUniformOffset_);
+			boundSceneUniformSet_ = sceneUniformSet_;
+			boundSceneUniformOffset_ = sceneUniformOffset_;
+		}
+
+#ifdef VK_EXT_extended_dynamic_state
+		if (supportsExtendedDynamicState_)
+		{
+			if (!boundRasterState_ || boundRasterState_->twoSided != state.twoSided)
+				commandBuffer.setCullModeEXT(state.GetCullMode());
+			if (!boundRasterState_ || boundRasterState_->depthWrite != state.depthWrite)
+				commandBuffer.setDepthWriteEnableEXT(state.depthWrite);
+			if (!boundRasterState_ || boundRasterState_->depthCompare != state.depthCompare)
+				commandBuffer.setDepthCompareOpEXT(state.depthCompare);
+			boundRasterState_ = state;
+		}
+#endif
+
+		return pipeline;
+	}
+
+	// All scene programs share one layout, so descriptor sets and push constants stay valid across pipeline switches.
+	[[nodiscard]] PipelineDescription GetScenePipelineDescription(SceneProgram program) const
+	{
+		PipelineDescription description;
+		description.descriptorSetLayouts = {
+			context_->textureSetLayout,
+			context_->samplerSetLayout,
+			context_->surfaceSetLayout,
+			context_->textureSetLayout,
+			context_->sceneSetLayout
+		};
+		description.pushConstantRanges = {vk::PushConstantRange(vk::ShaderStageFlagBits::eFragment, 0, sizeof(DrawParameters))};
+
+		switch (program)
+		{
+		case SceneProgram::Gouraud:
+			description.vertexShader = "gouraud.vert";
+			description.fragmentShader = "gouraud.frag";
+			description.vertexBindings = {vk::VertexInputBindingDescription(0, sizeof(vertex_packing::GouraudVertex), vk::VertexInputRate::eVertex)};
+			description.vertexAttributes = {
+				vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(vertex_packing::GouraudVertex, position)),
+				vk::VertexInputAttributeDescription(1, 0, vk::Format::eR16G16Sfloat, offsetof(vertex_packing::GouraudVertex, uv)),
+				vk::VertexInputAttributeDescription(2, 0, vk::Format::eR8G8B8A8Unorm, offsetof(vertex_packing::GouraudVertex, light)),
+				vk::VertexInputAttributeDescription(3, 0, vk::Format::eR8G8B8A8Unorm, offsetof(vertex_packing::GouraudVertex, fog))
+			};
+			break;
+		case SceneProgram::Tile:
+			description.vertexShader = "tile.vert";
+			description.fragmentShader = "gouraud.frag";
+			description.vertexBindings = {vk::VertexInputBindingDescription(0, sizeof(vertex_packing::TileVertex), vk::VertexInputRate::eVertex)};
+			description.vertexAttributes = {
+				vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(vertex_packing::TileVertex, position)),
+				vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32G32Sfloat, offsetof(vertex_packing::TileVertex, uv)),
+				vk::VertexInputAttributeDescription(2, 0, vk::Format::eR8G8B8A8Unorm, offsetof(vertex_packing::TileVertex, color))
+			};
+			break;
+		case SceneProgram::Color:
+		case SceneProgram::Line:
+			description.vertexShader = "color.vert";
+			description.fragmentShader = "color.frag";
+			description.vertexBindings = {vk::VertexInputBindingDescription(0, sizeof(vertex_packing::ColorVertex), vk::VertexInputRate::eVertex)};
+			description.vertexAttributes = {
+				vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(vertex_packing::ColorVertex, position)),
+				vk::VertexInputAttributeDescription(1, 0, vk::Format::eR8G8B8A8Unorm, offsetof(vertex_packing::ColorVertex, color))
+			};
+			if (program == SceneProgram::Line)
+				description.topology = vk::PrimitiveTopology::eLineList;
+			break;
+		case SceneProgram::World:
+		case SceneProgram::WorldDepth:
+			description.vertexShader = "world.vert";
+			description.fragmentShader = program == SceneProgram::World ? "world.frag" : "depth.frag";
+			description.colorWrite = program == SceneProgram::World;
+			// Binding 1 holds a SurfaceParameters record per draw, see FlushWorldQueue().
+			description.vertexBindings = {
+				vk::VertexInputBindingDescription(0, sizeof(vertex_packing::SurfaceVertex), vk::VertexInputRate::eVertex),
+				vk::VertexInputBindingDescription(1, sizeof(SurfaceParameters), vk::VertexInputRate::eInstance)
+			};
+			description.vertexAttributes = {
+				vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(vertex_packing::SurfaceVertex, position)),
+				vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32G32Sfloat, offsetof(vertex_packing::SurfaceVertex, uv))
+			};
+			for (uint32_t layer = 0; layer < 5; ++layer)
+			{
+				description.vertexAttributes.emplace_back(
+					2 + layer,
+					1,
+					vk::Format::eR32G32B32A32Sfloat,
+					uint32_t(offsetof(SurfaceParameters, layers) + layer * sizeof(SurfaceParameters::layers[0])));
+			}
+			description.vertexAttributes.emplace_back(7, 1, vk::Format::eR32G32Uint, uint32_t(offsetof(SurfaceParameters, flags)));
+			description.vertexAttributes.emplace_back(8, 1, vk::Format::eR16G16B16A16Uint, uint32_t(offsetof(SurfaceParameters, layerTextures)));
+			// The size of the layer texture array and whether it is indexed per surface, see AddWorldLayers().
+			if (program == SceneProgram::World)
+				description.fragmentConstants = {context_->worldLayerCount, context_->supportsLayerIndexing ? 1u : 0u};
+			break;
+		default:
+			throw std::runtime_error("Unknown scene program");
+		}
+
+		return description;
+	}
+
+	// Coordinates are in swapchain pixels, the way the game sees the screen; they are scaled to the current render extent.
+	void SetViewport(int32_t x, int32_t y, uint32_t width, uint32_t height)
+	{
+		auto& commandBuffer = frames_[currentFrameIndex_].commandBuffer;
+		sceneViewport_ = vk::Rect2D({x, y}, {width, height});
+
+		const auto scaleX = float(renderExtent_.width) / float(presentationSurfaceExtent_.width);
+		const auto scaleY = float(renderExtent_.height) / float(presentationSurfaceExtent_.height);
+
+		const auto viewport = vk::Viewport(float(x) * scaleX, float(y) * scaleY, float(width) * scaleX, float(height) * scaleY, 0.0f, 1.0f);
+		commandBuffer.setViewport(0, viewport);
+
+		const auto left = int32_t(std::floor(viewport.x));
+		const auto top = int32_t(std::floor(viewport.y));
+		const auto right = int32_t(std::ceil(viewport.x + viewport.width));
+		const auto bottom = int32_t(std::ceil(viewport.y + viewport.height));
+		commandBuffer.setScissor(0, vk::Rect2D({left, top}, {uint32_t(right - left), uint32_t(bottom - top)}));
+	}
+
+	[[nodiscard]] vk::Extent2D GetRenderExtent() const
+	{
+		const auto scale = dynamicResolution_.GetScale();
+		return vk::Extent2D(
+			std::clamp(uint32_t(std::lround(float(presentationSurfaceExtent_.width) * scale)), 1u, renderTargetExtent_.width),
+			std::clamp(uint32_t(std::lround(float(presentationSurfaceExtent_.height) * scale)), 1u, renderTargetExtent_.height));
+	}
+
+	void InitCompositeDescriptors()
+	{
+		SamplerState samplerState;
+		samplerState.clamp = true;
+		const auto sampler = context_->samplerCache->Get(samplerState);
+		compositeSetLayout_ = CreateSingleDescriptorSetLayout(vk::DescriptorType::eCombinedImageSampler, &sampler);
+	}
+
+	// Upscales the rendered part of the offscreen target to the whole swapchain image, applying the screen flash and brightness on the way.
+	void RecordComposite(vk::CommandBuffer commandBuffer)
+	{
+		commandBuffer.beginRenderPass(
+			vk::RenderPassBeginInfo()
+			.setRenderPass(compositeRenderPass_)
+			.setFramebuffer(swapChainImages_[currentImageIndex_].framebuffer)
+			.setRenderArea(vk::Rect2D({0, 0}, presentationSurfaceExtent_)),
+			vk::SubpassContents::eInline);
+		BeginLabel(commandBuffer, "Composite");
+
+		commandBuffer.setViewport(
+			0,
+			vk::Viewport(0.0f, 0.0f, float(presentationSurfaceExtent_.width), float(presentationSurfaceExtent_.height), 0.0f, 1.0f));
+		commandBuffer.setScissor(0, vk::Rect2D({0, 0}, presentationSurfaceExtent_));
+
+		// Allocated per frame, so that a resize never rewrites a set that a frame in flight still reads.
+		const auto compositeDescriptorSet = AllocateFrameDescriptorSet(compositeSetLayout_);
+		const auto imageInfo = vk::DescriptorImageInfo()
+		                       .setImageView(renderTargetImageView_)
+		                       .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+		logicalDevice_.updateDescriptorSets(
+			vk::WriteDescriptorSet()
+			.setDstSet(compositeDescriptorSet)
+			.setDstBinding(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setPImageInfo(&imageInfo),
+			nullptr);
+
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, upscalePipeline_->GetHandle());
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, upscalePipeline_->GetLayout(), 0, compositeDescriptorSet, nullptr);
+
+		UpscaleParameters parameters{
+			{float(renderExtent_.width) / float(renderTargetExtent_.width), float(renderExtent_.height) / float(renderTargetExtent_.height)},
+			{1.0f / float(renderTargetExtent_.width), 1.0f / float(renderTargetExtent_.height)},
+			settings_.upscaleFilter == UpscaleFilter::Sharpen ? settings_.sharpness : 0.0f
+		};
+		SetCompositeColorTransform(parameters);
+		commandBuffer.pushConstants(upscalePipeline_->GetLayout(), vk::ShaderStageFlagBits::eFragment, 0, sizeof(parameters), &parameters);
+
+		commandBuffer.draw(3, 1, 0, 0);
+
+		EndLabel(commandBuffer);
+		commandBuffer.endRenderPass();
+
+		// The bound pipeline and its state belong to the composite pass now.
+		boundPipeline_ = nullptr;
+		boundRasterState_.reset();
+		isPaletteSetBound_ = false;
+		boundSceneUniformSet_ = nullptr;
+	}
+
+	/**
+	The flash scales the scene by 2 * FlashScale and adds FlashFog, which is identity at FlashScale 0.5 and FlashFog 0; the game sends that
+	instead of skipping the flash. Brightness maps to gamma the way other UE renderers do it.
+	*/
+	void SetCompositeColorTransform(UpscaleParameters& parameters) const
+	{
+		constexpr float Tolerance = 0.5f / 255.0f;
+
+		const float flashScale[3] = {flashScale_.X, flashScale_.Y, flashScale_.Z};
+		const float flashFog[3] = {flashFog_.X, flashFog_.Y, flashFog_.Z};
+		bool isIdentity = true;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			parameters.flashScale[i] = std::clamp(flashScale[i] * 2.0f, 0.0f, 1.0f);
+			parameters.flashFog[i] = std::clamp(flashFog[i], 0.0f, 1.0f);
+			isIdentity = isIdentity && std::abs(parameters.flashScale[i] - 1.0f) < Tolerance && parameters.flashFog[i] < Tolerance;
+		}
+
+		const auto brightness = Viewport->GetOuterUClient()->Brightness;
+		parameters.inverseGamma = 1.0f / (0.4f + 2.0f * std::clamp(brightness, 0.0f, 1.0f));
+		isIdentity = isIdentity && std::abs(parameters.inverseGamma - 1.0f) < 0.001f;
+
+		parameters.colorTransform = isIdentity ? 0 : 1;
+	}
+
+	void InitTimestampQueries()
+	{
+		timestampValidBits_ = physicalDevice_.getQueueFamilyProperties()[renderingQueueFamilyIndex_].timestampValidBits;
+		timestampPeriod_ = physicalDevice_.getProperties().limits.timestampPeriod;
+
+		if (timestampValidBits_ == 0)
+		{
+			DebugPrint("The rendering queue does not support timestamps, dynamic resolution is unavailable.");
+			dynamicResolution_.Configure(0.0f, settings_.minResolutionScale, settings_.maxResolutionScale);
+			return;
+		}
+
+		timestampQueryPool_ = logicalDevice_.createQueryPool(
+			vk::QueryPoolCreateInfo()
+			.setQueryType(vk::QueryType::eTimestamp)
+			.setQueryCount(uint32_t(MaxFramesInFlight * 2)));
+	}
+
+	// Reads the scene pass duration of the current frame's previous use. Its fence has been waited on, so results are available.
+	void UpdateGpuFrameTime()
+	{
+		std::array<uint64_t, 2> timestamps{};
+		const auto result = logicalDevice_.getQueryPoolResults<uint64_t>(
+			timestampQueryPool_,
+			uint32_t(currentFrameIndex_ * 2),
+			2,
+			timestamps,
+			sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64);
+
+		if (result != vk::Result::eSuccess)
+			return;
+
+		const auto mask = timestampValidBits_ >= 64 ? ~uint64_t(0) : (uint64_t(1) << timestampValidBits_) - 1;
+		const auto ticks = (timestamps[1] - timestamps[0]) & mask;
+
+		gpuFrameTime_ = float(double(ticks) * timestampPeriod_ / 1000000.0);
+		dynamicResolution_.Update(gpuFrameTime_);
+
+		// Per megapixel, so that frames at different dynamic resolutions compare.
+		const auto& frame = frames_[currentFrameIndex_];
+		const auto megapixels = float(frame.renderExtent.width) * float(frame.renderExtent.height) / 1000000.0f;
+		if (megapixels > 0.0f)
+		{
+			auto& cost = depthPrePassCost_[frame.depthPrePass ? 1 : 0];
+			const auto sample = gpuFrameTime_ / megapixels;
+			cost = cost == 0.0f ? sample : cost + (sample - cost) * DepthPrePassCostWeight;
+		}
+	}
+
+	/**
+	Compares the averaged GPU time of frames with and without the depth pre-pass, scaled to the current resolution.
+	\note Both averages cover whatever was drawn while they were measured; toggle VKDEPTHPREPASS on the same view to compare.
+	*/
+	[[nodiscard]] std::wstring FormatDepthPrePassStatistics() const
+	{
+		const auto megapixels = float(renderExtent_.width) * float(renderExtent_.height) / 1000000.0f;
+
+		std::wstringstream text;
+		text
+			<< "Depth pre-pass " << (settings_.depthPrePass ? "on" : "off") << ", " << lastFrameDrawStatistics_.depthPrePassDraws
+			<< " surfaces, GPU " << std::fixed << std::setprecision(2);
+		if (depthPrePassCost_[0] != 0.0f && depthPrePassCost_[1] != 0.0f)
+		{
+			const auto without = depthPrePassCost_[0] * megapixels;
+			const auto with = depthPrePassCost_[1] * megapixels;
+			text << with << " ms with, " << without << " ms without (" << std::showpos << with - without << std::noshowpos << " ms)";
+		}
+		else
+			text << "time not yet measured " << (depthPrePassCost_[1] == 0.0f ? "with" : "without") << " it";
+
+		return text.str();
+	}
+
+	[[nodiscard]] std::wstring FormatFrameStatistics() const
+	{
+		std::wstringstream text;
+		text
+			<< "GPU " << std::fixed << std::setprecision(2) << gpuFrameTime_ << " ms, resolution " << renderExtent_.width << "x"
+			<< renderExtent_.height << " (" << int(dynamicResolution_.GetScale() * 100.0f + 0.5f) << "%), "
+			<< lastFrameDrawStatistics_.gouraudPolygons << " gouraud polygons in " << lastFrameDrawStatistics_.gouraudDraws << " draws, "
+			<< lastFrameDrawStatistics_.worldDraws << " world surfaces in " << lastFrameDrawStatistics_.worldSubmissions << " draws, "
+			<< lastFrameDrawStatistics_.tiles << " tiles in " << lastFrameDrawStatistics_.tileDraws << " draws, "
+			<< lastFrameDrawStatistics_.sceneNodes << " scene nodes, "
+			<< lastFrameDrawStatistics_.lines << " lines, " << lastFrameDrawStatistics_.points << " points, " << lastFrameDrawStatistics_.textureUploads << " texture uploads ("
+			<< lastFrameDrawStatistics_.unchangedTextureUploads << " unchanged skipped), " << FormatDepthPrePassStatistics();
+
+		return text.str();
+	}
+
+
+	// Low latency mode: blocks until the previously submitted frame has been presented, or finished by the GPU without present wait.
+	void WaitForPreviousFrame()
+	{
+		auto& previousFrame = frames_[(currentFrameIndex_ + MaxFramesInFlight - 1) % MaxFramesInFlight];
+		if (!previousFrame.isLatencyPending)
+			return;
+
+#ifdef VK_KHR_present_wait
+		if (previousFrame.presentId != 0)
+		{
+			// A timeout keeps a stalled compositor from freezing the game; the fence wait below still applies.
+			constexpr uint64_t Timeout = 100'000'000;
+			try
+			{
+				(void)logicalDevice_.waitForPresentKHR(swapChain_, previousFrame.presentId, Timeout);
+			}
+			catch (const vk::OutOfDateKHRError&)
+			{
+			}
+		}
+#endif
+
+		(void)logicalDevice_.waitForFences(previousFrame.fence, true, std::numeric_limits<uint64_t>::max());
+		context_->deletionQueue.Retire(previousFrame.serial);
+		RecordLatency(previousFrame);
+	}
+
+	// The frame is known to be done, i.e. presented or at least finished by the GPU.
+	void RecordLatency(FrameContext& frame)
+	{
+		const auto latency = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frame.lockTime).count();
+		latency_ = latency_ == 0.0f ? latency : latency_ + (latency - latency_) * 0.1f;
+		frame.isLatencyPending = false;
+	}
+
+	[[nodiscard]] std::wstring FormatLatencyStatistics() const
+	{
+		std::wstringstream text;
+		text
+			<< (supportsPresentWait_ && settings_.lowLatency ? "Lock-to-present" : "Lock-to-GPU-completion") << " latency " << std::fixed
+			<< std::setprecision(2) << latency_ << " ms, low latency " << (settings_.lowLatency ? "on" : "off") << ", frame limit ";
+		if (frameLimiter_.IsEnabled())
+			text << settings_.frameRateLimit << " fps";
+		else
+			text << "off";
+
+		return text.str();
 	}
 
-	void InitPipeline()
+	[[nodiscard]] std::wstring FormatDebugMessageStatistics() const
 	{
-		pipeline_ = std::make_optional(Pipeline(logicalDevice_, presentationSurfaceExtent_, presentationSurfaceFormat_, renderPass_, 0));
+		if (!context_->debugMessageFilter)
+			return L"Debug messages: VK_EXT_debug_utils is not enabled";
+
+		const auto& filter = *context_->debugMessageFilter;
+		std::wstringstream text;
+		text
+			<< "Debug messages: " << filter.GetCount(DebugMessageFilter::Severity::Error) << " errors, "
+			<< filter.GetCount(DebugMessageFilter::Severity::Warning) << " warnings, " << filter.GetCount(DebugMessageFilter::Severity::Info)
+			<< " info, " << filter.GetCount(DebugMessageFilter::Severity::Verbose) << " verbose, " << filter.GetSuppressedCount()
+			<< " suppressed as repeats";
+		return text.str();
 	}
 
+	[[nodiscard]] std::wstring FormatMemoryStatistics() const
+	{
+		const auto statistics = memoryAllocator_->GetStatistics();
+
+		std::wstringstream text;
+		text
+			<< "Device memory: " << statistics.usedSize / 1024 << " / " << statistics.reservedSize / 1024 << " KiB in "
+			<< statistics.allocationCount << " allocations, " << statistics.blockCount << " blocks, "
+			<< statistics.dedicatedAllocationCount << " dedicated, " << statistics.deviceMemoryObjectCount << " memory objects, fragmentation "
+			<< int(statistics.GetFragmentation() * 100.0f) << "%";
+
+		if (context_->textureDiskCache)
+		{
+			text
+				<< ", texture disk cache " << context_->textureDiskCache->GetFileSize() / (1024 * 1024) << " MiB, " << context_->textureDiskCache->GetHitCount()
+				<< " hits, " << context_->textureDiskCache->GetMissCount() << " misses";
+		}
+
+		if (context_->paletteTable)
+			text << ", palette rows " << context_->paletteTable->GetUsedRowCount() << " / " << PaletteTable::RowCount;
+
+		text << ", pending destructions " << context_->deletionQueue.GetPendingCount();
+
+		return text.str();
+	}
 
 	template <class ... TArgs>
 	static void DebugPrint(const TArgs&... args)
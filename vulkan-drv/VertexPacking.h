@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define VERTEX_PACKING_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Compact vertex formats and the writers that fill them from the engine's float data. Independent of the engine headers.
+namespace vertex_packing
+{
+	// 24 bytes. UVs are half floats normalized by the texture size, so tiling still works; colors are RGBA8.
+	struct GouraudVertex
+	{
+		float position[3];
+		uint16_t uv[2];
+		uint32_t light;
+		uint32_t fog;
+	};
+
+	static_assert(sizeof(GouraudVertex) == 24);
+
+	// 16 bytes, for untextured geometry.
+	struct ColorVertex
+	{
+		float position[3];
+		uint32_t color;
+	};
+
+	static_assert(sizeof(ColorVertex) == 16);
+
+	// 20 bytes. UVs are texel coordinates along the surface's map axes; world.vert derives every layer's coordinates from them.
+	struct SurfaceVertex
+	{
+		float position[3];
+		float uv[2];
+	};
+
+	static_assert(sizeof(SurfaceVertex) == 20);
+
+	// 24 bytes. Position is in pixels of the scene node with the view depth in z; tile.vert projects it. UVs are normalized like
+	// GouraudVertex's but stay floats, since tiled backgrounds repeat a texture far beyond what half floats resolve.
+	struct TileVertex
+	{
+		float position[3];
+		float uv[2];
+		uint32_t color;
+	};
+
+	static_assert(sizeof(TileVertex) == 24);
+
+	/**
+	Float to half with round to nearest. Magnitudes below the smallest normal half flush to zero and overflow saturates to the largest
+	finite half; texture coordinates never need either.
+	*/
+	inline uint16_t ToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		const auto sign = uint16_t((bits >> 16) & 0x8000);
+		const auto magnitude = bits & 0x7FFFFFFF;
+		if (magnitude < 0x38800000)
+			return sign;
+		if (magnitude >= 0x477FF000)
+			return uint16_t(sign | 0x7BFF);
+
+		return uint16_t(sign | ((magnitude - 0x38000000 + 0xFFF + ((magnitude >> 13) & 1)) >> 13));
+	}
+
+	inline uint32_t ToColor(const float* rgba)
+	{
+		uint32_t color = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			const auto channel = rgba[i] <= 0.0f ? 0.0f : rgba[i] >= 1.0f ? 255.0f : rgba[i] * 255.0f;
+			color |= uint32_t(channel + 0.5f) << (i * 8);
+		}
+		return color;
+	}
+
+	/**
+	\param light RGBA floats, 0..1. Alpha is ignored and written as opaque. Null writes opaque white (PF_Modulated).
+	\param fog RGBA floats, 0..1. Null writes zero, for polygons that are not fogged.
+	\param uvScale Reciprocal of the texture size in texels.
+	*/
+	inline void PackGouraudVertex(
+		const float* position,
+		float u,
+		float v,
+		const float* light,
+		const float* fog,
+		const float* uvScale,
+		GouraudVertex& destination)
+	{
+		std::memcpy(destination.position, position, sizeof(destination.position));
+
+#if VERTEX_PACKING_SSE2
+		// Both colors are converted and packed together; UV halves use the integer path of ToHalf() on two lanes at once.
+		const auto zero = _mm_setzero_ps();
+		const auto one = _mm_set1_ps(1.0f);
+		const auto scale = _mm_set1_ps(255.0f);
+
+		const auto lightValue = light ? _mm_loadu_ps(light) : one;
+		const auto fogValue = fog ? _mm_loadu_ps(fog) : zero;
+		const auto lightInt = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(lightValue, zero), one), scale));
+		const auto fogInt = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(fogValue, zero), one), scale));
+		const auto colors = _mm_packus_epi16(_mm_packs_epi32(lightInt, fogInt), _mm_setzero_si128());
+		destination.light = uint32_t(_mm_cvtsi128_si32(colors)) | 0xFF000000u;
+		destination.fog = uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(colors, 4)));
+
+		const auto uv = _mm_castps_si128(_mm_mul_ps(_mm_setr_ps(u, v, 0.0f, 0.0f), _mm_setr_ps(uvScale[0], uvScale[1], 0.0f, 0.0f)));
+		const auto sign = _mm_and_si128(_mm_srli_epi32(uv, 16), _mm_set1_epi32(0x8000));
+		const auto magnitude = _mm_and_si128(uv, _mm_set1_epi32(0x7FFFFFFF));
+		const auto odd = _mm_and_si128(_mm_srli_epi32(magnitude, 13), _mm_set1_epi32(1));
+		auto half = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(magnitude, _mm_set1_epi32(0xFFF - 0x38000000)), odd), 13);
+		// Compares are signed, which is fine as the sign bit is cleared.
+		const auto tooSmall = _mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x38800000));
+		const auto tooLarge = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x477FEFFF));
+		half = _mm_andnot_si128(tooSmall, half);
+		half = _mm_or_si128(_mm_andnot_si128(tooLarge, half), _mm_and_si128(tooLarge, _mm_set1_epi32(0x7BFF)));
+		half = _mm_or_si128(half, sign);
+		destination.uv[0] = uint16_t(_mm_cvtsi128_si32(half));
+		destination.uv[1] = uint16_t(_mm_cvtsi128_si32(_mm_srli_si128(half, 4)));
+#else
+		static constexpr float White[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+		destination.light = ToColor(light ? light : White) | 0xFF000000u;
+		destination.fog = fog ? ToColor(fog) : 0;
+		destination.uv[0] = ToHalf(u * uvScale[0]);
+		destination.uv[1] = ToHalf(v * uvScale[1]);
+#endif
+	}
+
+	// Appends the triangle list indices of a fan whose first vertex is firstVertex.
+	inline uint16_t* WriteFanIndices(uint16_t firstVertex, uint32_t vertexCount, uint16_t* destination)
+	{
+		for (uint32_t i = 1; i + 1 < vertexCount; ++i)
+		{
+			*destination++ = firstVertex;
+			*destination++ = uint16_t(firstVertex + i);
+			*destination++ = uint16_t(firstVertex + i + 1);
+		}
+		return destination;
+	}
+}
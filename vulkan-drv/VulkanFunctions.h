@@ -0,0 +1,9 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// VK_EXT_debug_utils is an instance extension; only call its functions when it is enabled.
+void LoadVulkanDebugUtilsFunctions(VkInstance instance);
+
+// Device-level extension entry points are not exported by the loader, so they are resolved once the device is created.
+void LoadVulkanDeviceFunctions(VkDevice device);
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Untextured geometry in view space, see gouraud.vert.
+layout(set = 4, binding = 0) uniform Scene {
+    vec4 projection;
+} scene;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    gl_Position = vec4(
+        inPosition.xy * scene.projection.xy,
+        inPosition.z * scene.projection.z + scene.projection.w,
+        inPosition.z);
+    outColor = inColor;
+}
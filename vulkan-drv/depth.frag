@@ -0,0 +1,6 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// The depth pre-pass of world surfaces, see UVulkan1RenderDevice::FlushWorldQueue(). Only depth is written.
+void main() {
+}
@@ -0,0 +1,78 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+const uint AlphaTest = 1;
+const uint DiffusePalette = 32;
+const uint Masked = 256;
+const uint PaletteBilinear = 512;
+
+layout(set = 0, binding = 0) uniform texture2D diffuseTexture;
+layout(set = 1, binding = 0) uniform sampler diffuseSampler;
+layout(set = 3, binding = 0) uniform texture2D paletteTexture;
+
+layout(push_constant) uniform Parameters {
+    vec4 distanceFogColor;
+    float distanceFogScale; // 1 / fog end distance, 0 without distance fog (Rune).
+    uint flags;
+    uint paletteRows; // Diffuse, detail and macro rows, 10 bits each.
+} parameters;
+
+layout(location = 0) in vec2 inUv;
+layout(location = 1) in vec4 inLight;
+layout(location = 2) in vec4 inFog;
+layout(location = 3) in float inDepth;
+
+layout(location = 0) out vec4 outColor;
+
+// Palette-indexed textures hold indices in R8; their colors are rows of paletteTexture, see PaletteTable.h.
+// Textures are powers of two, so addressing wraps with a mask.
+vec4 paletteColor(uint index, uint row, bool masked) {
+    if (masked && index == 0)
+        return vec4(0.0);
+    return texelFetch(paletteTexture, ivec2(index, row), 0);
+}
+
+vec4 paletteTexel(sampler2D indices, ivec2 texel, ivec2 size, int level, uint row, bool masked) {
+    uint index = uint(texelFetch(indices, texel & (size - 1), level).r * 255.0 + 0.5);
+    return paletteColor(index, row, masked);
+}
+
+// The sampler only picks the mip; filtering happens after the lookup, manually for PaletteBilinear.
+vec4 samplePalette(sampler2D indices, vec2 uv, uint row, bool masked) {
+    int level = clamp(int(textureQueryLod(indices, uv).x + 0.5), 0, textureQueryLevels(indices) - 1);
+    ivec2 size = textureSize(indices, level);
+
+    if ((parameters.flags & PaletteBilinear) == 0)
+        return paletteTexel(indices, ivec2(floor(uv * vec2(size))), size, level, row, masked);
+
+    vec2 position = uv * vec2(size) - 0.5;
+    ivec2 texel = ivec2(floor(position));
+    vec2 weight = position - floor(position);
+    return mix(
+        mix(paletteTexel(indices, texel, size, level, row, masked), paletteTexel(indices, texel + ivec2(1, 0), size, level, row, masked), weight.x),
+        mix(paletteTexel(indices, texel + ivec2(0, 1), size, level, row, masked), paletteTexel(indices, texel + ivec2(1, 1), size, level, row, masked), weight.x),
+        weight.y);
+}
+
+uint paletteRow(uint slot) {
+    return (parameters.paletteRows >> (slot * 10)) & 1023;
+}
+
+void main() {
+    vec4 color = (parameters.flags & DiffusePalette) != 0
+        ? samplePalette(sampler2D(diffuseTexture, diffuseSampler), inUv, paletteRow(0), (parameters.flags & Masked) != 0)
+        : texture(sampler2D(diffuseTexture, diffuseSampler), inUv);
+
+    if ((parameters.flags & AlphaTest) != 0 && color.a < 0.5)
+        discard;
+
+    // Light is white and fog black when the flags exclude them, see vertex_packing::PackGouraudVertex().
+    color.rgb *= inLight.rgb;
+    color.rgb = color.rgb * (1.0 - inFog.rgb) + inFog.rgb;
+
+    // Linear from the eye to the fog end; the fog color is chosen to be neutral for the blend mode.
+    if (parameters.distanceFogScale > 0.0)
+        color.rgb = mix(color.rgb, parameters.distanceFogColor.rgb, clamp(inDepth * parameters.distanceFogScale, 0.0, 1.0));
+
+    outColor = color;
+}
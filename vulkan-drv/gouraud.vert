@@ -0,0 +1,36 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Models arrive in view space: x right, y down, z forward.
+layout(set = 4, binding = 0) uniform Scene {
+    vec4 projection; // x and y scale, depth scale and offset.
+    vec4 viewport;
+    float nearDepth; // Vertices closer than this are pushed out along their view ray, see nearPosition().
+} scene;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inUv;
+layout(location = 2) in vec4 inLight;
+layout(location = 3) in vec4 inFog;
+
+layout(location = 0) out vec2 outUv;
+layout(location = 1) out vec4 outLight;
+layout(location = 2) out vec4 outFog;
+layout(location = 3) out float outDepth;
+
+// Weapons come closer than the near plane. Scaling the whole position keeps the vertex on its pixel while moving its depth into range.
+vec3 nearPosition(vec3 position) {
+    return position.z > 0.0 && position.z < scene.nearDepth ? position * (scene.nearDepth / position.z) : position;
+}
+
+void main() {
+    vec3 position = nearPosition(inPosition);
+    gl_Position = vec4(
+        position.xy * scene.projection.xy,
+        position.z * scene.projection.z + scene.projection.w,
+        position.z);
+    outUv = inUv;
+    outLight = inLight;
+    outFog = inFog;
+    outDepth = inPosition.z;
+}
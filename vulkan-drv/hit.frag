@@ -0,0 +1,10 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) flat in uint inId;
+
+layout(location = 0) out uint outId;
+
+void main() {
+    outId = inId;
+}
@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// UnrealEd hit testing: the hit record ID of each primitive, projected like gouraud.vert with the uniforms of its scene node.
+layout(set = 0, binding = 0) uniform Scene {
+    vec4 projection;
+    vec4 viewport;
+    float nearDepth;
+} scene;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in uint inId;
+
+layout(location = 0) flat out uint outId;
+
+vec3 nearPosition(vec3 position) {
+    return position.z > 0.0 && position.z < scene.nearDepth ? position * (scene.nearDepth / position.z) : position;
+}
+
+void main() {
+    vec3 position = nearPosition(inPosition);
+    gl_Position = vec4(
+        position.xy * scene.projection.xy,
+        position.z * scene.projection.z + scene.projection.w,
+        position.z);
+    outId = inId;
+}
@@ -0,0 +1,32 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Tiles arrive in pixels of the scene node with the view depth in z. Only depth is projected, so a tile covers exactly its pixels
+// whatever the field of view; x and y are multiplied by w so that the perspective divide leaves them alone.
+layout(set = 4, binding = 0) uniform Scene {
+    vec4 projection;
+    vec4 viewport; // Half size of the scene node in pixels, then its reciprocal.
+    float nearDepth; // HUD tiles and weapon effects closer than this are moved to it.
+} scene;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inUv;
+layout(location = 2) in vec4 inColor;
+
+// The inputs of gouraud.frag, which shades tiles too.
+layout(location = 0) out vec2 outUv;
+layout(location = 1) out vec4 outLight;
+layout(location = 2) out vec4 outFog;
+layout(location = 3) out float outDepth;
+
+void main() {
+    float depth = max(inPosition.z, scene.nearDepth);
+    gl_Position = vec4(
+        (inPosition.xy * scene.viewport.zw - 1.0) * depth,
+        depth * scene.projection.z + scene.projection.w,
+        depth);
+    outUv = inUv;
+    outLight = inColor;
+    outFog = vec4(0.0);
+    outDepth = depth;
+}
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// The scene is rendered into the top-left part of a larger target, see DynamicResolutionController.
+layout(set = 0, binding = 0) uniform sampler2D sceneTexture;
+
+layout(push_constant) uniform Parameters {
+    vec2 uvScale;   // Rendered extent / target extent.
+    vec2 texelSize; // 1 / target extent.
+    float sharpness; // 0 is plain bilinear.
+    float inverseGamma;
+    uint colorTransform; // 0 when the flash and gamma below are identity.
+    vec4 flashScale;
+    vec4 flashFog;
+} parameters;
+
+layout(location = 0) in vec2 inUv;
+
+layout(location = 0) out vec4 outColor;
+
+vec3 fetch(vec2 uv, vec2 uvMax) {
+    return texture(sceneTexture, clamp(uv, 0.5 * parameters.texelSize, uvMax)).rgb;
+}
+
+void main() {
+    // Bilinear taps must not reach outside of the rendered part.
+    vec2 uvMax = parameters.uvScale - 0.5 * parameters.texelSize;
+    vec2 uv = inUv * parameters.uvScale;
+
+    vec3 color = fetch(uv, uvMax);
+
+    if (parameters.sharpness > 0.0) {
+        vec3 north = fetch(uv - vec2(0.0, parameters.texelSize.y), uvMax);
+        vec3 south = fetch(uv + vec2(0.0, parameters.texelSize.y), uvMax);
+        vec3 west = fetch(uv - vec2(parameters.texelSize.x, 0.0), uvMax);
+        vec3 east = fetch(uv + vec2(parameters.texelSize.x, 0.0), uvMax);
+
+        // Unsharp mask, limited to the neighbourhood's range so that edges don't ring.
+        vec3 minimum = min(color, min(min(north, south), min(west, east)));
+        vec3 maximum = max(color, max(max(north, south), max(west, east)));
+        vec3 sharpened = color + (4.0 * color - north - south - west - east) * parameters.sharpness;
+        color = clamp(sharpened, minimum, maximum);
+    }
+
+    // Screen flash and brightness are part of this pass so that they never cost another full-screen read and write.
+    if (parameters.colorTransform != 0) {
+        color = color * parameters.flashScale.rgb + parameters.flashFog.rgb;
+        color = pow(clamp(color, 0.0, 1.0), vec3(parameters.inverseGamma));
+    }
+
+    outColor = vec4(color, 1.0);
+}
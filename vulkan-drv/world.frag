@@ -0,0 +1,127 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+const uint AlphaTest = 1;
+const uint Lightmap = 2;
+const uint Fogmap = 4;
+const uint Detail = 8;
+const uint Macro = 16;
+const uint DiffusePalette = 32;
+const uint DetailPalette = 64;
+const uint MacroPalette = 128;
+const uint Masked = 256;
+const uint PaletteBilinear = 512;
+const uint LightmapRGBA7 = 1024;
+const uint FogmapRGBA7 = 2048;
+
+// TEXF_RGBA7 lightmaps and fogmaps are uploaded as they are; their 7 bits per channel are expanded here instead of on the CPU.
+const float RGBA7Scale = 2.0;
+
+// Detail textures fade out towards this view depth, like in the software renderer.
+const float DetailDistance = 380.0;
+
+// Size of layerTextures, and whether each surface selects its layers in it; see UVulkan1RenderDevice::AddWorldLayers().
+layout(constant_id = 0) const uint LayerTextureCount = 4;
+layout(constant_id = 1) const bool LayerIndexing = true;
+
+layout(set = 0, binding = 0) uniform texture2D diffuseTexture;
+layout(set = 1, binding = 0) uniform sampler diffuseSampler;
+// The layers of all surfaces of the batch. Absent layers are skipped through the flags.
+layout(set = 2, binding = 0) uniform texture2D layerTextures[LayerTextureCount];
+layout(set = 2, binding = 1) uniform sampler lightmapSampler; // Clamped, for lightmaps and fogmaps.
+layout(set = 2, binding = 2) uniform sampler layerSampler; // Wrapped, for detail and macro textures.
+layout(set = 3, binding = 0) uniform texture2D paletteTexture;
+
+// Flags and palette rows come per draw from world.vert; the push constants only hold the distance fog of the batch.
+layout(push_constant) uniform Parameters {
+    vec4 distanceFogColor;
+    float distanceFogScale;
+} parameters;
+
+layout(location = 0) in vec2 inDiffuseUv;
+layout(location = 1) in vec2 inLightmapUv;
+layout(location = 2) in vec2 inFogmapUv;
+layout(location = 3) in vec2 inDetailUv;
+layout(location = 4) in vec2 inMacroUv;
+layout(location = 5) in float inDepth;
+layout(location = 6) flat in uint inFlags;
+layout(location = 7) flat in uint inPaletteRows; // Diffuse, detail and macro rows, 10 bits each.
+layout(location = 8) flat in uvec4 inLayerTextures; // Lightmap, fogmap, detail, macro.
+
+layout(location = 0) out vec4 outColor;
+
+// Palette-indexed textures hold indices in R8; their colors are rows of paletteTexture, see PaletteTable.h.
+// Textures are powers of two, so addressing wraps with a mask.
+vec4 paletteColor(uint index, uint row, bool masked) {
+    if (masked && index == 0)
+        return vec4(0.0);
+    return texelFetch(paletteTexture, ivec2(index, row), 0);
+}
+
+vec4 paletteTexel(sampler2D indices, ivec2 texel, ivec2 size, int level, uint row, bool masked) {
+    uint index = uint(texelFetch(indices, texel & (size - 1), level).r * 255.0 + 0.5);
+    return paletteColor(index, row, masked);
+}
+
+// The sampler only picks the mip; filtering happens after the lookup, manually for PaletteBilinear.
+vec4 samplePalette(sampler2D indices, vec2 uv, uint row, bool masked) {
+    int level = clamp(int(textureQueryLod(indices, uv).x + 0.5), 0, textureQueryLevels(indices) - 1);
+    ivec2 size = textureSize(indices, level);
+
+    if ((inFlags & PaletteBilinear) == 0)
+        return paletteTexel(indices, ivec2(floor(uv * vec2(size))), size, level, row, masked);
+
+    vec2 position = uv * vec2(size) - 0.5;
+    ivec2 texel = ivec2(floor(position));
+    vec2 weight = position - floor(position);
+    return mix(
+        mix(paletteTexel(indices, texel, size, level, row, masked), paletteTexel(indices, texel + ivec2(1, 0), size, level, row, masked), weight.x),
+        mix(paletteTexel(indices, texel + ivec2(0, 1), size, level, row, masked), paletteTexel(indices, texel + ivec2(1, 1), size, level, row, masked), weight.x),
+        weight.y);
+}
+
+// Without dynamic indexing, element i holds layer i + 1 of every surface of the batch.
+uint layerTexture(uint layer) {
+    return LayerIndexing ? inLayerTextures[layer] : layer;
+}
+
+uint paletteRow(uint slot) {
+    return (inPaletteRows >> (slot * 10)) & 1023;
+}
+
+// Only the diffuse layer is masked.
+vec4 sampleLayer(sampler2D layer, vec2 uv, uint paletteFlag, uint slot) {
+    return (inFlags & paletteFlag) != 0
+        ? samplePalette(layer, uv, paletteRow(slot), slot == 0 && (inFlags & Masked) != 0)
+        : texture(layer, uv);
+}
+
+void main() {
+    vec4 color = sampleLayer(sampler2D(diffuseTexture, diffuseSampler), inDiffuseUv, DiffusePalette, 0);
+
+    if ((inFlags & AlphaTest) != 0 && color.a < 0.5)
+        discard;
+
+    // Detail and macro textures are centered around grey, hence the factor 2.
+    if ((inFlags & Macro) != 0)
+        color.rgb *= sampleLayer(sampler2D(layerTextures[layerTexture(3)], layerSampler), inMacroUv, MacroPalette, 2).rgb * 2.0;
+
+    if ((inFlags & Detail) != 0) {
+        float nearness = clamp(1.0 - inDepth / DetailDistance, 0.0, 1.0);
+        color.rgb *= mix(vec3(1.0), sampleLayer(sampler2D(layerTextures[layerTexture(2)], layerSampler), inDetailUv, DetailPalette, 1).rgb * 2.0, nearness);
+    }
+
+    if ((inFlags & Lightmap) != 0)
+        color.rgb *= texture(sampler2D(layerTextures[layerTexture(0)], lightmapSampler), inLightmapUv).rgb * ((inFlags & LightmapRGBA7) != 0 ? RGBA7Scale : 1.0);
+
+    // Fog is added on top, not modulated.
+    if ((inFlags & Fogmap) != 0) {
+        vec3 fog = texture(sampler2D(layerTextures[layerTexture(1)], lightmapSampler), inFogmapUv).rgb * ((inFlags & FogmapRGBA7) != 0 ? RGBA7Scale : 1.0);
+        color.rgb = color.rgb * (1.0 - fog) + fog;
+    }
+
+    if (parameters.distanceFogScale > 0.0)
+        color.rgb = mix(color.rgb, parameters.distanceFogColor.rgb, clamp(inDepth * parameters.distanceFogScale, 0.0, 1.0));
+
+    outColor = color;
+}
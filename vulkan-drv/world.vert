@@ -0,0 +1,49 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// World surfaces arrive in view space with texel coordinates on the surface's map axes; each layer pans and scales them.
+layout(set = 4, binding = 0) uniform Scene {
+    vec4 projection;
+    vec4 viewport;
+    float nearDepth; // Not applied: pushing water surfaces the player is in out of the way looks wrong.
+} scene;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inSurfaceUv;
+// Per draw, from the instance selected by firstInstance; see SurfaceParameters.
+layout(location = 2) in vec4 inLayers[5]; // Diffuse, lightmap, fogmap, detail, macro: pan in xy, 1 / size in zw.
+layout(location = 7) in uvec2 inDrawData; // Flags and palette rows for world.frag.
+layout(location = 8) in uvec4 inLayerTextures; // Elements of world.frag's layerTextures for the lightmap, fogmap, detail and macro texture.
+
+layout(location = 0) out vec2 outDiffuseUv;
+layout(location = 1) out vec2 outLightmapUv;
+layout(location = 2) out vec2 outFogmapUv;
+layout(location = 3) out vec2 outDetailUv;
+layout(location = 4) out vec2 outMacroUv;
+layout(location = 5) out float outDepth;
+layout(location = 6) flat out uint outFlags;
+layout(location = 7) flat out uint outPaletteRows;
+layout(location = 8) flat out uvec4 outLayerTextures;
+
+// The depth pre-pass runs this shader too, and the shading pass tests for exactly the depth it wrote.
+invariant gl_Position;
+
+vec2 layerUv(int layer) {
+    return (inSurfaceUv - inLayers[layer].xy) * inLayers[layer].zw;
+}
+
+void main() {
+    gl_Position = vec4(
+        inPosition.xy * scene.projection.xy,
+        inPosition.z * scene.projection.z + scene.projection.w,
+        inPosition.z);
+    outDiffuseUv = layerUv(0);
+    outLightmapUv = layerUv(1);
+    outFogmapUv = layerUv(2);
+    outDetailUv = layerUv(3);
+    outMacroUv = layerUv(4);
+    outDepth = inPosition.z;
+    outFlags = inDrawData.x;
+    outPaletteRows = inDrawData.y;
+    outLayerTextures = inLayerTextures;
+}